@@ -0,0 +1,162 @@
+/**
+ * Battery health tracking.
+ *
+ * Counts equivalent full cycles from the charge current, accumulates the
+ * time the pack spends near its charge voltage and at high temperature, and
+ * measures the full-charge capacity whenever the pack is charged from the
+ * cut-off to full without being discharged in between. The counters are small
+ * enough to keep in the EEPROM, and only change every few minutes of use.
+ *
+ * Only the charge current is measured by the BQ25895; the discharge current is
+ * estimated from the state of charge, which in turn is scaled by the measured
+ * capacity. Cycles and capacity are counted from the measured side so they
+ * don't feed back into themselves.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Within this of the cells' charge voltage counts as time at high voltage, in mV */
+#define BATT_HEALTH_HIGH_MARGIN_MV 100
+
+/** At or above this counts as time at high temperature, in degrees C */
+#define BATT_HEALTH_HOT_C 45
+
+/** Charge voltage is lowered by one step every this many cycles... */
+#define BATT_HEALTH_DERATE_CYCLES 200
+
+/** ...of this much, one BQ25895 VREG step, in mV... */
+#define BATT_HEALTH_DERATE_STEP_MV 16
+
+/** ...up to this much in total, in mV */
+#define BATT_HEALTH_DERATE_MAX_MV 64
+
+/** Pack temperature not known yet */
+#define BATT_HEALTH_TEMP_UNKNOWN INT8_MIN
+
+/**
+ * Counters kept across power loss.
+ */
+struct batt_health_data {
+  /** Equivalent full cycles, in tenths */
+  uint16_t cycles_x10;
+
+  /** Hours spent within BATT_HEALTH_HIGH_MARGIN_MV of the charge voltage */
+  uint16_t high_volt_h;
+
+  /** Hours spent at or above BATT_HEALTH_HOT_C */
+  uint16_t hot_h;
+
+  /** Measured full-charge capacity in mAh, 0 until the first measurement */
+  uint16_t capacity_mah;
+
+  /** Charges from the cut-off to termination measured, saturating */
+  uint8_t measurements;
+
+  /** Hottest pack temperature seen, in degrees C */
+  int8_t max_temp_c;
+};
+
+/**
+ * Tracker state.
+ */
+struct batt_health {
+  /** Counters kept across power loss */
+  struct batt_health_data data;
+
+  /** Set when data changed, cleared by the caller once saved */
+  bool changed;
+
+  /** Charged since the last tenth of a cycle was counted, in mA*s */
+  uint32_t cycle_mas;
+
+  /** Charge not yet accounted for in cycle_mas, in mA*ms */
+  uint32_t residue;
+
+  /** Time towards the next hour at high voltage and at high temperature, in ms */
+  uint32_t high_volt_ms;
+  uint32_t hot_ms;
+
+  /** Charged since the cut-off, in mA*s, if not discharged since */
+  uint32_t from_empty_mas;
+  bool from_empty;
+
+  /** Time of the last update, in ms */
+  uint32_t last_ms;
+
+  /** Time asleep since the last update, in ms, which the update's clock doesn't count */
+  uint32_t slept_ms;
+};
+
+/**
+ * Start tracking.
+ *
+ * @param h      Tracker state
+ * @param saved  Counters read back from the EEPROM, NULL or blank (0xFF) to start afresh
+ * @param now_ms Current time, in ms
+ */
+void batt_health_init(struct batt_health *h, struct batt_health_data const *saved, uint32_t now_ms);
+
+/**
+ * Account for the time since the last update, and any sleep reported since, at
+ * the given conditions. Charge is only counted over the time awake.
+ *
+ * @param h          Tracker state
+ * @param current_ma Pack current, positive when charging. Only the sign of a
+ *                   discharge current is used, the charge current should be
+ *                   the one measured by the BQ25895
+ * @param vbat_mv    Pack voltage, in mV
+ * @param temp_c     Pack temperature, or BATT_HEALTH_TEMP_UNKNOWN
+ * @param charge_mv  The cells' charge voltage, in mV
+ * @param rated_mah  The cells' rated capacity, one cycle's worth of discharge, in mAh
+ * @param now_ms     Current time, in ms
+ */
+void batt_health_update(struct batt_health *h, int16_t current_ma, uint16_t vbat_mv, int8_t temp_c,
+                        uint16_t charge_mv, uint16_t rated_mah, uint32_t now_ms);
+
+/**
+ * Account for time asleep, with the millisecond clock stopped, on the next
+ * update.
+ *
+ * @param h        Tracker state
+ * @param slept_ms Time asleep, in ms
+ */
+void batt_health_slept(struct batt_health *h, uint32_t slept_ms);
+
+/**
+ * The pack reached the cut-off: start measuring the capacity from here.
+ *
+ * @param h Tracker state
+ */
+void batt_health_empty(struct batt_health *h);
+
+/**
+ * The charger terminated. Completes a capacity measurement if the pack was
+ * charged from the cut-off, and by at least half its rated capacity.
+ *
+ * @param h         Tracker state
+ * @param rated_mah The cells' rated capacity, in mAh
+ * @return Whether the capacity was measured
+ */
+bool batt_health_full(struct batt_health *h, uint16_t rated_mah);
+
+/**
+ * State of health: the measured capacity against the rated one.
+ *
+ * @param h         Tracker state
+ * @param rated_mah The cells' rated capacity, in mAh
+ * @return Percentage, 100 until the capacity has been measured
+ */
+uint8_t batt_health_soh(struct batt_health const *h, uint16_t rated_mah);
+
+/**
+ * Charge voltage for the pack's age, lowered as the cycles add up to slow
+ * further fade.
+ *
+ * @param h         Tracker state
+ * @param charge_mv Configured charge voltage, in mV
+ * @return Charge voltage to use, in mV
+ */
+uint16_t batt_health_charge_mv(struct batt_health const *h, uint16_t charge_mv);
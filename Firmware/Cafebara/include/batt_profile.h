@@ -0,0 +1,41 @@
+/**
+ * Battery profiles.
+ *
+ * Everything that depends on the cells: the OCV curve, the charge voltage and
+ * current limits, and the discharge cutoffs. The profiles are defined in
+ * batt_profiles.json, and scripts/batt_profiles.py generates the tables in
+ * batt_profiles.h and batt_profiles.c from it.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "batt_profiles.h"
+#include "soc.h"
+
+/**
+ * Battery profile.
+ */
+struct batt_profile {
+  /** Relaxed OCV curve, and its lookup table */
+  struct soc_curve curve;
+
+  /** Charge voltage and current limits, in mV and mA */
+  uint16_t charge_mv;
+  uint16_t charge_ma;
+
+  /** Pre-charge and termination currents, in mA */
+  uint16_t precharge_ma;
+  uint16_t term_ma;
+
+  /** Lowest voltage to power on at, and the hard cutoff under load, in mV */
+  uint16_t min_mv;
+  uint16_t cutoff_mv;
+
+  /** Nominal full-charge capacity, in mAh */
+  uint16_t capacity_mah;
+};
+
+/** Profiles, indexed by enum batt_profile_id */
+extern const struct batt_profile batt_profiles[BATT_PROFILES];
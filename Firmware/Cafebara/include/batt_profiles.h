@@ -0,0 +1,17 @@
+/* Generated by scripts/batt_profiles.py from batt_profiles.json, do not edit */
+
+#pragma once
+
+/**
+ * Battery profiles, in the order of batt_profiles[].
+ */
+enum batt_profile_id {
+  /** Original pack */
+  BATT_STOCK,
+  /** 4.2V NMC 18650/21700 cells */
+  BATT_NMC,
+  /** 4.35V high-voltage LiPo cells */
+  BATT_LIHV,
+
+  BATT_PROFILES,
+};
@@ -0,0 +1,55 @@
+/**
+ * Boot and power-on phase timestamps.
+ *
+ * Each phase records the millisecond counter when it is reached, so the time
+ * spent in setup() and between holding the button and powering the console
+ * can be dumped over the console.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Traced phases, in the order they are normally reached.
+ */
+enum boot_phase {
+  /** setup() entered, interrupts enabled */
+  BOOT_START,
+  /** Settings loaded from EEPROM */
+  BOOT_EEPROM,
+  /** Pins, fan and I2C configured */
+  BOOT_IO,
+  /** BQ detected and configured */
+  BOOT_BQ,
+  /** State of charge initialised, entering the main loop */
+  BOOT_READY,
+
+  /** Power button pressed */
+  PWRON_PRESS,
+  /** Power button held long enough */
+  PWRON_HELD,
+  /** Battery checked */
+  PWRON_BATT,
+  /** PWR_EN raised */
+  PWRON_ENABLE,
+  /** Fan, ADC and battery monitor set up */
+  PWRON_DONE,
+
+  BOOT_PHASES,
+};
+
+/**
+ * Record the time a phase was reached. Marking PWRON_PRESS clears the later
+ * power-on phases, so each power-on is measured on its own.
+ *
+ * @param phase  Phase reached
+ * @param millis Current millisecond count
+ */
+void boot_trace_mark(enum boot_phase phase, uint32_t millis);
+
+/**
+ * Log every recorded phase, with its time and the time since the previous
+ * phase of the same sequence.
+ */
+void boot_trace_dump(void);
@@ -0,0 +1,56 @@
+/**
+ * Runtime charge configuration.
+ *
+ * The settings the Pi can change while running, kept as one block so that a
+ * new configuration is validated as a whole before any of it is applied.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Configuration fields, in the order of the Pi configuration window.
+ */
+enum charge_cfg_field {
+  /** Fast-charge current, in mA */
+  CHARGE_CFG_CHRG_CURRENT,
+  /** Pre-charge current, in mA */
+  CHARGE_CFG_PRE_CURRENT,
+  /** Termination current, in mA */
+  CHARGE_CFG_TERM_CURRENT,
+  /** Charge voltage, in mV */
+  CHARGE_CFG_CHRG_VOLTAGE,
+  /** Fan speed while powered, 0x00-0xFF */
+  CHARGE_CFG_FAN_SPEED,
+
+  CHARGE_CFG_FIELDS,
+};
+
+/** Bit for a field in a mask of fields */
+#define CHARGE_CFG_BIT(field) (1 << (field))
+
+/**
+ * Configuration, one value per field.
+ */
+struct charge_cfg {
+  uint16_t value[CHARGE_CFG_FIELDS];
+};
+
+/**
+ * Check every field against the range and step of its BQ25895 register field,
+ * the cell limits, and the other fields.
+ *
+ * @param cfg       Configuration to check
+ * @param max_mv    Highest charge voltage the cells allow, in mV
+ * @param max_ma    Highest charge current the cells allow, in mA
+ * @return CHARGE_CFG_FIELDS if valid, otherwise the first field rejected
+ */
+uint8_t charge_cfg_check(const struct charge_cfg *cfg, uint16_t max_mv, uint16_t max_ma);
+
+/**
+ * Compare two configurations.
+ *
+ * @return Mask of the fields that differ, see CHARGE_CFG_BIT()
+ */
+uint8_t charge_cfg_diff(const struct charge_cfg *a, const struct charge_cfg *b);
@@ -0,0 +1,72 @@
+/**
+ * Load-aware charge current control.
+ *
+ * Keeps the BQ25895 fast-charge current (ICHG) just below the point where the
+ * charger drops into input DPM or thermal regulation, so the adapter's power is
+ * split between the system load and the pack without the BQ hunting in and out
+ * of regulation.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bq25895.h"
+
+/**
+ * Controller state.
+ */
+struct charge_ctrl {
+  /** Configured charge current, the controller never exceeds this */
+  uint16_t limit_ma;
+
+  /** Charge current currently programmed into the BQ */
+  uint16_t setpoint_ma;
+
+  /** Highest setpoint known to be free of regulation */
+  uint16_t ceiling_ma;
+
+  /** Consecutive updates without regulation since the last step */
+  uint8_t stable_ticks;
+
+  /** Consecutive updates without regulation since the ceiling was relaxed */
+  uint8_t relax_ticks;
+};
+
+/**
+ * Initialise the controller, assuming the BQ is programmed with the limit.
+ *
+ * @param ctrl     Controller state
+ * @param limit_ma Maximum charge current, in mA
+ */
+void charge_ctrl_init(struct charge_ctrl *ctrl, uint16_t limit_ma);
+
+/**
+ * Forget the learned ceiling, eg. after the system load has changed.
+ *
+ * @param ctrl Controller state
+ */
+void charge_ctrl_reset(struct charge_ctrl *ctrl);
+
+/**
+ * Change the charge current limit, eg. when the temperature band changes.
+ * A lower limit is applied immediately; if no regulation has been learned the
+ * setpoint follows a higher limit straight away, otherwise it probes up to it.
+ *
+ * @param ctrl     Controller state
+ * @param dev      BQ25895 device handle
+ * @param limit_ma New maximum charge current, in mA
+ * @return true if successful, false on a bus error
+ */
+bool charge_ctrl_set_limit(struct charge_ctrl *ctrl, bq25895_t const *dev, uint16_t limit_ma);
+
+/**
+ * Run a single control step. Should be called periodically while fast charging.
+ * ICHG is only written when the setpoint actually changes.
+ *
+ * @param ctrl Controller state
+ * @param dev  BQ25895 device handle
+ * @return true if the step completed, false on a bus error
+ */
+bool charge_ctrl_update(struct charge_ctrl *ctrl, bq25895_t const *dev);
@@ -0,0 +1,80 @@
+/**
+ * Temperature-compensated (JEITA-style) charge profile.
+ *
+ * Picks the fast-charge current and charge voltage from a table of pack
+ * temperature bands, with hysteresis between neighbouring bands so that a
+ * pack sitting on a boundary doesn't keep flipping between them.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bq25895.h"
+
+/** No band selected yet */
+#define CHARGE_PROFILE_NO_BAND 0xFF
+
+/**
+ * Profile state.
+ */
+struct charge_profile {
+  /** Configured (maximum) charge current and voltage */
+  uint16_t ichg_max_ma;
+  uint16_t vreg_max_mv;
+
+  /** Currently selected band */
+  uint8_t band;
+
+  /** Charge current and voltage for the selected band */
+  uint16_t ichg_ma;
+  uint16_t vreg_mv;
+};
+
+/**
+ * Initialise the profile. The next update always selects and applies a band.
+ *
+ * @param prof        Profile state
+ * @param ichg_max_ma Configured charge current, in mA
+ * @param vreg_max_mv Configured charge voltage, in mV
+ */
+void charge_profile_init(struct charge_profile *prof, uint16_t ichg_max_ma, uint16_t vreg_max_mv);
+
+/**
+ * Select the band for the given pack temperature. When the band changes, the
+ * charge voltage is written to the BQ (only if it differs), and the caller is
+ * expected to apply `ichg_ma` as the new charge current limit.
+ *
+ * @param prof   Profile state
+ * @param dev    BQ25895 device handle
+ * @param temp_c Pack temperature, in degrees C
+ * @return true if the band changed
+ */
+bool charge_profile_update(struct charge_profile *prof, bq25895_t const *dev, int8_t temp_c);
+
+/**
+ * Change the configured charge current and voltage, keeping the selected
+ * band. The derated charge voltage is written to the BQ, and the caller is
+ * expected to apply `ichg_ma` as the charge current limit. With no band
+ * selected yet both are the configured values until the next update.
+ *
+ * @param prof        Profile state
+ * @param dev         BQ25895 device handle
+ * @param ichg_max_ma Configured charge current, in mA
+ * @param vreg_max_mv Configured charge voltage, in mV
+ * @return true if successful, false on a bus error
+ */
+bool charge_profile_set_max(struct charge_profile *prof, bq25895_t const *dev, uint16_t ichg_max_ma,
+                            uint16_t vreg_max_mv);
+
+/**
+ * Convert a TS ADC reading into a pack temperature, assuming a 103AT NTC with
+ * the datasheet's recommended RT1/RT2 divider.
+ *
+ * @param pct    TS voltage, in 0.1% of REGN
+ * @param temp_c Pack temperature, in degrees C
+ * @return false if the reading is outside of the NTC curve, or at the ADC's
+ *         ceiling (eg. no thermistor)
+ */
+bool charge_profile_ts_to_celsius(bq25895_ts_pct_t pct, int8_t *temp_c);
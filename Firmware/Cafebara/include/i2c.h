@@ -21,6 +21,9 @@
 /** Fast mode (400 KHz) */
 #define I2C_MODE_FAST           1
 
+/** Fast mode plus (1 MHz) */
+#define I2C_MODE_FAST_PLUS      2
+
 /**
  * I2C message flags.
  */
@@ -56,16 +59,78 @@ struct i2c_msg {
  */
 enum i2c_error {
   I2C_ERR = 1,
+  I2C_ERR_NACK,
+  I2C_ERR_ARB_LOST,
+  I2C_ERR_BUS,
+  I2C_ERR_TIMEOUT,
+};
+
+/**
+ * I2C controller error counters, saturating at 0xFFFF.
+ */
+struct i2c_stats {
+  /** Address or data not acknowledged */
+  uint16_t nack;
+
+  /** Arbitration lost to another controller */
+  uint16_t arb_lost;
+
+  /** Illegal bus condition */
+  uint16_t bus_err;
+
+  /** Bus did not respond in time */
+  uint16_t timeout;
+
+  /** Bus clear sequences sent */
+  uint16_t recoveries;
 };
 
 /**
  * Initialize the I2C bus as a controller.
  *
- * @param mode I2C_MODE_STANDARD or I2C_MODE_FAST
+ * @param mode Default bus speed, one of the I2C_MODE_* values
  * @return 0 if successful, negative error code
  */
 int i2c_configure(uint8_t mode);
 
+/**
+ * Set the bus speed used for transfers to a specific target device.
+ * Targets without their own speed use the default from `i2c_configure`.
+ *
+ * @param addr 7-bit I2C address of the target device
+ * @param mode Bus speed, one of the I2C_MODE_* values
+ * @return 0 if successful, negative error code
+ */
+int i2c_set_speed(uint8_t addr, uint8_t mode);
+
+/**
+ * Free a stuck bus, by clocking SCL until the target holding SDA low lets go,
+ * then sending a STOP condition. Only done when SDA stays low with SCL high,
+ * with the TWI controller and target both disabled meanwhile. A bus that is
+ * merely busy is left alone.
+ *
+ * @return 0 if the bus is free afterwards, negative error code otherwise
+ */
+int i2c_recover(void);
+
+/**
+ * Stop the controller before sleep. Target mode, and waking on an address
+ * match, carry on.
+ */
+void i2c_suspend(void);
+
+/**
+ * Start the controller again after `i2c_suspend`.
+ */
+void i2c_resume(void);
+
+/**
+ * Get the controller error counters, copied with interrupts disabled.
+ *
+ * @param stats Counters, copied out
+ */
+void i2c_get_stats(struct i2c_stats *stats);
+
 /**
  * Send one or more messages on the I2C bus, in a single transfer.
  * STOP is issued to terminate the operation; each message begins with a START.
@@ -0,0 +1,105 @@
+/**
+ * Battery IR compensation calibration.
+ *
+ * Measures the resistance between the BQ25895 BAT pin and the cells by stepping
+ * the charge current down during constant-current charging, and comparing the
+ * BATV/ICHGR ADC readings either side of the step. The result is programmed into
+ * BAT_COMP and VCLAMP, which delays the switch to constant-voltage charging.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bq25895.h"
+
+/** Largest compensation resistance supported by BAT_COMP, in mOhm */
+#define IRCOMP_MAX_MOHM  140
+
+/** Largest compensation voltage supported by VCLAMP, in mV */
+#define IRCOMP_MAX_CLAMP 224
+
+/**
+ * Calibration result.
+ */
+enum ircomp_result {
+  IRCOMP_IDLE,
+  IRCOMP_BUSY,
+  IRCOMP_DONE,
+  IRCOMP_FAILED,
+};
+
+/**
+ * Calibration state.
+ */
+struct ircomp {
+  /** Current step of the calibration sequence */
+  uint8_t state;
+
+  /** Updates spent in the current step */
+  uint8_t ticks;
+
+  /** Charge current to measure at, and to restore afterwards */
+  uint16_t setpoint_ma;
+
+  /** Configured charge current, used to size the clamp */
+  uint16_t limit_ma;
+
+  /** Charge voltage, used to detect constant-voltage charging */
+  uint16_t vreg_mv;
+
+  /** Accumulated BATV/ICHGR samples at the high and low current */
+  uint32_t v_sum[2];
+  uint32_t i_sum[2];
+
+  /** Measured resistance, in mOhm */
+  uint16_t measured_mohm;
+
+  /** Values programmed into BAT_COMP and VCLAMP */
+  uint8_t comp_mohm;
+  uint8_t clamp_mv;
+};
+
+/** Lowest charge current a calibration can start at, in mA */
+#define IRCOMP_MIN_SETPOINT_MA 1024
+
+/**
+ * Begin a calibration. The caller must stop adjusting ICHG until it completes.
+ *
+ * @param cal         Calibration state
+ * @param setpoint_ma Charge current currently programmed into the BQ
+ * @param limit_ma    Configured (maximum) charge current
+ * @param vreg_mv     Configured charge voltage
+ * @return false if the setpoint is below IRCOMP_MIN_SETPOINT_MA, too low for
+ *         its half-current step to be measured
+ */
+bool ircomp_start(struct ircomp *cal, uint16_t setpoint_ma, uint16_t limit_ma, uint16_t vreg_mv);
+
+/**
+ * Abandon a calibration, restoring the charge current.
+ *
+ * @param cal Calibration state
+ * @param dev BQ25895 device handle
+ */
+void ircomp_abort(struct ircomp *cal, bq25895_t const *dev);
+
+/**
+ * Check if a calibration is in progress.
+ *
+ * @param cal Calibration state
+ * @return true while calibrating
+ */
+bool ircomp_busy(struct ircomp const *cal);
+
+/**
+ * Run a single calibration step. Should be called about once per ADC conversion
+ * (1 s in continuous mode) while fast charging.
+ *
+ * @param cal Calibration state
+ * @param dev BQ25895 device handle
+ * @return IRCOMP_BUSY while running, IRCOMP_DONE once BAT_COMP/VCLAMP have been
+ *         programmed, IRCOMP_FAILED if the measurement was not usable, including
+ *         a resistance that measured as 0
+ */
+enum ircomp_result ircomp_update(struct ircomp *cal, bq25895_t const *dev);
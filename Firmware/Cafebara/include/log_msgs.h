@@ -0,0 +1,57 @@
+/**
+ * Log message table.
+ *
+ * Each entry is a message ID and its printf-style format. Only the IDs are
+ * compiled into the firmware: scripts/tlog_decode.py reads the formats from
+ * this file to turn the records back into text.
+ *
+ * Argument sizes follow the format, using the AVR's sizes: %hhu/%hhd/%hhx/%c
+ * are 1 byte, %u/%d/%x are 2 bytes and %lu/%ld/%lx are 4 bytes. %{name} is a
+ * 1-byte value of enum name, printed as the enumerator. Append new messages
+ * at the end, so IDs stay stable across firmware versions.
+ */
+
+#pragma once
+
+#include "tlog.h"
+
+#define LOG_MSGS(X)                                                         \
+  X(LOG_CONSOLE_UNKNOWN, "?")                                               \
+  X(LOG_STATUS_BATT,     "batt %umV %u/255 %dmA %ldmW")                     \
+  X(LOG_STATUS_TIME,     "tte %umin ttf %umin")                             \
+  X(LOG_STATUS_PWR,      "pwr %hhu chrg %hhu state %hhu fault 0x%02hhx")    \
+  X(LOG_I2C_STATS,       "nack %u arb %u bus %u timeout %u recover %u")     \
+  X(LOG_STACK,           "stack %u/%u used")                                \
+  X(LOG_BOOT_PHASE,      "%-7{boot_phase} %lums")                           \
+  X(LOG_BOOT_PHASE_NEXT, "%-7{boot_phase} %lums +%lu")                      \
+  X(LOG_PROF_HEADER,     "section   count min/avg/max us nested")           \
+  X(LOG_PROF_SECTION,    "%-9{prof_section} %5u %lu/%lu/%lu %5u")           \
+  X(LOG_POWER_ON,        "power on, batt %umV")                             \
+  X(LOG_POWER_OFF,       "power off, batt %umV")                            \
+  X(LOG_FAULT,           "charger fault 0x%02hhx")                          \
+  X(LOG_DROPPED,         "log dropped %u records")                          \
+  X(LOG_BATT_PROFILE,    "batt profile %{batt_profile_id}")                 \
+  X(LOG_CONFIG_APPLIED,  "config applied, changed 0x%02hhx ok %hhu")        \
+  X(LOG_CONFIG_REJECTED, "config rejected, %{charge_cfg_field}")            \
+  X(LOG_PSTATS_WAKE,     "%-17{pstats_wake} %lu")                           \
+  X(LOG_PSTATS_STATE,    "%-17{pstats_state} %lu.%03us")                    \
+  X(LOG_PSTATS_EVENT,    "%-17{pstats_event} %lu")                          \
+  X(LOG_RESET_CAUSE,     "reset flags 0x%02hhx, %hhu watchdog resets")      \
+  X(LOG_BROWNOUT,        "brownout, batt %umV %hhu/255")                    \
+  X(LOG_HEALTH_CYCLES,   "cycles %u.%u, high %uh, hot %uh, max %hhdC")      \
+  X(LOG_HEALTH_CAPACITY, "capacity %umAh, %hhu%% of rated, %hhu measured")  \
+  X(LOG_HEALTH_VREG,     "charge voltage %umV for age")                     \
+  X(LOG_SLEEP_FLOATING,  "sleep leak: P%c 0x%02hhx floating")               \
+  X(LOG_SLEEP_PERIPH,    "sleep leak: %{sleep_periph} left on")             \
+  X(LOG_SLEEP_CLEAN,     "sleep: no leaks")                                 \
+  X(LOG_TRACE_READ,      "trace bq %02hhx: %02hhx")                         \
+  X(LOG_TRACE_GPIO,      "trace %lums %{trace_pin} %hhu")                   \
+  X(LOG_TRACE_CHARGER,   "trace %lums pwr %hhu %{power_action} led %hhu")   \
+  X(LOG_TRACE_BATTERY,   "trace %lums %hhu/255 %{power_action} led %hhu")
+
+enum log_msg {
+#define LOG_MSG_ID(id, fmt) id,
+  LOG_MSGS(LOG_MSG_ID)
+#undef LOG_MSG_ID
+  LOG_MSG_COUNT,
+};
@@ -3,6 +3,9 @@
 #include "gpio.h"
 #include "button.h"
 #include "i2c_target.h"
+#include "bq25895.h"
+#include "charge_cfg.h"
+#include "trace.h"
 
 static const gpio_t SDA         = {&PORTB, 1};
 static const gpio_t SCL         = {&PORTB, 0};
@@ -21,29 +24,91 @@ struct button pwr_button;
 static const gpio_t TEMP_ALERT  = {&PORTB, 5};
 static const gpio_t HPD         = {&PORTB, 4};
 
+// Not connected, or not used: inputs with the digital input buffer off, so
+// they can float without drawing current
+static const gpio_t UNUSED_PINS[] = {
+  {&PORTA, 3}, {&PORTA, 4}, {&PORTA, 5}, {&PORTA, 6}, {&PORTA, 7},
+  {&PORTB, 3},
+  {&PORTC, 1}, {&PORTC, 2},
+};
+#define UNUSED_PIN_COUNT (sizeof(UNUSED_PINS) / sizeof(UNUSED_PINS[0]))
+
+// Inputs held at a level from outside in sleep, or not bonded out, by port
+#define SLEEP_HELD_A  PIN0_bm                       // UPDI
+#define SLEEP_HELD_B  (PIN0_bm | PIN1_bm | 0xC0)    // I2C, pulled up on the board
+#define SLEEP_HELD_C  0xF0
+
 int main();
 
 bool setup();
 void loop();
+void handlePinEvents();
 
 void getEEPROM();
+void countResets();
 void overTemp();
+void brownOut();
+void brownOutShutdown();
 void buttonHeld();
 void chargingStatus();
+void chargeControl();
+bool getPackTemp(int8_t *temp);
+void chargeProfile();
 void initFan();
 void setFan(bool active, uint8_t speed);
+void fanSuspend();
+void fanResume();
 void powerLED(uint8_t mode);
+void ledTask();
 void consoleOn();
 void consoleOff();
 void enableShipping();
 void setupBQ();
+bool applyChargeLimits();
+void setAdcContinuous(bool enable);
 void writeToEEPROM();
 void applyChanges();
 void getBattVoltage();
-bool i2c_bq_write(uint8_t addr, uint8_t reg, void const* buf, size_t len, void* context);
-bool i2c_bq_read(uint8_t addr, uint8_t reg, void const* buf, size_t len, void* context);
-void setLED(uint8_t r, uint8_t g, uint8_t b, float bright, bool enabled);
+bool i2c_bq_write(uint16_t addr, uint8_t reg, void const* buf, size_t len, void* context);
+bool i2c_bq_read(uint16_t addr, uint8_t reg, void* buf, size_t len, void* context);
+void bq_delay(uint16_t ms, void* context);
 void battChargeStatus();
+uint16_t chargeVoltage();
+void saveHealth();
+void battEmpty();
+void battFull();
+void selectBattProfile(uint8_t id);
+void getChargeConfig(struct charge_cfg *cfg);
+void syncConfigShadow();
+void applyPiConfig();
+void configTask();
+void enterBootloader();
+void monitorTask();
+void adcTask();
+void adcDone(bool ok, bq25895_adc_t const* adc, void* context);
 void monitorBatt();
+void traceGpio(enum trace_pin pin, gpio_t gpio);
 void checkHPDstatus();
-void setupUSART();
\ No newline at end of file
+void hpdSuspend();
+void hpdResume();
+void sleepAudit();
+void logSleepLeaks();
+void setupUSART();
+bool consoleAttached();
+uint16_t readStatsWord(uint8_t index);
+uint16_t readI2CStatsWord(uint8_t reg);
+void publishRegisters();
+uint16_t readRegisterWord(uint8_t reg);
+int handle_register_read(uint8_t reg, uint8_t *value);
+int handle_register_write(uint8_t reg, uint8_t value);
+void consoleTask();
+void cmdStatus(const char *args);
+void cmdBoot(const char *args);
+void cmdI2C(const char *args);
+void cmdStack(const char *args);
+void cmdBatt(const char *args);
+void cmdPower(const char *args);
+void cmdHealth(const char *args);
+void cmdSleep(const char *args);
+void cmdTrace(const char *args);
+void cmdProf(const char *args);
\ No newline at end of file
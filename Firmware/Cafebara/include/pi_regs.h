@@ -0,0 +1,196 @@
+/**
+ * Register map exposed to the Pi Zero 2W over the I2C target interface.
+ *
+ * Registers are bytes, and the register address auto-increments on each byte
+ * read. 16-bit values are little-endian and span two consecutive registers;
+ * reading the low byte latches the high byte, so a value read in one transfer
+ * is never torn by an update between the two bytes. The values themselves are
+ * published by the firmware's main loop every 50 ms, copied as a whole, so a
+ * read never catches one half-way through an update either.
+ */
+
+#pragma once
+
+/** Firmware version, uint8_t */
+#define PI_REG_VERSION        0x00
+
+/** Status flags, uint8_t. See PI_STATUS_* */
+#define PI_REG_STATUS         0x01
+
+/** Power error status (BQ25895 REG0C), uint8_t */
+#define PI_REG_FAULT          0x02
+
+/** Fan speed, uint8_t */
+#define PI_REG_FAN_SPEED      0x03
+
+/** Battery charge, uint8_t, 0x00-0xFF representing 0-100% */
+#define PI_REG_CHARGE         0x04
+
+/** Battery voltage (mV), uint16_t */
+#define PI_REG_BATT_VOLT      0x05
+
+/** Charging current (mA), uint16_t */
+#define PI_REG_CHRG_CURRENT   0x07
+
+/** Pre-charge current (mA), uint16_t */
+#define PI_REG_PRE_CURRENT    0x09
+
+/** Termination charge current (mA), uint16_t */
+#define PI_REG_TERM_CURRENT   0x0B
+
+/** Charging voltage (mV), uint16_t */
+#define PI_REG_CHRG_VOLTAGE   0x0D
+
+/** Estimated minutes until empty, uint16_t, 0xFFFF if not discharging */
+#define PI_REG_TIME_TO_EMPTY  0x0F
+
+/** Estimated minutes until full, uint16_t, 0xFFFF if not charging */
+#define PI_REG_TIME_TO_FULL   0x11
+
+/** Averaged pack current (mA, positive when charging), int16_t */
+#define PI_REG_BATT_CURRENT   0x13
+
+/** I2C controller error counters, uint16_t each. See struct i2c_stats */
+#define PI_REG_I2C_NACK       0x15
+#define PI_REG_I2C_ARB_LOST   0x17
+#define PI_REG_I2C_BUS_ERR    0x19
+#define PI_REG_I2C_TIMEOUT    0x1B
+#define PI_REG_I2C_RECOVERIES 0x1D
+
+/** Deepest the stack has been since reset (bytes), uint16_t */
+#define PI_REG_STACK_HIGH     0x1F
+
+/**
+ * Battery profile, uint16_t: the active profile in the low byte, and the
+ * number of profiles in the high byte. Writing a profile number to the low
+ * byte switches to it, and resets the IR calibration and charge estimate.
+ */
+#define PI_REG_BATT_PROFILE   0x21
+
+/**
+ * Configuration window, uint16_t each, in the order of enum charge_cfg_field.
+ * Writes only stage values; reads return the staged values, which match the
+ * live configuration until something is staged. Nothing takes effect until
+ * PI_CFG_COMMIT is written to PI_REG_CFG_COMMIT, and the window can be staged
+ * and committed in one transfer.
+ */
+#define PI_REG_CFG_FIRST      0x23
+#define PI_REG_CFG_CHRG_CURRENT 0x23
+#define PI_REG_CFG_PRE_CURRENT 0x25
+#define PI_REG_CFG_TERM_CURRENT 0x27
+#define PI_REG_CFG_CHRG_VOLTAGE 0x29
+#define PI_REG_CFG_FAN_SPEED  0x2B
+
+/**
+ * Configuration commit, uint16_t. Write PI_CFG_COMMIT to the low byte to
+ * validate and apply the staged configuration, or PI_CFG_REVERT to discard it.
+ * Reads give the status of the last commit in the low byte (PI_CFG_*), and the
+ * rejected field in the high byte (0xFF if none). Writes to the window are
+ * refused while a commit is pending.
+ */
+#define PI_REG_CFG_COMMIT     0x2D
+
+/**
+ * Power stats, uint16_t each, the low 16 bits of the counters in struct
+ * pstats. They wrap, so read them periodically and use the differences.
+ */
+
+/** Wakeups from sleep, by source, in the order of enum pstats_wake */
+#define PI_REG_PSTATS_FIRST   0x2F
+#define PI_REG_WAKE_BUTTON    0x2F
+#define PI_REG_WAKE_BQ_INT    0x31
+#define PI_REG_WAKE_TEMP_ALERT 0x33
+#define PI_REG_WAKE_HPD       0x35
+#define PI_REG_WAKE_RTC       0x37
+#define PI_REG_WAKE_TWI       0x39
+#define PI_REG_WAKE_USART     0x3B
+
+/** Minutes spent in each power state, in the order of enum pstats_state */
+#define PI_REG_TIME_ON        0x3D
+#define PI_REG_TIME_CHARGING  0x3F
+#define PI_REG_TIME_AWAKE     0x41
+#define PI_REG_TIME_STANDBY   0x43
+
+/** Event counts, in the order of enum pstats_event */
+#define PI_REG_I2C_TRANSFERS  0x45
+#define PI_REG_I2C_BYTES      0x47
+#define PI_REG_TWI_TRANSACTIONS 0x49
+#define PI_REG_TWI_BYTES      0x4B
+#define PI_REG_LED_REFRESHES  0x4D
+
+/** Write PI_PSTATS_RESET to the low byte to clear the power stats */
+#define PI_REG_PSTATS_RESET   0x4F
+
+/**
+ * Reset cause, uint16_t: RSTCTRL.RSTFR captured at boot in the low byte
+ * (see PI_RESET_*), and the number of watchdog resets saved in the EEPROM in
+ * the high byte.
+ */
+#define PI_REG_RESET_CAUSE    0x51
+
+/**
+ * Write BOOT_KEY to the low byte to start the I2C bootloader, reads BOOT_ID.
+ * Only in firmware built for the bootloader, see ../CafebaraBoot
+ */
+#define PI_REG_BOOT           0x53
+
+/** Equivalent full cycles, uint16_t, in tenths */
+#define PI_REG_CYCLES         0x55
+
+/** Hours spent near the charge voltage, uint16_t */
+#define PI_REG_HIGH_VOLT_HOURS 0x57
+
+/** Hours spent at or above 45C, uint16_t */
+#define PI_REG_HOT_HOURS      0x59
+
+/** Measured full-charge capacity (mAh), uint16_t, 0 until the first charge from the cut-off to full */
+#define PI_REG_CAPACITY       0x5B
+
+/**
+ * State of health, uint16_t: the measured capacity as a percentage of the
+ * rated capacity in the low byte (100 until measured), and the number of
+ * measurements in the high byte.
+ */
+#define PI_REG_HEALTH         0x5D
+
+/** Charge voltage in use (mV), uint16_t: PI_REG_CHRG_VOLTAGE lowered for the pack's age */
+#define PI_REG_CHRG_VOLTAGE_AGED 0x5F
+
+/** First unused register */
+#define PI_REG_END            0x61
+
+/**
+ * Status flags.
+ */
+#define PI_STATUS_POWERED     (1 << 0)
+#define PI_STATUS_CHARGING    (1 << 1)
+#define PI_STATUS_FAULT       (1 << 2)
+#define PI_STATUS_USBC_VIDEO  (1 << 3)
+#define PI_STATUS_CHRG_POS    4         // chargeStatus, 2 bits
+
+/**
+ * Configuration commit commands and status.
+ */
+#define PI_CFG_COMMIT         0xA5
+#define PI_CFG_REVERT         0x5A
+
+#define PI_CFG_IDLE           0         // Nothing committed since reset
+#define PI_CFG_PENDING        1         // Waiting to be applied
+#define PI_CFG_OK             2         // Applied and saved
+#define PI_CFG_INVALID        3         // Rejected, nothing applied
+#define PI_CFG_BUS_ERROR      4         // BQ write failed, all settings re-sent
+
+/**
+ * Power stats reset command.
+ */
+#define PI_PSTATS_RESET       0xA5
+
+/**
+ * Reset cause flags, as in RSTCTRL.RSTFR.
+ */
+#define PI_RESET_POWER_ON     (1 << 0)
+#define PI_RESET_BROWN_OUT    (1 << 1)
+#define PI_RESET_EXTERNAL     (1 << 2)
+#define PI_RESET_WATCHDOG     (1 << 3)
+#define PI_RESET_SOFTWARE     (1 << 4)
+#define PI_RESET_UPDI         (1 << 5)
@@ -0,0 +1,76 @@
+/**
+ * Power decisions.
+ *
+ * What the charger's status and the pack's charge call for: shutting the
+ * console down, and the LED mode to show (the modes of powerLED()). Kept
+ * apart from acting on them, and host-portable, so a trace recorded in the
+ * field can be replayed through the same decisions on the host (see sim/).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bq25895.h"
+
+/** No change to the LED mode */
+#define POWER_LED_KEEP 0xFF
+
+/** Error flash, shown before the LED mode decided when shutting down */
+#define POWER_LED_ERROR 5
+
+/**
+ * What to do.
+ */
+enum power_action {
+  POWER_NONE,       // Carry on
+  POWER_FAULT,      // Charger fault, turn the console off
+  POWER_OVERTEMP,   // Thermal fault, turn the console off and cool down
+  POWER_SHIP,       // Battery over-voltage, turn off and disconnect the pack
+  POWER_EMPTY,      // Pack at the cut-off, turn the console off
+};
+
+/**
+ * Charger status, as read from the BQ25895.
+ */
+struct power_charger {
+  /** Input power good */
+  bool connected;
+
+  /** Charge state */
+  bq25895_charge_state_t state;
+
+  /** Faults, bits of bq25895_fault_t. Reading them clears those no longer present */
+  bq25895_fault_t faults;
+};
+
+/**
+ * Read the charger status.
+ *
+ * @param bq Charger
+ * @param c  Status, written
+ * @return Whether every register was read
+ */
+bool power_charger_read(bq25895_t const *bq, struct power_charger *c);
+
+/**
+ * Decide on the charger status.
+ *
+ * @param c       Charger status
+ * @param powered Whether the console is on
+ * @param led     LED mode to show after acting, or POWER_LED_KEEP, written
+ * @return What to do, POWER_NONE to POWER_SHIP
+ */
+enum power_action power_charger_decide(struct power_charger const *c, bool powered, uint8_t *led);
+
+/**
+ * Decide on the pack's charge, while the console runs from it.
+ *
+ * @param soc       State of charge, 0 to 255
+ * @param vbat_mv   Pack voltage, in mV
+ * @param cutoff_mv The cells' cut-off under load, in mV
+ * @param led       LED mode to show after acting, written
+ * @return POWER_EMPTY or POWER_NONE
+ */
+enum power_action power_battery_decide(uint8_t soc, uint16_t vbat_mv, uint16_t cutoff_mv, uint8_t *led);
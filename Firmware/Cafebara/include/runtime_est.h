@@ -0,0 +1,61 @@
+/**
+ * Incremental time-to-empty / time-to-full estimation.
+ *
+ * Keeps exponentially weighted averages of pack power and current, updated once
+ * per telemetry tick in constant time and without floating point.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** Estimate not available (eg. not charging, or not discharging) */
+#define RUNTIME_UNKNOWN 0xFFFF
+
+/**
+ * Estimator state.
+ */
+struct runtime_est {
+  /** Averaged pack current (mA) and power (mW), scaled by 2^RUNTIME_EST_SHIFT */
+  int32_t current_avg;
+  int32_t power_avg;
+
+  /** Estimated minutes until empty and until full */
+  uint16_t tte_min;
+  uint16_t ttf_min;
+};
+
+/**
+ * Reset the estimator.
+ *
+ * @param rt Estimator state
+ */
+void runtime_est_init(struct runtime_est *rt);
+
+/**
+ * Fold a telemetry sample into the averages and refresh the estimates.
+ *
+ * @param rt           Estimator state
+ * @param current_ma   Pack current, positive when charging
+ * @param vbat_mv      Pack voltage, in mV
+ * @param charge_mas   Remaining charge, in mA*s
+ * @param capacity_mas Full-charge capacity, in mA*s
+ */
+void runtime_est_update(struct runtime_est *rt, int16_t current_ma, uint16_t vbat_mv, uint32_t charge_mas,
+                        uint32_t capacity_mas);
+
+/**
+ * Averaged pack current, positive when charging.
+ *
+ * @param rt Estimator state
+ * @return Current, in mA
+ */
+int16_t runtime_est_current(struct runtime_est const *rt);
+
+/**
+ * Averaged pack power, positive when charging.
+ *
+ * @param rt Estimator state
+ * @return Power, in mW
+ */
+int32_t runtime_est_power(struct runtime_est const *rt);
@@ -0,0 +1,74 @@
+/**
+ * Sleep current audit.
+ *
+ * Checks a snapshot of the pins and peripherals, taken right before standby
+ * sleep, for anything that keeps drawing current: inputs left floating with
+ * their digital input buffer on, and peripherals left running or holding a
+ * pin. Host-portable, so a simulated snapshot can be checked the same way.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Ports checked, PORTA to PORTC */
+#define SLEEP_AUDIT_PORTS 3
+
+/**
+ * Peripherals that should be stopped in sleep.
+ */
+enum sleep_periph {
+  SLEEP_FAN_PWM,      // Fan timer stopped with its output still holding the pin
+  SLEEP_USART_TX,     // Transmitter holding TX high into an unpowered host
+  SLEEP_TWI_MASTER,   // I2C controller enabled
+  SLEEP_ADC,          // ADC enabled
+  SLEEP_PERIPHS,
+};
+
+/**
+ * Pin state of one port, one bit per pin.
+ */
+struct sleep_port {
+  /** Pins configured as inputs */
+  uint8_t input;
+
+  /** Pins with their digital input buffer enabled */
+  uint8_t buffered;
+
+  /** Pins with the internal pull-up enabled */
+  uint8_t pullup;
+
+  /** Pins held at a level from outside (external pull-ups, powered drivers), or not bonded out */
+  uint8_t held;
+};
+
+/**
+ * What is left on going into sleep.
+ */
+struct sleep_snapshot {
+  struct sleep_port port[SLEEP_AUDIT_PORTS];
+
+  /** Peripherals left running, bits of enum sleep_periph */
+  uint8_t periphs;
+};
+
+/**
+ * Leaks found.
+ */
+struct sleep_leaks {
+  /** Floating inputs, per port */
+  uint8_t floating[SLEEP_AUDIT_PORTS];
+
+  /** Peripherals left running, bits of enum sleep_periph */
+  uint8_t periphs;
+};
+
+/**
+ * Check a snapshot.
+ *
+ * @param snap  Pins and peripherals going into sleep
+ * @param leaks Leaks found, written
+ * @return Whether anything leaks
+ */
+bool sleep_audit(struct sleep_snapshot const *snap, struct sleep_leaks *leaks);
@@ -0,0 +1,122 @@
+/**
+ * Fixed-point battery state-of-charge estimator.
+ *
+ * Coulomb counts the pack current over time, and blends the result towards the
+ * relaxed open-circuit-voltage curve whenever the pack has been at rest. The
+ * BQ25895 only measures charge current, so under load the discharge current is
+ * estimated from the IR drop below the expected OCV.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of points in an OCV curve, evenly spaced from 0% to 100% */
+#define SOC_OCV_POINTS 9
+
+/** Full charge, on the 0x00-0xFF scale */
+#define SOC_FULL 0xFF
+
+/** Entries in a voltage to state of charge lookup table */
+#define SOC_LUT_SIZE 256
+
+/** Time at rest before the voltage is trusted as OCV, in ms */
+#define SOC_REST_MS (10UL * 60 * 1000)
+
+/**
+ * Relaxed OCV curve of a cell chemistry, and the same curve expanded into a
+ * direct-index lookup table by scripts/batt_profiles.py.
+ */
+struct soc_curve {
+  /** SOC_OCV_POINTS voltages in mV, evenly spaced from 0% to 100% */
+  uint16_t ocv[SOC_OCV_POINTS];
+
+  /** State of charge for lut_base_mv + (i << lut_shift) mV and up to the next entry */
+  const uint8_t *lut;
+  uint16_t lut_base_mv;
+  uint8_t lut_shift;
+};
+
+/**
+ * Estimator state.
+ */
+struct soc_est {
+  /** Relaxed OCV curve */
+  const struct soc_curve *curve;
+
+  /** Full-charge capacity and remaining charge, in mA*s */
+  uint32_t capacity_mas;
+  uint32_t charge_mas;
+
+  /** Charge represented by one count of the 0x00-0xFF scale, in mA*s */
+  uint32_t unit_mas;
+
+  /** Charge not yet accounted for in charge_mas, in mA*ms */
+  int32_t residue;
+
+  /** Time of the last update, and time spent at rest, in ms */
+  uint32_t last_ms;
+  uint32_t rest_ms;
+
+  /** Last pack current, positive when charging, in mA */
+  int16_t current_ma;
+
+  /** State of charge, 0x00-0xFF representing 0-100% */
+  uint8_t soc;
+};
+
+/**
+ * Initialise the estimator at a known state of charge.
+ *
+ * @param est          Estimator state
+ * @param curve        Relaxed OCV curve
+ * @param capacity_mah Full-charge capacity, in mAh
+ * @param soc          Initial state of charge
+ * @param now_ms       Current time, in ms
+ */
+void soc_init(struct soc_est *est, const struct soc_curve *curve, uint16_t capacity_mah, uint8_t soc,
+              uint32_t now_ms);
+
+/**
+ * Look up the state of charge for a relaxed pack voltage, to within one
+ * lookup table step.
+ *
+ * @param curve Relaxed OCV curve
+ * @param mv    Pack voltage, in mV
+ * @return State of charge
+ */
+uint8_t soc_from_ocv(const struct soc_curve *curve, uint16_t mv);
+
+/**
+ * Integrate the pack current since the last update, and correct towards the
+ * OCV curve if the pack has been at rest long enough.
+ *
+ * @param est      Estimator state
+ * @param vbat_mv  Pack voltage, in mV
+ * @param ichg_ma  Measured charge current, 0 if not charging
+ * @param loaded   Is the console drawing from the pack?
+ * @param r_mohm   Pack resistance, used to estimate the discharge current
+ * @param now_ms   Current time, in ms
+ */
+void soc_update(struct soc_est *est, uint16_t vbat_mv, uint16_t ichg_ma, bool loaded, uint16_t r_mohm,
+                uint32_t now_ms);
+
+/**
+ * Account for a period of rest the estimator didn't see, eg. while the MCU was
+ * asleep. A rest of SOC_REST_MS or more corrects strongly towards the OCV curve,
+ * a shorter one counts towards the rest time as if it had been observed.
+ *
+ * @param est       Estimator state
+ * @param vbat_mv   Pack voltage, in mV
+ * @param rested_ms Length of the rest, in ms
+ * @param now_ms    Current time, in ms
+ */
+void soc_rested(struct soc_est *est, uint16_t vbat_mv, uint32_t rested_ms, uint32_t now_ms);
+
+/**
+ * Mark the pack as full, eg. when the charger terminates.
+ *
+ * @param est Estimator state
+ */
+void soc_set_full(struct soc_est *est);
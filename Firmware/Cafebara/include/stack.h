@@ -0,0 +1,27 @@
+/**
+ * Stack high-water mark.
+ *
+ * The free RAM between the end of .bss and the top of the stack is painted
+ * with a known pattern at reset, before main() runs. The deepest the stack
+ * has reached is then the first byte, counting down from the top, that still
+ * holds the pattern.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Bytes available to the stack, from the end of .bss to the top of RAM.
+ */
+uint16_t stack_size(void);
+
+/**
+ * Bytes of stack that have never been used since reset.
+ */
+uint16_t stack_unused(void);
+
+/**
+ * Deepest the stack has been since reset, in bytes.
+ */
+uint16_t stack_high_water(void);
@@ -0,0 +1,20 @@
+/**
+ * Minimal TMP1075N temperature sensor support.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// TMP1075N registers
+#define TMP1075_REG_TEMP 0x00
+
+/**
+ * Read the temperature, rounded to the nearest degree.
+ *
+ * @param addr   7-bit I2C address of the sensor
+ * @param temp_c Temperature, in degrees C
+ * @return true if successful
+ */
+bool tmp1075_get_temp(uint8_t addr, int8_t *temp_c);
@@ -0,0 +1,22 @@
+/**
+ * Charger telemetry capture.
+ *
+ * With the console's "trace on", every byte read from the BQ25895 is logged
+ * as a LOG_TRACE_READ record, edges on the input pins as LOG_TRACE_GPIO, and
+ * each power decision (power_policy.h) as LOG_TRACE_CHARGER or
+ * LOG_TRACE_BATTERY, right after the reads it was made on. A capture saved
+ * with scripts/tlog_decode.py --save can be run through the host build of the
+ * decisions by sim/replay, which checks that they come out the same.
+ */
+
+#pragma once
+
+/**
+ * Input pins traced.
+ */
+enum trace_pin {
+  TRACE_BUTTON,
+  TRACE_HPD,
+  TRACE_TEMP_ALERT,
+  TRACE_BQ_INT,
+};
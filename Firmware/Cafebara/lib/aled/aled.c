@@ -1,4 +1,6 @@
 #include "aled.h"
+#include "prof.h"
+#include "pstats.h"
 
 #include <util/atomic.h>
 #include <util/delay.h>
@@ -45,6 +47,9 @@ void led_clear_all()
 
 void led_refresh()
 {
+    PROF_BEGIN(PROF_LED_REFRESH);
+    pstats_count(PSTATS_EVENT_LED_REFRESHES, 1);
+
     // Disable interrupts while sending data
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
@@ -73,4 +78,6 @@ void led_refresh()
     // Wait for the latch time before sending more data, so LEDs update
     // NOTE: We aren't doing high frequency updates, so we don't need to wait
     DELAY_CYCLES(CYCLES(LED_LAT));
+
+    PROF_END(PROF_LED_REFRESH);
 }
@@ -0,0 +1,169 @@
+#include "led_anim.h"
+
+#include "aled.h"
+
+// Perceptual brightness to LED duty cycle (gamma 2.8)
+static const uint8_t gamma8[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+      5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+     10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+     25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+     37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+     51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+     69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+     90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+    115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+    144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+    177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+    215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255,
+};
+
+static const struct led_keyframe solid_frames[] = {
+    {0, 255},
+};
+
+static const struct led_keyframe blink_frames[] = {
+    {0, 255}, {100, 255}, {0, 0}, {100, 0},
+};
+
+static const struct led_keyframe breathe_frames[] = {
+    {1500, 255}, {1500, 0},
+};
+
+static const struct led_keyframe pulse_frames[] = {
+    {0, 255}, {300, 0}, {700, 0},
+};
+
+#define FRAMES(f) f, sizeof(f) / sizeof(f[0])
+
+const struct led_pattern LED_SOLID   = {FRAMES(solid_frames)};
+const struct led_pattern LED_BLINK   = {FRAMES(blink_frames)};
+const struct led_pattern LED_BREATHE = {FRAMES(breathe_frames)};
+const struct led_pattern LED_PULSE   = {FRAMES(pulse_frames)};
+
+// A pattern, and how to play it
+struct led_anim {
+    const struct led_pattern *pattern;
+    uint32_t color;
+    uint8_t brightness;
+    uint8_t repeat;
+};
+
+// Running animation, and a steady one waiting for it to finish
+static struct led_anim current = {&LED_SOLID, 0x000000, 0, LED_REPEAT_FOREVER};
+static struct led_anim pending = {0};
+
+// Playback position
+static uint8_t frame        = 0;
+static uint8_t from_level   = 0;
+static uint8_t level        = 0;
+static uint8_t repeats_left = 0;
+static bool finished        = false;
+static uint32_t frame_start = 0;
+
+// Colour last sent to the LEDs, in GRB order
+static uint32_t output = 0xFFFFFFFF;
+
+static bool led_anim_equal(struct led_anim const *a, struct led_anim const *b)
+{
+    return a->pattern == b->pattern && a->color == b->color && a->brightness == b->brightness &&
+           a->repeat == b->repeat;
+}
+
+static void led_anim_play(struct led_anim const *anim, uint32_t millis)
+{
+    current      = *anim;
+    frame        = 0;
+    from_level   = level;
+    repeats_left = anim->repeat;
+    finished     = false;
+    frame_start  = millis;
+}
+
+void led_anim_start(const struct led_pattern *pattern, uint32_t color, uint8_t brightness,
+                    uint8_t repeat, uint32_t millis)
+{
+    struct led_anim anim = {pattern, color, brightness, repeat};
+
+    if (repeat == LED_REPEAT_FOREVER && led_anim_busy()) {
+        // Let the finite pattern finish first
+        pending = anim;
+        return;
+    }
+
+    if (led_anim_equal(&anim, &current) && !finished) {
+        return;
+    }
+
+    pending.pattern = 0;
+    led_anim_play(&anim, millis);
+}
+
+bool led_anim_busy()
+{
+    return current.repeat != LED_REPEAT_FOREVER && !finished;
+}
+
+// Scale a colour channel by a perceptual brightness
+static uint8_t led_anim_channel(uint8_t c, uint8_t brightness)
+{
+    return (uint8_t)(((uint16_t)c * (gamma8[brightness] + 1)) >> 8);
+}
+
+void led_anim_update(uint32_t millis)
+{
+    const struct led_keyframe *frames = current.pattern->frames;
+
+    // Move past every keyframe that has completed. If more than a whole pass is
+    // due (zero-length patterns, or a long gap between updates), resynchronise
+    uint8_t steps = 0;
+    while (!finished && millis - frame_start >= frames[frame].ms) {
+        if (++steps > current.pattern->count) {
+            frame_start = millis;
+            break;
+        }
+        frame_start += frames[frame].ms;
+        from_level = level = frames[frame].level;
+
+        if (++frame >= current.pattern->count) {
+            frame = 0;
+            if (current.repeat != LED_REPEAT_FOREVER && --repeats_left == 0) {
+                finished = true;
+            }
+        }
+    }
+
+    if (finished && pending.pattern) {
+        // Hand over to the steady pattern requested meanwhile
+        struct led_anim next = pending;
+        pending.pattern      = 0;
+        led_anim_play(&next, millis);
+        led_anim_update(millis);
+        return;
+    }
+
+    if (!finished && frames[frame].ms > 0) {
+        // Interpolate towards the next keyframe
+        uint16_t ms   = frames[frame].ms;
+        uint16_t t    = (uint16_t)(millis - frame_start);
+        int16_t delta = (int16_t)frames[frame].level - from_level;
+        level         = (uint8_t)(from_level + ((int32_t)delta * t) / ms);
+    }
+
+    uint8_t brightness = ((uint16_t)level * current.brightness + 255) >> 8;
+    uint8_t r          = led_anim_channel((current.color >> 16) & 0xFF, brightness);
+    uint8_t g          = led_anim_channel((current.color >> 8) & 0xFF, brightness);
+    uint8_t b          = led_anim_channel(current.color & 0xFF, brightness);
+    uint32_t color     = ((uint32_t)g << 16) | ((uint32_t)r << 8) | b; // WS2812 and compatible use GRB
+
+    // Only touch the LEDs when the colour actually changes
+    if (color != output) {
+        output = color;
+        led_set_all(color);
+        led_refresh();
+    }
+}
@@ -0,0 +1,46 @@
+/**
+ * Non-blocking animations for the addressable LEDs.
+ *
+ * - Patterns are keyframe tables stored in flash
+ * - Brightness is integer-only, and gamma corrected
+ * - Driven from a periodic update, LEDs are only refreshed when their colour changes
+ * - A finite pattern (eg. an error flash) runs to completion; steady patterns
+ *   requested meanwhile are started once it has finished
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ramp linearly to a brightness level over a number of milliseconds (0 jumps)
+struct led_keyframe {
+    uint16_t ms;
+    uint8_t level;
+};
+
+// A sequence of keyframes, played in order
+struct led_pattern {
+    const struct led_keyframe *frames;
+    uint8_t count;
+};
+
+// Built-in patterns
+extern const struct led_pattern LED_SOLID;
+extern const struct led_pattern LED_BLINK;
+extern const struct led_pattern LED_BREATHE;
+extern const struct led_pattern LED_PULSE;
+
+// Repeat a pattern until another one is started
+#define LED_REPEAT_FOREVER 0
+
+// Start a pattern, unless it is already running with the same settings
+// color is 0xRRGGBB, brightness scales the pattern's levels (0-255)
+void led_anim_start(const struct led_pattern *pattern, uint32_t color, uint8_t brightness,
+                    uint8_t repeat, uint32_t millis);
+
+// Advance the running pattern, refreshing the LEDs if the output changed
+void led_anim_update(uint32_t millis);
+
+// Is a finite pattern still running?
+bool led_anim_busy();
@@ -5,16 +5,31 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef bool (*bq25895_write_t)(
   uint16_t addr, uint8_t reg, void const* buf, size_t len, void* context);
 typedef bool (*bq25895_read_t)(uint16_t addr, uint8_t reg, void* buf, size_t len, void* context);
+typedef void (*bq25895_delay_t)(uint16_t ms, void* context);
 
 typedef struct {
     bq25895_write_t write;
     bq25895_read_t read;
+    bq25895_delay_t delay; // Optional, used to back off while waiting for the ADC
     void* context;
 } bq25895_t;
 
+typedef void (*bq25895_adc_cb_t)(bool ok, bq25895_adc_t const* adc, void* context);
+
+typedef struct {
+    bq25895_adc_cb_t callback;
+    void* context;
+    uint8_t polls;
+    bool pending;
+} bq25895_adc_req_t;
+
 bool bq25895_is_present(bq25895_t const* dev);
 
 bool bq25895_set_iin_max(bq25895_t const* dev, bq25895_iin_max_t ma);
@@ -91,4 +106,18 @@ bool bq25895_check_faults(bq25895_t const* dev, bq25895_fault_t* faults);
 
 bool bq25895_trigger_adc_read(bq25895_t const* dev);
 bool bq25895_get_adc_batt(bq25895_t const* dev, bq25895_batt_volt_t* voltage);
+bool bq25895_get_adc_vbus(bq25895_t const* dev, bq25895_vbus_volt_t* voltage);
+bool bq25895_get_adc_charge_current(bq25895_t const* dev, bq25895_chg_current_t* ma);
+bool bq25895_get_adc_ts(bq25895_t const* dev, bq25895_ts_pct_t* pct);
 bool bq25895_set_adc_cont(bq25895_t const* dev, bool enabled);
+
+bool bq25895_is_adc_busy(bq25895_t const* dev, bool* busy);
+bool bq25895_read_adc(bq25895_t const* dev, bq25895_adc_t* adc);
+bool bq25895_adc_convert(bq25895_t const* dev, bq25895_adc_t* adc);
+bool bq25895_adc_start(
+  bq25895_t const* dev, bq25895_adc_req_t* req, bq25895_adc_cb_t callback, void* context);
+bool bq25895_adc_poll(bq25895_t const* dev, bq25895_adc_req_t* req);
+
+#ifdef __cplusplus
+}
+#endif
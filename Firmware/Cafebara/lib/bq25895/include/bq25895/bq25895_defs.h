@@ -6,6 +6,10 @@ typedef uint16_t bq25895_iin_max_t;
 
 typedef uint16_t bq25895_batt_volt_t;
 
+typedef uint16_t bq25895_vbus_volt_t;
+
+typedef uint16_t bq25895_ts_pct_t; // 0.1% of REGN
+
 typedef uint16_t bq25895_vin_max_t;
 
 typedef uint16_t bq25895_vsys_min_t;
@@ -93,3 +97,13 @@ enum {
     BQ_FAULT_WATCHDOG   = 0x80U,
 };
 typedef uint8_t bq25895_fault_t;
+
+typedef struct {
+    bq25895_batt_volt_t batt_mv;
+    uint16_t sys_mv;
+    bq25895_ts_pct_t ts_pct;
+    bq25895_vbus_volt_t vbus_mv;
+    uint16_t ichg_ma;
+    uint8_t therm_reg;  // In thermal regulation
+    uint8_t vbus_good;  // VBUS attached
+} bq25895_adc_t;
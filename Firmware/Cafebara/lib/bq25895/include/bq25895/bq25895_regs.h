@@ -99,7 +99,7 @@
 #define BQ_IPRECHG_INCR 64U
 
 #define BQ_VRECHG_POS 0U
-#define BQ_VRECHG_MSK (0x03U << BQ_VRECHG_POS)
+#define BQ_VRECHG_MSK (0x01U << BQ_VRECHG_POS)
 
 #define BQ_VBATLOW_POS 1U
 #define BQ_VBATLOW_MSK (0x01 << BQ_VBATLOW_POS)
@@ -142,14 +142,16 @@
 #define BQ_VSYS_STAT_POS 0U
 #define BQ_VSYS_STAT_MSK (0x01U << BQ_VSYS_STAT_POS)
 
-#define BQ_THERM_STAT_POS 7U
+#define BQ_THERM_STAT_POS 7U // REG0E
 #define BQ_THERM_STAT_MSK (0x01U << BQ_THERM_STAT_POS)
 
 #define BQ_PG_STAT_POS 2U
 #define BQ_PG_STAT_MSK (0x01U << BQ_PG_STAT_POS)
 
-#define BQ_DPM_STAT_POS 1U
-#define BQ_DPM_STAT_MSK (0x01U << BQ_DPM_STAT_POS)
+#define BQ_VDPM_STAT_POS 7U // REG13
+#define BQ_VDPM_STAT_MSK (0x01U << BQ_VDPM_STAT_POS)
+#define BQ_IDPM_STAT_POS 6U // REG13
+#define BQ_IDPM_STAT_MSK (0x01U << BQ_IDPM_STAT_POS)
 
 #define BQ_CHRG_STAT_POS 3U
 #define BQ_CHRG_STAT_MSK (0x03U << BQ_CHRG_STAT_POS)
@@ -162,6 +164,28 @@
 #define BQ_ADC_VAL_OFFSET 2304U
 #define BQ_ADC_VAL_INCR 20U
 
+#define BQ_VBUS_GD_POS 7U // REG11
+#define BQ_VBUS_GD_MSK (0x01U << BQ_VBUS_GD_POS)
+
+#define BQ_VBUS_VAL_POS 0U
+#define BQ_VBUS_VAL_MSK (0x7FU << BQ_VBUS_VAL_POS)
+#define BQ_VBUS_VAL_OFFSET 2600U
+#define BQ_VBUS_VAL_INCR 100U
+
+#define BQ_ICHGR_VAL_POS 0U
+#define BQ_ICHGR_VAL_MSK (0x7FU << BQ_ICHGR_VAL_POS)
+#define BQ_ICHGR_VAL_OFFSET 0U
+#define BQ_ICHGR_VAL_INCR 50U
+
+#define BQ_TSPCT_VAL_POS 0U
+#define BQ_TSPCT_VAL_MSK (0x7FU << BQ_TSPCT_VAL_POS)
+#define BQ_TSPCT_VAL_OFFSET 21000U // 0.001% of REGN
+#define BQ_TSPCT_VAL_INCR 465U     // 0.001% of REGN
+
+// ADC result block, REG0E (BATV) to REG12 (ICHGR)
+#define BQ_ADC_BLOCK_START BQ_REG0E
+#define BQ_ADC_BLOCK_LEN 5U
+
 #define BQ_PART_NUMBER_POS 3U
 #define BQ_PART_NUMBER_MSK (0x07U << BQ_PART_NUMBER_POS)
 #define BQ_PART_NUMBER 0b111U
@@ -0,0 +1,158 @@
+#include "bq25895_linux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+// Register ranges per I2C_RDWR transfer (two messages each), within the
+// kernel's I2C_RDWR_IOCTL_MAX_MSGS
+#define BQ_LINUX_MAX_SPANS 16U
+
+// Longest SMBus I2C block transfer
+#define BQ_LINUX_SMBUS_BLOCK_MAX I2C_SMBUS_BLOCK_MAX
+
+bool bq25895_linux_open(bq25895_linux_t* bus, const char* path) {
+    unsigned long funcs = 0;
+
+    bus->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (bus->fd < 0) {
+        return false;
+    }
+
+    if (ioctl(bus->fd, I2C_FUNCS, &funcs) < 0) {
+        bq25895_linux_close(bus);
+        return false;
+    }
+
+    bus->rdwr = (funcs & I2C_FUNC_I2C) != 0;
+    if (!bus->rdwr && !(funcs & I2C_FUNC_SMBUS_I2C_BLOCK)) {
+        bq25895_linux_close(bus);
+        errno = EOPNOTSUPP;
+        return false;
+    }
+
+    return true;
+}
+
+void bq25895_linux_close(bq25895_linux_t* bus) {
+    if (bus->fd >= 0) {
+        close(bus->fd);
+        bus->fd = -1;
+    }
+}
+
+void bq25895_linux_bind(bq25895_linux_t* bus, bq25895_t* dev) {
+    dev->write = bq25895_linux_write;
+    dev->read = bq25895_linux_read;
+    dev->delay = bq25895_linux_delay;
+    dev->context = bus;
+}
+
+static bool smbus_access(
+  bq25895_linux_t* bus, uint16_t addr, uint8_t rw, uint8_t reg, uint8_t* buf, size_t len) {
+    union i2c_smbus_data data;
+    struct i2c_smbus_ioctl_data args = {
+        .read_write = rw,
+        .command = reg,
+        .size = I2C_SMBUS_I2C_BLOCK_DATA,
+        .data = &data,
+    };
+
+    if (len == 0 || len > BQ_LINUX_SMBUS_BLOCK_MAX) {
+        return false;
+    }
+    if (ioctl(bus->fd, I2C_SLAVE, addr) < 0) {
+        return false;
+    }
+
+    data.block[0] = (uint8_t)len;
+    if (rw == I2C_SMBUS_WRITE) {
+        memcpy(&data.block[1], buf, len);
+    }
+    if (ioctl(bus->fd, I2C_SMBUS, &args) < 0) {
+        return false;
+    }
+    if (rw == I2C_SMBUS_READ) {
+        memcpy(buf, &data.block[1], len);
+    }
+    return true;
+}
+
+bool bq25895_linux_write(uint16_t addr, uint8_t reg, void const* buf, size_t len, void* context) {
+    bq25895_linux_t* bus = context;
+    uint8_t msg[1 + BQ_LINUX_SMBUS_BLOCK_MAX];
+
+    if (len > BQ_LINUX_SMBUS_BLOCK_MAX) {
+        return false;
+    }
+    if (!bus->rdwr) {
+        memcpy(msg, buf, len);
+        return smbus_access(bus, addr, I2C_SMBUS_WRITE, reg, msg, len);
+    }
+
+    msg[0] = reg;
+    memcpy(&msg[1], buf, len);
+
+    struct i2c_msg xfer = {.addr = addr, .flags = 0, .len = (uint16_t)(len + 1), .buf = msg};
+    struct i2c_rdwr_ioctl_data args = {.msgs = &xfer, .nmsgs = 1};
+    return ioctl(bus->fd, I2C_RDWR, &args) >= 0;
+}
+
+bool bq25895_linux_read(uint16_t addr, uint8_t reg, void* buf, size_t len, void* context) {
+    bq25895_linux_span_t span = {.reg = 0, .len = (uint8_t)len};
+    uint8_t regs[UINT8_MAX + 1];
+
+    if (len == 0 || reg + len > sizeof(regs)) {
+        return false;
+    }
+
+    span.reg = reg;
+    if (!bq25895_linux_read_spans(context, addr, &span, 1, regs)) {
+        return false;
+    }
+
+    memcpy(buf, &regs[reg], len);
+    return true;
+}
+
+void bq25895_linux_delay(uint16_t ms, void* context) {
+    (void)context;
+
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+bool bq25895_linux_read_spans(
+  bq25895_linux_t* bus, uint16_t addr, bq25895_linux_span_t const* spans, size_t count, uint8_t* regs) {
+    if (count == 0 || count > BQ_LINUX_MAX_SPANS) {
+        return false;
+    }
+
+    if (!bus->rdwr) {
+        for (size_t i = 0; i < count; i++) {
+            if (!smbus_access(bus, addr, I2C_SMBUS_READ, spans[i].reg, &regs[spans[i].reg], spans[i].len)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Register address write then repeated start read, for each range
+    struct i2c_msg msgs[2 * BQ_LINUX_MAX_SPANS];
+    uint8_t addrs[BQ_LINUX_MAX_SPANS];
+    for (size_t i = 0; i < count; i++) {
+        addrs[i] = spans[i].reg;
+        msgs[2 * i] = (struct i2c_msg){.addr = addr, .flags = 0, .len = 1, .buf = &addrs[i]};
+        msgs[2 * i + 1] = (struct i2c_msg){
+            .addr = addr, .flags = I2C_M_RD, .len = spans[i].len, .buf = &regs[spans[i].reg]};
+    }
+
+    struct i2c_rdwr_ioctl_data args = {.msgs = msgs, .nmsgs = (uint32_t)(2 * count)};
+    return ioctl(bus->fd, I2C_RDWR, &args) >= 0;
+}
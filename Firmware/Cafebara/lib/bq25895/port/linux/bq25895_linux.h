@@ -0,0 +1,49 @@
+#pragma once
+
+#include "bq25895.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Linux i2c-dev backend for the bq25895 driver.
+//
+// Uses I2C_RDWR when the adapter supports plain I2C, so a register read is a
+// single write-then-read transfer, and several register ranges can be read in
+// one ioctl. Adapters that only speak SMBus (eg. i2c-stub) fall back to I2C
+// block transfers.
+
+typedef struct {
+    int fd;
+    bool rdwr; // Adapter supports I2C_RDWR
+} bq25895_linux_t;
+
+// A range of consecutive registers
+typedef struct {
+    uint8_t reg;
+    uint8_t len;
+} bq25895_linux_span_t;
+
+// Open an i2c-dev node, eg. "/dev/i2c-1"
+bool bq25895_linux_open(bq25895_linux_t* bus, const char* path);
+void bq25895_linux_close(bq25895_linux_t* bus);
+
+// Point a device handle at the bus
+void bq25895_linux_bind(bq25895_linux_t* bus, bq25895_t* dev);
+
+bool bq25895_linux_write(uint16_t addr, uint8_t reg, void const* buf, size_t len, void* context);
+bool bq25895_linux_read(uint16_t addr, uint8_t reg, void* buf, size_t len, void* context);
+void bq25895_linux_delay(uint16_t ms, void* context);
+
+// Read several register ranges, in a single I2C_RDWR transfer when possible.
+// Each range is stored at its register address in regs.
+bool bq25895_linux_read_spans(
+  bq25895_linux_t* bus, uint16_t addr, bq25895_linux_span_t const* spans, size_t count, uint8_t* regs);
+
+#ifdef __cplusplus
+}
+#endif
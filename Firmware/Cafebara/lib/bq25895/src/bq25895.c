@@ -2,6 +2,11 @@
 
 #include "bq25895/bq25895_regs.h"
 
+// One-shot ADC conversion polling: backoff doubles from 1ms up to the cap,
+// and the conversion is abandoned after the poll limit
+#define BQ_ADC_BACKOFF_MAX_MS 64U
+#define BQ_ADC_MAX_POLLS 32U
+
 static inline bool read_reg(bq25895_t const* dev, uint8_t reg, uint8_t* out) {
     return dev->read(BQ_ADDR, reg, out, 1, dev->context);
 }
@@ -20,7 +25,8 @@ static inline bool modify_reg(bq25895_t const* dev, uint8_t reg, uint8_t data, u
     return write_reg(dev, reg, buf);
 }
 
-static uint8_t perform_adc(uint16_t in, uint16_t offset, uint16_t incr) {
+// Convert a value to a register code, saturating at the largest code the field holds
+static uint8_t perform_adc(uint16_t in, uint16_t offset, uint16_t incr, uint8_t max) {
     if (in < offset) {
         return 0;
     }
@@ -36,7 +42,7 @@ static uint8_t perform_adc(uint16_t in, uint16_t offset, uint16_t incr) {
         }
     }
 
-    return out;
+    return (out > max) ? max : out;
 }
 
 static uint16_t perform_dac(uint8_t in, uint16_t offset, uint16_t incr) {
@@ -61,7 +67,7 @@ bool bq25895_is_present(bq25895_t const* dev) {
 
 bool bq25895_set_iin_max(bq25895_t const* dev, bq25895_iin_max_t ma) {
 
-    uint8_t data = ((perform_adc(ma, BQ_IIN_MAX_OFFSET, BQ_IIN_MAX_INCR) << BQ_IIN_MAX_POS) & BQ_IIN_MAX_MSK);
+    uint8_t data = ((perform_adc(ma, BQ_IIN_MAX_OFFSET, BQ_IIN_MAX_INCR, BQ_IIN_MAX_MSK >> BQ_IIN_MAX_POS) << BQ_IIN_MAX_POS) & BQ_IIN_MAX_MSK);
 
     return modify_reg(dev, BQ_REG00, data, BQ_IIN_MAX_MSK);
 }
@@ -80,7 +86,7 @@ bool bq25895_get_iin_max(bq25895_t const* dev, bq25895_iin_max_t* ma) {
 
 bool bq25895_set_vin_max(bq25895_t const* dev, bq25895_vin_max_t mv) {
     uint8_t data =
-      (perform_adc(mv, BQ_VIN_MAX_OFFSET, BQ_VIN_MAX_INCR) << BQ_VIN_MAX_POS) & BQ_VIN_MAX_MSK;
+      (perform_adc(mv, BQ_VIN_MAX_OFFSET, BQ_VIN_MAX_INCR, BQ_VIN_MAX_MSK >> BQ_VIN_MAX_POS) << BQ_VIN_MAX_POS) & BQ_VIN_MAX_MSK;
 
     return modify_reg(dev, BQ_REG0D, data, BQ_VIN_MAX_MSK);
 }
@@ -100,7 +106,7 @@ bool bq25895_get_vin_max(bq25895_t const* dev, bq25895_vin_max_t* mv) {
 
 bool bq25895_set_vsys_min(bq25895_t const* dev, bq25895_vsys_min_t mv) {
     uint8_t data =
-      (perform_adc(mv, BQ_VSYS_MIN_OFFSET, BQ_VSYS_MIN_INCR) << BQ_VSYS_MIN_POS) & BQ_VSYS_MIN_MSK;
+      (perform_adc(mv, BQ_VSYS_MIN_OFFSET, BQ_VSYS_MIN_INCR, BQ_VSYS_MIN_MSK >> BQ_VSYS_MIN_POS) << BQ_VSYS_MIN_POS) & BQ_VSYS_MIN_MSK;
 
     return modify_reg(dev, BQ_REG03, data, BQ_VSYS_MIN_MSK);
 }
@@ -141,7 +147,7 @@ bool bq25895_reset_wdt(bq25895_t const* dev) {
 }
 
 bool bq25895_set_charge_current(bq25895_t const* dev, bq25895_chg_current_t ma) {
-    uint8_t data = (perform_adc(ma, BQ_ICHG_OFFSET, BQ_ICHG_INCR) << BQ_ICHG_POS) & BQ_ICHG_MSK;
+    uint8_t data = (perform_adc(ma, BQ_ICHG_OFFSET, BQ_ICHG_INCR, BQ_ICHG_MSK >> BQ_ICHG_POS) << BQ_ICHG_POS) & BQ_ICHG_MSK;
 
     return modify_reg(dev, BQ_REG04, data, BQ_ICHG_MSK);
 }
@@ -160,7 +166,7 @@ bool bq25895_get_charge_current(bq25895_t const* dev, bq25895_chg_current_t* ma)
 }
 
 bool bq25895_set_term_current(bq25895_t const* dev, bq25895_term_current_t ma) {
-    uint8_t data = (perform_adc(ma, BQ_ITERM_OFFSET, BQ_ITERM_INCR) << BQ_ITERM_POS) & BQ_ITERM_MSK;
+    uint8_t data = (perform_adc(ma, BQ_ITERM_OFFSET, BQ_ITERM_INCR, BQ_ITERM_MSK >> BQ_ITERM_POS) << BQ_ITERM_POS) & BQ_ITERM_MSK;
 
     return modify_reg(dev, BQ_REG05, data, BQ_ITERM_MSK);
 }
@@ -180,7 +186,7 @@ bool bq25895_get_term_current(bq25895_t const* dev, bq25895_term_current_t* ma)
 
 bool bq25895_set_precharge_current(bq25895_t const* dev, bq25895_prechg_current_t ma) {
     uint8_t data =
-      (perform_adc(ma, BQ_IPRECHG_OFFSET, BQ_IPRECHG_INCR) << BQ_IPRECHG_POS) & BQ_IPRECHG_MSK;
+      (perform_adc(ma, BQ_IPRECHG_OFFSET, BQ_IPRECHG_INCR, BQ_IPRECHG_MSK >> BQ_IPRECHG_POS) << BQ_IPRECHG_POS) & BQ_IPRECHG_MSK;
 
     return modify_reg(dev, BQ_REG05, data, BQ_IPRECHG_MSK);
 }
@@ -236,7 +242,7 @@ bool bq25895_get_batlow_voltage(bq25895_t const* dev, bq25895_vbatlow_t* mv) {
 
 bool bq25895_set_max_charge_voltage(bq25895_t const* dev, bq25895_vchg_max_t mv) {
     uint8_t data =
-      (perform_adc(mv, BQ_VCHG_MAX_OFFSET, BQ_VCHG_MAX_INCR) << BQ_VCHG_MAX_POS) & BQ_VCHG_MAX_MSK;
+      (perform_adc(mv, BQ_VCHG_MAX_OFFSET, BQ_VCHG_MAX_INCR, BQ_VCHG_MAX_MSK >> BQ_VCHG_MAX_POS) << BQ_VCHG_MAX_POS) & BQ_VCHG_MAX_MSK;
 
     return modify_reg(dev, BQ_REG06, data, BQ_VCHG_MAX_MSK);
 }
@@ -329,7 +335,7 @@ bool bq25895_get_max_temp(bq25895_t const* dev, bq_24292i_max_temp_t* temp) {
 
 bool bq25895_set_voltage_clamp(bq25895_t const* dev, bq25895_clamp_voltage_t mv) {
     uint8_t data =
-      (perform_adc(mv, BQ_VCLAMP_OFFSET, BQ_VCLAMP_INCR) << BQ_VCLAMP_POS) & BQ_VCLAMP_MSK;
+      (perform_adc(mv, BQ_VCLAMP_OFFSET, BQ_VCLAMP_INCR, BQ_VCLAMP_MSK >> BQ_VCLAMP_POS) << BQ_VCLAMP_POS) & BQ_VCLAMP_MSK;
 
     return modify_reg(dev, BQ_REG08, data, BQ_VCLAMP_MSK);
 }
@@ -348,7 +354,7 @@ bool bq25895_get_voltage_clamp(bq25895_t const* dev, bq25895_clamp_voltage_t* mv
 }
 
 bool bq25895_set_comp_resistor(bq25895_t const* dev, bq25895_comp_resistor_t mohms) {
-    uint8_t data = (perform_adc(mohms, BQ_BAT_COMP_OFFSET, BQ_BAT_COMP_INCR) << BQ_BAT_COMP_POS) &
+    uint8_t data = (perform_adc(mohms, BQ_BAT_COMP_OFFSET, BQ_BAT_COMP_INCR, BQ_BAT_COMP_MSK >> BQ_BAT_COMP_POS) << BQ_BAT_COMP_POS) &
                    BQ_BAT_COMP_MSK;
 
     return modify_reg(dev, BQ_REG08, data, BQ_BAT_COMP_MSK);
@@ -386,7 +392,8 @@ bool bq25895_get_interrupt_mask(bq25895_t const* dev, bq25895_interrupt_mask_t*
 }
 */
 bool bq25895_set_batfet_enabled(bq25895_t const* dev, bool enable) {
-    uint8_t data = (uint8_t)((enable << BQ_BATFET_POS) & BQ_BATFET_MSK);
+    // BATFET_DIS turns the BATFET off
+    uint8_t data = (uint8_t)((!enable << BQ_BATFET_POS) & BQ_BATFET_MSK);
 
     return modify_reg(dev, BQ_REG09, data, BQ_BATFET_MSK);
 }
@@ -399,7 +406,7 @@ bool bq25895_get_batfet_enabled(bq25895_t const* dev, bool* enable) {
         return false;
     }
 
-    *enable = ((data & BQ_BATFET_MSK) >> BQ_BATFET_POS);
+    *enable = !((data & BQ_BATFET_MSK) >> BQ_BATFET_POS);
     return true;
 }
 
@@ -421,7 +428,7 @@ bool bq25895_is_overtemp(bq25895_t const* dev, bool* result) {
     if (!result) return false;
 
     uint8_t data;
-    if (!read_reg(dev, BQ_REG0B, &data)) {
+    if (!read_reg(dev, BQ_REG0E, &data)) {
         return false;
     }
 
@@ -445,11 +452,12 @@ bool bq25895_is_in_dpm(bq25895_t const* dev, bool* result) {
     if (!result) return false;
 
     uint8_t data;
-    if (!read_reg(dev, BQ_REG0B, &data)) {
+    if (!read_reg(dev, BQ_REG13, &data)) {
         return false;
     }
 
-    *result = ((data & BQ_DPM_STAT_MSK) >> BQ_DPM_STAT_POS);
+    // Either input voltage or input current regulation
+    *result = ((data & (BQ_VDPM_STAT_MSK | BQ_IDPM_STAT_MSK)) != 0);
     return true;
 }
 
@@ -509,9 +517,154 @@ bool bq25895_get_adc_batt(bq25895_t const* dev, bq25895_batt_volt_t* voltage) {
     return true;
 }
 
+bool bq25895_get_adc_vbus(bq25895_t const* dev, bq25895_vbus_volt_t* voltage) {
+    if (!voltage) return false;
+
+    uint8_t data;
+    if (!read_reg(dev, BQ_REG11, &data)) {
+        return false;
+    }
+
+    *voltage = (bq25895_vbus_volt_t)(perform_dac(
+      ((data & BQ_VBUS_VAL_MSK) >> BQ_VBUS_VAL_POS), BQ_VBUS_VAL_OFFSET, BQ_VBUS_VAL_INCR));
+    return true;
+}
+
+bool bq25895_get_adc_charge_current(bq25895_t const* dev, bq25895_chg_current_t* ma) {
+    if (!ma) return false;
+
+    uint8_t data;
+    if (!read_reg(dev, BQ_REG12, &data)) {
+        return false;
+    }
+
+    *ma = (bq25895_chg_current_t)(perform_dac(
+      ((data & BQ_ICHGR_VAL_MSK) >> BQ_ICHGR_VAL_POS), BQ_ICHGR_VAL_OFFSET, BQ_ICHGR_VAL_INCR));
+    return true;
+}
+
+bool bq25895_get_adc_ts(bq25895_t const* dev, bq25895_ts_pct_t* pct) {
+    if (!pct) return false;
+
+    uint8_t data;
+    if (!read_reg(dev, BQ_REG10, &data)) {
+        return false;
+    }
+
+    // TS step isn't a whole number of 0.1%, so scale up before converting
+    uint32_t val = BQ_TSPCT_VAL_OFFSET +
+      (uint32_t)((data & BQ_TSPCT_VAL_MSK) >> BQ_TSPCT_VAL_POS) * BQ_TSPCT_VAL_INCR;
+    *pct = (bq25895_ts_pct_t)(val / 100U);
+    return true;
+}
+
 
 bool bq25895_set_adc_cont(bq25895_t const* dev, bool enable) {
     uint8_t data = (uint8_t)((enable << BQ_ADC_RATE_POS) & BQ_ADC_RATE_MSK);
 
     return modify_reg(dev, BQ_REG02, data, BQ_ADC_RATE_MSK);
 }
+
+bool bq25895_is_adc_busy(bq25895_t const* dev, bool* busy) {
+    if (!busy) return false;
+
+    uint8_t data;
+    if (!read_reg(dev, BQ_REG02, &data)) {
+        return false;
+    }
+
+    // CONV_START clears itself once a one-shot conversion has completed
+    *busy = ((data & BQ_ADC_START_MSK) >> BQ_ADC_START_POS);
+    return true;
+}
+
+bool bq25895_read_adc(bq25895_t const* dev, bq25895_adc_t* adc) {
+    if (!adc) return false;
+
+    // Read every result register in a single transfer
+    uint8_t data[BQ_ADC_BLOCK_LEN];
+    if (!dev->read(BQ_ADDR, BQ_ADC_BLOCK_START, data, sizeof(data), dev->context)) {
+        return false;
+    }
+
+    uint8_t batv  = data[BQ_REG0E - BQ_ADC_BLOCK_START];
+    uint8_t sysv  = data[BQ_REG0F - BQ_ADC_BLOCK_START];
+    uint8_t ts    = data[BQ_REG10 - BQ_ADC_BLOCK_START];
+    uint8_t vbus  = data[BQ_REG11 - BQ_ADC_BLOCK_START];
+    uint8_t ichgr = data[BQ_REG12 - BQ_ADC_BLOCK_START];
+
+    adc->batt_mv = (bq25895_batt_volt_t)(perform_dac(
+      ((batv & BQ_ADC_VAL_MSK) >> BQ_ADC_VAL_POS), BQ_ADC_VAL_OFFSET, BQ_ADC_VAL_INCR));
+    adc->sys_mv = perform_dac(
+      ((sysv & BQ_ADC_VAL_MSK) >> BQ_ADC_VAL_POS), BQ_ADC_VAL_OFFSET, BQ_ADC_VAL_INCR);
+    adc->ts_pct = (bq25895_ts_pct_t)((BQ_TSPCT_VAL_OFFSET +
+      (uint32_t)((ts & BQ_TSPCT_VAL_MSK) >> BQ_TSPCT_VAL_POS) * BQ_TSPCT_VAL_INCR) / 100U);
+    adc->vbus_mv = (bq25895_vbus_volt_t)(perform_dac(
+      ((vbus & BQ_VBUS_VAL_MSK) >> BQ_VBUS_VAL_POS), BQ_VBUS_VAL_OFFSET, BQ_VBUS_VAL_INCR));
+    adc->ichg_ma = perform_dac(
+      ((ichgr & BQ_ICHGR_VAL_MSK) >> BQ_ICHGR_VAL_POS), BQ_ICHGR_VAL_OFFSET, BQ_ICHGR_VAL_INCR);
+    adc->therm_reg = ((batv & BQ_THERM_STAT_MSK) >> BQ_THERM_STAT_POS);
+    adc->vbus_good = ((vbus & BQ_VBUS_GD_MSK) >> BQ_VBUS_GD_POS);
+    return true;
+}
+
+bool bq25895_adc_convert(bq25895_t const* dev, bq25895_adc_t* adc) {
+    if (!bq25895_trigger_adc_read(dev)) {
+        return false;
+    }
+
+    uint16_t backoff = 1;
+    for (uint8_t polls = 0; polls < BQ_ADC_MAX_POLLS; polls++) {
+        if (dev->delay) {
+            dev->delay(backoff, dev->context);
+            if (backoff < BQ_ADC_BACKOFF_MAX_MS) {
+                backoff <<= 1;
+            }
+        }
+
+        bool busy;
+        if (!bq25895_is_adc_busy(dev, &busy)) {
+            return false;
+        }
+        if (!busy) {
+            return bq25895_read_adc(dev, adc);
+        }
+    }
+
+    return false;
+}
+
+bool bq25895_adc_start(
+  bq25895_t const* dev, bq25895_adc_req_t* req, bq25895_adc_cb_t callback, void* context) {
+    if (!req || req->pending) return false;
+
+    if (!bq25895_trigger_adc_read(dev)) {
+        return false;
+    }
+
+    req->callback = callback;
+    req->context = context;
+    req->polls = 0;
+    req->pending = true;
+    return true;
+}
+
+bool bq25895_adc_poll(bq25895_t const* dev, bq25895_adc_req_t* req) {
+    if (!req || !req->pending) return false;
+
+    bool busy = true;
+    bq25895_adc_t adc;
+    bool ok = bq25895_is_adc_busy(dev, &busy);
+
+    if (ok && busy && ++req->polls < BQ_ADC_MAX_POLLS) {
+        return true; // Still converting, try again on the next poll
+    }
+
+    // Finished, timed out, or failed to read
+    ok = ok && !busy && bq25895_read_adc(dev, &adc);
+    req->pending = false;
+    if (req->callback) {
+        req->callback(ok, ok ? &adc : NULL, req->context);
+    }
+    return false;
+}
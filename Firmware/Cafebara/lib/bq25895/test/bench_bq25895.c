@@ -0,0 +1,105 @@
+// Micro-benchmark for the bq25895 driver: I2C transfers, bytes on the wire and
+// host CPU time per API call, measured against the register model.
+//
+// Usage: bench_bq25895 [iterations]
+
+#include "bq25895.h"
+#include "bq25895_model.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static bq25895_model_t model;
+static bq25895_t dev;
+
+typedef void (*bench_fn)(void);
+
+static void bench_is_present(void) { bq25895_is_present(&dev); }
+static void bench_set_charge_current(void) { bq25895_set_charge_current(&dev, 2048); }
+static void bench_get_charge_current(void) {
+    bq25895_chg_current_t ma;
+    bq25895_get_charge_current(&dev, &ma);
+}
+static void bench_set_max_charge_voltage(void) { bq25895_set_max_charge_voltage(&dev, 4208); }
+static void bench_reset_wdt(void) { bq25895_reset_wdt(&dev); }
+static void bench_check_faults(void) {
+    bq25895_fault_t faults;
+    bq25895_check_faults(&dev, &faults);
+}
+static void bench_charge_state(void) {
+    bq25895_charge_state_t state;
+    bq25895_get_charge_state(&dev, &state);
+}
+static void bench_adc_getters(void) {
+    bq25895_batt_volt_t batt;
+    bq25895_vbus_volt_t vbus;
+    bq25895_chg_current_t ichg;
+    bq25895_ts_pct_t ts;
+    bq25895_get_adc_batt(&dev, &batt);
+    bq25895_get_adc_vbus(&dev, &vbus);
+    bq25895_get_adc_charge_current(&dev, &ichg);
+    bq25895_get_adc_ts(&dev, &ts);
+}
+static void bench_read_adc(void) {
+    bq25895_adc_t adc;
+    bq25895_read_adc(&dev, &adc);
+}
+static void bench_adc_convert(void) {
+    bq25895_adc_t adc;
+    bq25895_adc_convert(&dev, &adc);
+}
+
+static const struct {
+    const char* name;
+    bench_fn fn;
+} benches[] = {
+    {"is_present", bench_is_present},
+    {"set_charge_current", bench_set_charge_current},
+    {"get_charge_current", bench_get_charge_current},
+    {"set_max_charge_voltage", bench_set_max_charge_voltage},
+    {"reset_wdt", bench_reset_wdt},
+    {"check_faults", bench_check_faults},
+    {"get_charge_state", bench_charge_state},
+    {"get_adc_* (4 values)", bench_adc_getters},
+    {"read_adc (5 values)", bench_read_adc},
+    {"adc_convert", bench_adc_convert},
+};
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 100000;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-24s %6s %6s %6s %9s %10s\n", "call", "reads", "writes", "bytes", "delay_ms", "ns/call");
+
+    for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        bq25895_model_init(&model);
+        bq25895_model_bind(&model, &dev);
+        model.conv_reads = 2; // Conversion completes on the third poll
+
+        // One call for the bus cost, then many for the CPU time
+        benches[i].fn();
+        uint32_t reads = model.reads, writes = model.writes, bytes = model.bytes;
+        uint32_t delay_ms = model.delay_ms;
+
+        double start = now_ns();
+        for (long n = 0; n < iterations; n++) {
+            benches[i].fn();
+        }
+        double ns = (now_ns() - start) / iterations;
+
+        printf("%-24s %6u %6u %6u %9u %10.1f\n", benches[i].name, (unsigned)reads,
+               (unsigned)writes, (unsigned)bytes, (unsigned)delay_ms, ns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "bq25895_model.h"
+
+#include "bq25895/bq25895_regs.h"
+
+#include <string.h>
+
+// Power-on defaults, from the datasheet
+static const uint8_t defaults[BQ25895_MODEL_REGS] = {
+    0x48, 0x06, 0x1D, 0x3A, 0x20, 0x13, 0x5E, 0x9D, 0x03, 0x44, 0x93,
+    0x00, 0x00, 0x12, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x39,
+};
+
+// Host-writable bits of each register, the rest are status or read-only
+static const uint8_t writable[BQ25895_MODEL_REGS] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x00, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+};
+
+#define BQ_REG_RST_MSK 0x80U
+
+void bq25895_model_init(bq25895_model_t* model) {
+    memset(model, 0, sizeof(*model));
+    memcpy(model->regs, defaults, sizeof(defaults));
+}
+
+void bq25895_model_bind(bq25895_model_t* model, bq25895_t* dev) {
+    dev->write = bq25895_model_write;
+    dev->read = bq25895_model_read;
+    dev->delay = bq25895_model_delay;
+    dev->context = model;
+}
+
+void bq25895_model_clear_stats(bq25895_model_t* model) {
+    model->reads = 0;
+    model->writes = 0;
+    model->bytes = 0;
+    model->delay_ms = 0;
+}
+
+static void write_one(bq25895_model_t* model, uint8_t reg, uint8_t data) {
+    model->regs[reg] = (model->regs[reg] & ~writable[reg]) | (data & writable[reg]);
+
+    switch (reg) {
+    case BQ_REG02:
+        // One-shot conversion, unless converting continuously
+        if ((data & BQ_ADC_START_MSK) && !(data & BQ_ADC_RATE_MSK)) {
+            model->conv_left = model->conv_reads;
+            if (model->conv_left == 0) {
+                model->regs[reg] &= ~BQ_ADC_START_MSK;
+            }
+        }
+        break;
+    case BQ_REG03:
+        // Watchdog reset clears itself
+        model->regs[reg] &= ~BQ_WDT_MSK;
+        break;
+    case BQ_REG14:
+        // Register reset, restoring the defaults
+        if (data & BQ_REG_RST_MSK) {
+            memcpy(model->regs, defaults, sizeof(defaults));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static uint8_t read_one(bq25895_model_t* model, uint8_t reg) {
+    uint8_t data = model->regs[reg];
+
+    switch (reg) {
+    case BQ_REG02:
+        if ((data & BQ_ADC_START_MSK) && model->conv_left > 0 && --model->conv_left == 0) {
+            model->regs[reg] &= ~BQ_ADC_START_MSK;
+        }
+        break;
+    case BQ_REG0C:
+        // Latched faults clear on read, leaving only those still present
+        model->regs[reg] = model->faults;
+        break;
+    default:
+        break;
+    }
+
+    return data;
+}
+
+bool bq25895_model_write(uint16_t addr, uint8_t reg, void const* buf, size_t len, void* context) {
+    bq25895_model_t* model = context;
+    uint8_t const* data = buf;
+
+    model->writes++;
+    model->bytes += 2 + len; // Address, register, data
+
+    if (model->nack || addr != BQ_ADDR || reg + len > BQ25895_MODEL_REGS) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        write_one(model, (uint8_t)(reg + i), data[i]);
+    }
+    return true;
+}
+
+bool bq25895_model_read(uint16_t addr, uint8_t reg, void* buf, size_t len, void* context) {
+    bq25895_model_t* model = context;
+    uint8_t* data = buf;
+
+    model->reads++;
+    model->bytes += 3 + len; // Address, register, repeated start address, data
+
+    if (model->nack || addr != BQ_ADDR || reg + len > BQ25895_MODEL_REGS) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        data[i] = read_one(model, (uint8_t)(reg + i));
+    }
+    return true;
+}
+
+void bq25895_model_delay(uint16_t ms, void* context) {
+    bq25895_model_t* model = context;
+    model->delay_ms += ms;
+}
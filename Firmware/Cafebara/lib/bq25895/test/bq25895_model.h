@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bq25895.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register-level model of a BQ25895 on the host, for testing the driver
+// without hardware. Implements the bq25895_t read/write callbacks.
+
+#define BQ25895_MODEL_REGS 0x15U
+
+typedef struct {
+    uint8_t regs[BQ25895_MODEL_REGS];
+
+    // Faults currently present, latched into REG0C again after it is read
+    uint8_t faults;
+
+    // REG02 reads that still see a one-shot conversion running, and reads remaining
+    uint8_t conv_reads;
+    uint8_t conv_left;
+
+    // Fail every transfer, as if the BQ stopped acknowledging
+    bool nack;
+
+    // Bus statistics: transfers, bytes on the wire (including address and
+    // register bytes), and time spent in the delay callback
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bytes;
+    uint32_t delay_ms;
+} bq25895_model_t;
+
+// Reset the model to the power-on register defaults, and clear the statistics
+void bq25895_model_init(bq25895_model_t* model);
+
+// Point a device handle at the model
+void bq25895_model_bind(bq25895_model_t* model, bq25895_t* dev);
+
+// Clear the bus statistics
+void bq25895_model_clear_stats(bq25895_model_t* model);
+
+bool bq25895_model_write(uint16_t addr, uint8_t reg, void const* buf, size_t len, void* context);
+bool bq25895_model_read(uint16_t addr, uint8_t reg, void* buf, size_t len, void* context);
+void bq25895_model_delay(uint16_t ms, void* context);
+
+#ifdef __cplusplus
+}
+#endif
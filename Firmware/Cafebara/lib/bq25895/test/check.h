@@ -0,0 +1,39 @@
+// Checks shared by the host tests. A failed check prints where it failed and
+// counts, and the test carries on; check_done() reports and gives the status.
+
+#ifndef BQ25895_TEST_CHECK_H
+#define BQ25895_TEST_CHECK_H
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                             \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                     \
+    do {                                                                                   \
+        long _a = (long)(a), _b = (long)(b);                                               \
+        if (_a != _b) {                                                                    \
+            fprintf(stderr, "%s:%d: %s == %s failed (%ld != %ld)\n", __FILE__, __LINE__, #a, \
+                    #b, _a, _b);                                                           \
+            failures++;                                                                    \
+        }                                                                                  \
+    } while (0)
+
+// Exit status for main: prints the failure count, or that everything passed
+static inline int check_done(void) {
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,484 @@
+// Unit tests for the bq25895 driver, run against the register model
+
+#include "bq25895.h"
+#include "bq25895/bq25895_regs.h"
+#include "bq25895_model.h"
+#include "check.h"
+
+#include <stdio.h>
+
+static bq25895_model_t model;
+static bq25895_t dev;
+
+static void setup(void) {
+    bq25895_model_init(&model);
+    bq25895_model_bind(&model, &dev);
+}
+
+typedef bool (*set_u16_t)(bq25895_t const* dev, uint16_t val);
+typedef bool (*get_u16_t)(bq25895_t const* dev, uint16_t* val);
+
+// Set every value a field can hold, checking it reads back, lands in the right
+// bits, and leaves the rest of the register alone. Out of range values saturate.
+static void check_field(const char* name, set_u16_t set, get_u16_t get, uint8_t reg, uint8_t msk,
+                        uint8_t pos, uint16_t offset, uint16_t incr) {
+    uint8_t max = msk >> pos;
+
+    setup();
+    uint8_t others = model.regs[reg] & ~msk;
+
+    for (uint16_t code = 0; code <= max; code++) {
+        uint16_t val = offset + code * incr;
+        uint16_t out = 0;
+
+        if (!set(&dev, val) || !get(&dev, &out) || out != val) {
+            fprintf(stderr, "%s: %u read back as %u\n", name, val, out);
+            failures++;
+        }
+        CHECK_EQ((model.regs[reg] & msk) >> pos, code);
+        CHECK_EQ(model.regs[reg] & ~msk, others);
+
+        // Values between steps round down
+        if (incr > 1 && code < max) {
+            CHECK(set(&dev, val + incr - 1) && get(&dev, &out));
+            CHECK_EQ(out, val);
+        }
+    }
+
+    uint16_t out;
+    CHECK(set(&dev, offset + (max + 1) * incr));
+    CHECK(get(&dev, &out));
+    CHECK_EQ(out, offset + max * incr);
+    CHECK(set(&dev, 0xFFFF));
+    CHECK_EQ((model.regs[reg] & msk) >> pos, max);
+    if (offset > 0) {
+        CHECK(set(&dev, offset - 1));
+        CHECK_EQ((model.regs[reg] & msk) >> pos, 0);
+    }
+
+    CHECK(!get(&dev, NULL));
+}
+
+// uint8_t fields, adapted to the uint16_t helpers
+static bool set_vclamp(bq25895_t const* dev, uint16_t mv) {
+    return bq25895_set_voltage_clamp(dev, (bq25895_clamp_voltage_t)(mv > 0xFF ? 0xFF : mv));
+}
+static bool get_vclamp(bq25895_t const* dev, uint16_t* mv) {
+    bq25895_clamp_voltage_t val;
+    if (!mv) return bq25895_get_voltage_clamp(dev, NULL);
+    bool ok = bq25895_get_voltage_clamp(dev, &val);
+    *mv = val;
+    return ok;
+}
+static bool set_comp(bq25895_t const* dev, uint16_t mohms) {
+    return bq25895_set_comp_resistor(dev, (bq25895_comp_resistor_t)(mohms > 0xFF ? 0xFF : mohms));
+}
+static bool get_comp(bq25895_t const* dev, uint16_t* mohms) {
+    bq25895_comp_resistor_t val;
+    if (!mohms) return bq25895_get_comp_resistor(dev, NULL);
+    bool ok = bq25895_get_comp_resistor(dev, &val);
+    *mohms = val;
+    return ok;
+}
+
+static void test_numeric_fields(void) {
+    check_field("iin_max", bq25895_set_iin_max, bq25895_get_iin_max, BQ_REG00, BQ_IIN_MAX_MSK,
+                BQ_IIN_MAX_POS, BQ_IIN_MAX_OFFSET, BQ_IIN_MAX_INCR);
+    check_field("vin_max", bq25895_set_vin_max, bq25895_get_vin_max, BQ_REG0D, BQ_VIN_MAX_MSK,
+                BQ_VIN_MAX_POS, BQ_VIN_MAX_OFFSET, BQ_VIN_MAX_INCR);
+    check_field("vsys_min", bq25895_set_vsys_min, bq25895_get_vsys_min, BQ_REG03, BQ_VSYS_MIN_MSK,
+                BQ_VSYS_MIN_POS, BQ_VSYS_MIN_OFFSET, BQ_VSYS_MIN_INCR);
+    check_field("charge_current", bq25895_set_charge_current, bq25895_get_charge_current, BQ_REG04,
+                BQ_ICHG_MSK, BQ_ICHG_POS, BQ_ICHG_OFFSET, BQ_ICHG_INCR);
+    check_field("term_current", bq25895_set_term_current, bq25895_get_term_current, BQ_REG05,
+                BQ_ITERM_MSK, BQ_ITERM_POS, BQ_ITERM_OFFSET, BQ_ITERM_INCR);
+    check_field("precharge_current", bq25895_set_precharge_current, bq25895_get_precharge_current,
+                BQ_REG05, BQ_IPRECHG_MSK, BQ_IPRECHG_POS, BQ_IPRECHG_OFFSET, BQ_IPRECHG_INCR);
+    check_field("max_charge_voltage", bq25895_set_max_charge_voltage,
+                bq25895_get_max_charge_voltage, BQ_REG06, BQ_VCHG_MAX_MSK, BQ_VCHG_MAX_POS,
+                BQ_VCHG_MAX_OFFSET, BQ_VCHG_MAX_INCR);
+    check_field("voltage_clamp", set_vclamp, get_vclamp, BQ_REG08, BQ_VCLAMP_MSK, BQ_VCLAMP_POS,
+                BQ_VCLAMP_OFFSET, BQ_VCLAMP_INCR);
+    check_field("comp_resistor", set_comp, get_comp, BQ_REG08, BQ_BAT_COMP_MSK, BQ_BAT_COMP_POS,
+                BQ_BAT_COMP_OFFSET, BQ_BAT_COMP_INCR);
+}
+
+static void test_charge_config(void) {
+    static const bq25895_chg_config_t confs[] = {
+        BQ_CHG_CONFIG_ENABLE, BQ_CHG_CONFIG_OTG, BQ_CHG_CONFIG_DISABLE};
+    setup();
+    for (unsigned i = 0; i < sizeof(confs) / sizeof(confs[0]); i++) {
+        bq25895_chg_config_t out;
+        CHECK(bq25895_set_charge_config(&dev, confs[i]));
+        CHECK(bq25895_get_charge_config(&dev, &out));
+        CHECK_EQ(out, confs[i]);
+    }
+    CHECK_EQ(model.regs[BQ_REG03] & BQ_CHG_CONFIG_MSK, 0);
+    CHECK(!bq25895_get_charge_config(&dev, NULL));
+}
+
+static void test_reset_wdt(void) {
+    setup();
+    uint8_t before = model.regs[BQ_REG03];
+    CHECK(bq25895_reset_wdt(&dev));
+    CHECK_EQ(model.writes, 1);
+    CHECK_EQ(model.regs[BQ_REG03], before); // WD_RST clears itself, nothing else changes
+}
+
+static void test_vrechg_and_batlow(void) {
+    setup();
+    bq25895_vrechg_offset_t offset;
+    bq25895_vbatlow_t low;
+
+    CHECK(bq25895_set_batlow_voltage(&dev, BQ_VBATLOW_3000MV));
+    CHECK(bq25895_set_recharge_offset(&dev, BQ_VRECHG_200MV));
+    CHECK(bq25895_get_recharge_offset(&dev, &offset));
+    CHECK(bq25895_get_batlow_voltage(&dev, &low));
+    CHECK_EQ(offset, BQ_VRECHG_200MV);
+    CHECK_EQ(low, BQ_VBATLOW_3000MV);
+
+    CHECK(bq25895_set_recharge_offset(&dev, BQ_VRECHG_100MV));
+    CHECK(bq25895_set_batlow_voltage(&dev, BQ_VBATLOW_2800MV));
+    CHECK(bq25895_get_recharge_offset(&dev, &offset));
+    CHECK(bq25895_get_batlow_voltage(&dev, &low));
+    CHECK_EQ(offset, BQ_VRECHG_100MV);
+    CHECK_EQ(low, BQ_VBATLOW_2800MV);
+
+    CHECK(bq25895_set_recharge_offset(&dev, BQ_VRECHG_200MV));
+    CHECK_EQ(model.regs[BQ_REG06] & BQ_VCHG_MAX_MSK, 0x5E & BQ_VCHG_MAX_MSK); // Charge voltage untouched
+
+    CHECK(!bq25895_get_recharge_offset(&dev, NULL));
+    CHECK(!bq25895_get_batlow_voltage(&dev, NULL));
+}
+
+static void test_charge_timer(void) {
+    static const bq25895_chg_timer_t timers[] = {
+        BQ_CHG_TIMER_5H, BQ_CHG_TIMER_8H, BQ_CHG_TIMER_12H, BQ_CHG_TIMER_20H};
+    setup();
+    model.regs[BQ_REG07] &= ~BQ_CHG_TIMER_EN_MSK;
+    for (unsigned i = 0; i < sizeof(timers) / sizeof(timers[0]); i++) {
+        bq25895_chg_timer_t out;
+        CHECK(bq25895_set_charge_timer(&dev, timers[i]));
+        CHECK(bq25895_get_charge_timer(&dev, &out));
+        CHECK_EQ(out, timers[i]);
+        CHECK(model.regs[BQ_REG07] & BQ_CHG_TIMER_EN_MSK); // Setting a timer enables it
+    }
+    CHECK(!bq25895_get_charge_timer(&dev, NULL));
+}
+
+static void test_wdt_config(void) {
+    static const bq25895_watchdog_conf_t confs[] = {
+        BQ_WATCHDOG_DISABLE, BQ_WATCHDOG_40S, BQ_WATCHDOG_80S, BQ_WATCHDOG_160S};
+    setup();
+    uint8_t others = model.regs[BQ_REG07] & ~BQ_WDT_CONF_MSK;
+    for (unsigned i = 0; i < sizeof(confs) / sizeof(confs[0]); i++) {
+        bq25895_watchdog_conf_t out;
+        CHECK(bq25895_set_wdt_config(&dev, confs[i]));
+        CHECK(bq25895_get_wdt_config(&dev, &out));
+        CHECK_EQ(out, confs[i]);
+        CHECK_EQ(model.regs[BQ_REG07] & ~BQ_WDT_CONF_MSK, others);
+    }
+    CHECK(!bq25895_get_wdt_config(&dev, NULL));
+}
+
+static void test_charge_termination(void) {
+    setup();
+    bool out;
+    CHECK(bq25895_set_charge_termination(&dev, false));
+    CHECK(bq25895_get_charge_termination(&dev, &out));
+    CHECK(!out);
+    CHECK_EQ(model.regs[BQ_REG07] & BQ_TERM_EN_MSK, 0);
+    CHECK(bq25895_set_charge_termination(&dev, true));
+    CHECK(bq25895_get_charge_termination(&dev, &out));
+    CHECK(out);
+    CHECK(!bq25895_get_charge_termination(&dev, NULL));
+}
+
+static void test_max_temp(void) {
+    static const bq_24292i_max_temp_t temps[] = {
+        BQ_MAX_TEMP_60C, BQ_MAX_TEMP_80C, BQ_MAX_TEMP_100C, BQ_MAX_TEMP_120C};
+    setup();
+    uint8_t others = model.regs[BQ_REG08] & ~BQ_THERMAL_REG_MSK;
+    for (unsigned i = 0; i < sizeof(temps) / sizeof(temps[0]); i++) {
+        bq_24292i_max_temp_t out;
+        CHECK(bq25895_set_max_temp(&dev, temps[i]));
+        CHECK(bq25895_get_max_temp(&dev, &out));
+        CHECK_EQ(out, temps[i]);
+        CHECK_EQ(model.regs[BQ_REG08] & ~BQ_THERMAL_REG_MSK, others);
+    }
+    CHECK(!bq25895_get_max_temp(&dev, NULL));
+}
+
+static void test_batfet(void) {
+    setup();
+    bool out;
+    CHECK(bq25895_get_batfet_enabled(&dev, &out));
+    CHECK(out); // On by default
+
+    CHECK(bq25895_set_batfet_enabled(&dev, false));
+    CHECK(model.regs[BQ_REG09] & BQ_BATFET_MSK); // BATFET_DIS set
+    CHECK(bq25895_get_batfet_enabled(&dev, &out));
+    CHECK(!out);
+
+    CHECK(bq25895_set_batfet_enabled(&dev, true));
+    CHECK_EQ(model.regs[BQ_REG09] & BQ_BATFET_MSK, 0);
+    CHECK(bq25895_get_batfet_enabled(&dev, &out));
+    CHECK(out);
+    CHECK(!bq25895_get_batfet_enabled(&dev, NULL));
+}
+
+static void test_status(void) {
+    bool flag;
+    bq25895_charge_state_t state;
+    bq25895_source_type_t source;
+
+    setup();
+    model.regs[BQ_REG0B] = (BQ_SOURCE_USB_DCP << BQ_VBUS_STAT_POS) |
+                           (BQ_STATE_FAST_CHARGE << BQ_CHRG_STAT_POS) | BQ_PG_STAT_MSK;
+    CHECK(bq25895_is_charger_connected(&dev, &flag));
+    CHECK(flag);
+    CHECK(bq25895_get_charge_state(&dev, &state));
+    CHECK_EQ(state, BQ_STATE_FAST_CHARGE);
+    CHECK(bq25895_get_source_type(&dev, &source));
+    CHECK_EQ(source, BQ_SOURCE_USB_DCP);
+
+    model.regs[BQ_REG0B] = (BQ_STATE_TERMINATED << BQ_CHRG_STAT_POS);
+    CHECK(bq25895_is_charger_connected(&dev, &flag));
+    CHECK(!flag);
+    CHECK(bq25895_get_charge_state(&dev, &state));
+    CHECK_EQ(state, BQ_STATE_TERMINATED);
+    CHECK(bq25895_get_source_type(&dev, &source));
+    CHECK_EQ(source, BQ_SOURCE_NONE);
+
+    CHECK(bq25895_is_overtemp(&dev, &flag));
+    CHECK(!flag);
+    model.regs[BQ_REG0E] = BQ_THERM_STAT_MSK | 0x40;
+    CHECK(bq25895_is_overtemp(&dev, &flag));
+    CHECK(flag);
+
+    CHECK(bq25895_is_in_dpm(&dev, &flag));
+    CHECK(!flag);
+    model.regs[BQ_REG13] = BQ_VDPM_STAT_MSK;
+    CHECK(bq25895_is_in_dpm(&dev, &flag));
+    CHECK(flag);
+    model.regs[BQ_REG13] = BQ_IDPM_STAT_MSK;
+    CHECK(bq25895_is_in_dpm(&dev, &flag));
+    CHECK(flag);
+
+    CHECK(!bq25895_is_charger_connected(&dev, NULL));
+    CHECK(!bq25895_get_charge_state(&dev, NULL));
+    CHECK(!bq25895_get_source_type(&dev, NULL));
+    CHECK(!bq25895_is_overtemp(&dev, NULL));
+    CHECK(!bq25895_is_in_dpm(&dev, NULL));
+}
+
+static void test_faults(void) {
+    bq25895_fault_t faults;
+
+    setup();
+    model.regs[BQ_REG0C] = BQ_FAULT_WATCHDOG | BQ_FAULT_BAT;
+    model.faults = BQ_FAULT_BAT;
+    CHECK(bq25895_check_faults(&dev, &faults));
+    CHECK_EQ(faults, BQ_FAULT_WATCHDOG | BQ_FAULT_BAT);
+    CHECK(bq25895_check_faults(&dev, &faults)); // Latched fault cleared by the read
+    CHECK_EQ(faults, BQ_FAULT_BAT);
+    CHECK(!bq25895_check_faults(&dev, NULL));
+}
+
+static void test_is_present(void) {
+    setup();
+    CHECK(bq25895_is_present(&dev));
+    model.regs[BQ_REG14] = 0x01; // Some other part
+    CHECK(!bq25895_is_present(&dev));
+    model.nack = true;
+    CHECK(!bq25895_is_present(&dev));
+}
+
+static void set_adc_regs(void) {
+    model.regs[BQ_REG0E] = 0x5D;                   // 2304 + 93 * 20 = 4164 mV
+    model.regs[BQ_REG0F] = 0x5A;                   // 2304 + 90 * 20 = 4104 mV
+    model.regs[BQ_REG10] = 0x40;                   // 21% + 64 * 0.465% = 50.76%
+    model.regs[BQ_REG11] = BQ_VBUS_GD_MSK | 0x18;  // 2600 + 24 * 100 = 5000 mV
+    model.regs[BQ_REG12] = 0x28;                   // 40 * 50 = 2000 mA
+}
+
+static void test_adc_getters(void) {
+    bq25895_batt_volt_t batt;
+    bq25895_vbus_volt_t vbus;
+    bq25895_chg_current_t ichg;
+    bq25895_ts_pct_t ts;
+
+    setup();
+    set_adc_regs();
+    CHECK(bq25895_get_adc_batt(&dev, &batt));
+    CHECK_EQ(batt, 4164);
+    CHECK(bq25895_get_adc_vbus(&dev, &vbus));
+    CHECK_EQ(vbus, 5000);
+    CHECK(bq25895_get_adc_charge_current(&dev, &ichg));
+    CHECK_EQ(ichg, 2000);
+    CHECK(bq25895_get_adc_ts(&dev, &ts));
+    CHECK_EQ(ts, 507);
+
+    // Status bits sharing the registers don't leak into the values
+    model.regs[BQ_REG0E] |= BQ_THERM_STAT_MSK;
+    CHECK(bq25895_get_adc_batt(&dev, &batt));
+    CHECK_EQ(batt, 4164);
+
+    CHECK(!bq25895_get_adc_batt(&dev, NULL));
+    CHECK(!bq25895_get_adc_vbus(&dev, NULL));
+    CHECK(!bq25895_get_adc_charge_current(&dev, NULL));
+    CHECK(!bq25895_get_adc_ts(&dev, NULL));
+}
+
+static void test_read_adc(void) {
+    bq25895_adc_t adc;
+
+    setup();
+    set_adc_regs();
+    model.regs[BQ_REG0E] |= BQ_THERM_STAT_MSK;
+    CHECK(bq25895_read_adc(&dev, &adc));
+    CHECK_EQ(model.reads, 1); // One burst for the whole block
+    CHECK_EQ(adc.batt_mv, 4164);
+    CHECK_EQ(adc.sys_mv, 4104);
+    CHECK_EQ(adc.ts_pct, 507);
+    CHECK_EQ(adc.vbus_mv, 5000);
+    CHECK_EQ(adc.ichg_ma, 2000);
+    CHECK(adc.therm_reg);
+    CHECK(adc.vbus_good);
+    CHECK(!bq25895_read_adc(&dev, NULL));
+}
+
+static void test_adc_control(void) {
+    bool busy;
+
+    setup();
+    CHECK(bq25895_set_adc_cont(&dev, true));
+    CHECK(model.regs[BQ_REG02] & BQ_ADC_RATE_MSK);
+    CHECK(bq25895_set_adc_cont(&dev, false));
+    CHECK_EQ(model.regs[BQ_REG02] & BQ_ADC_RATE_MSK, 0);
+
+    model.conv_reads = 1;
+    CHECK(bq25895_trigger_adc_read(&dev));
+    CHECK(bq25895_is_adc_busy(&dev, &busy));
+    CHECK(busy);
+    CHECK(bq25895_is_adc_busy(&dev, &busy));
+    CHECK(!busy); // Conversion finished
+    CHECK(!bq25895_is_adc_busy(&dev, NULL));
+}
+
+static void test_adc_convert(void) {
+    bq25895_adc_t adc;
+
+    setup();
+    set_adc_regs();
+    model.conv_reads = 3;
+    CHECK(bq25895_adc_convert(&dev, &adc));
+    CHECK_EQ(adc.batt_mv, 4164);
+    CHECK_EQ(model.delay_ms, 1 + 2 + 4 + 8); // Backs off between polls
+
+    // Never completes
+    setup();
+    model.conv_reads = 255;
+    CHECK(!bq25895_adc_convert(&dev, &adc));
+
+    // No delay callback, polls straight away
+    setup();
+    dev.delay = NULL;
+    model.conv_reads = 3;
+    CHECK(bq25895_adc_convert(&dev, &adc));
+}
+
+static int adc_calls;
+static bool adc_ok;
+static bq25895_adc_t adc_result;
+
+static void adc_done(bool ok, bq25895_adc_t const* adc, void* context) {
+    CHECK(context == &model);
+    adc_calls++;
+    adc_ok = ok;
+    if (ok) {
+        adc_result = *adc;
+    } else {
+        CHECK(adc == NULL);
+    }
+}
+
+static void test_adc_async(void) {
+    bq25895_adc_req_t req = {0};
+
+    setup();
+    set_adc_regs();
+    adc_calls = 0;
+    model.conv_reads = 2;
+    CHECK(bq25895_adc_start(&dev, &req, adc_done, &model));
+    CHECK(req.pending);
+    CHECK(!bq25895_adc_start(&dev, &req, adc_done, &model)); // Already running
+    CHECK(bq25895_adc_poll(&dev, &req));
+    CHECK(bq25895_adc_poll(&dev, &req));
+    CHECK_EQ(adc_calls, 0);
+    CHECK(!bq25895_adc_poll(&dev, &req));
+    CHECK_EQ(adc_calls, 1);
+    CHECK(adc_ok);
+    CHECK_EQ(adc_result.vbus_mv, 5000);
+    CHECK(!req.pending);
+    CHECK(!bq25895_adc_poll(&dev, &req)); // Nothing pending
+    CHECK_EQ(adc_calls, 1);
+
+    // Timeout
+    adc_calls = 0;
+    model.conv_reads = 255;
+    CHECK(bq25895_adc_start(&dev, &req, adc_done, &model));
+    while (bq25895_adc_poll(&dev, &req)) {
+    }
+    CHECK_EQ(adc_calls, 1);
+    CHECK(!adc_ok);
+
+    // Bus error
+    adc_calls = 0;
+    model.conv_reads = 2;
+    CHECK(bq25895_adc_start(&dev, &req, adc_done, &model));
+    model.nack = true;
+    CHECK(!bq25895_adc_poll(&dev, &req));
+    CHECK_EQ(adc_calls, 1);
+    CHECK(!adc_ok);
+}
+
+static void test_bus_errors(void) {
+    uint16_t val;
+
+    setup();
+    model.nack = true;
+    CHECK(!bq25895_set_charge_current(&dev, 1024));
+    CHECK(!bq25895_get_charge_current(&dev, &val));
+    CHECK(!bq25895_reset_wdt(&dev));
+    CHECK(!bq25895_trigger_adc_read(&dev));
+
+    // Read-modify-write doesn't write after a failed read
+    model.writes = 0;
+    CHECK(!bq25895_set_charge_current(&dev, 1024));
+    CHECK_EQ(model.writes, 0);
+    CHECK_EQ(model.regs[BQ_REG04], 0x20);
+}
+
+int main(void) {
+    test_numeric_fields();
+    test_charge_config();
+    test_reset_wdt();
+    test_vrechg_and_batlow();
+    test_charge_timer();
+    test_wdt_config();
+    test_charge_termination();
+    test_max_temp();
+    test_batfet();
+    test_status();
+    test_faults();
+    test_is_present();
+    test_adc_getters();
+    test_read_adc();
+    test_adc_control();
+    test_adc_convert();
+    test_adc_async();
+    test_bus_errors();
+
+    return check_done();
+}
@@ -1,4 +1,5 @@
 #include "button.h"
+#include "prof.h"
 
 #include <stdbool.h>
 
@@ -18,6 +19,8 @@ void button_init(struct button *btn, PORT_t *port, uint8_t pin,
 
 void button_update(struct button *btn, uint32_t millis)
 {
+    PROF_BEGIN(PROF_BUTTON_UPDATE);
+
     // Read the current state of the power button (active low)
     bool gpio_state = btn->port->IN & (1 << btn->pin);
 
@@ -47,4 +50,6 @@ void button_update(struct button *btn, uint32_t millis)
 
     // Save the current state for comparison next time
     btn->last_gpio_state = gpio_state;
+
+    PROF_END(PROF_BUTTON_UPDATE);
 }
\ No newline at end of file
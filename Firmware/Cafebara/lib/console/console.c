@@ -1,35 +1,95 @@
+#include <avr/interrupt.h>
 #include <avr/io.h>
-#include <stdio.h>
+#include <string.h>
 
 #include "console.h"
+#include "prof.h"
+#include "pstats.h"
+#include "tlog.h"
 
 // Calculate the USART baud rate register value
 #define USART0_BAUD_RATE(BAUD_RATE) ((float)(F_CPU * 64 / (16 * (float)BAUD_RATE)) + 0.5)
 
-// Print a character to the USART
-static int usart_putchar(char c, FILE *stream)
+// Line being received, and whether it is complete
+static volatile char line[CONSOLE_LINE_MAX];
+static volatile uint8_t line_len    = 0;
+static volatile uint8_t line_ready  = 0;
+
+// Set by a byte received, cleared by console_activity()
+static volatile uint8_t activity    = 0;
+
+// Collect a received character into the line
+static inline void console_receive(char c)
 {
-    // Wait for the transmit buffer to be empty
-    while (!(USART0.STATUS & USART_DREIF_bm))
-        ;
+    // Drop input until the previous line has been handled
+    if (line_ready) {
+        return;
+    }
 
-    // Put the character in the transmit buffer
-    USART0.TXDATAL = c;
+    if (c == '\r' || c == '\n') {
+        if (line_len > 0) {
+            line[line_len] = '\0';
+            line_ready     = 1;
+        }
+    } else if (line_len < CONSOLE_LINE_MAX - 1) {
+        line[line_len++] = c;
+    }
+}
 
-    return 0;
+// Receive complete, and start of frame detected in standby sleep.
+// RX shares its pin with the button, so a press also starts a frame. Only a
+// byte framed correctly, which a held button can't produce, counts as the
+// console being used; a framing error is the button, for the wake statistics
+ISR(USART0_RXC_vect)
+{
+    PROF_BEGIN(PROF_ISR_USART);
+    if (USART0.STATUS & USART_RXSIF_bm) {
+        USART0.STATUS = USART_RXSIF_bm; // Just wakes the receiver
+    }
+    if (USART0.STATUS & USART_RXCIF_bm) {
+        uint8_t status = USART0.RXDATAH;
+        char c         = USART0.RXDATAL;
+        if (!(status & USART_FERR_bm)) {
+            pstats_wake(PSTATS_WAKE_USART);
+            console_receive(c);
+            activity = 1;
+        } else {
+            pstats_wake(PSTATS_WAKE_BUTTON);
+        }
+    }
+    PROF_END(PROF_ISR_USART);
 }
 
-// Initialize a stdio stream for the USART
-static FILE USART_stream = FDEV_SETUP_STREAM(usart_putchar, NULL, _FDEV_SETUP_WRITE);
+// Set while the last byte written may still be shifting out
+static volatile uint8_t tx_pending = 0;
+
+// Send queued log bytes as the transmit buffer empties
+ISR(USART0_DRE_vect)
+{
+    uint8_t byte;
+    if (tlog_pop(&byte)) {
+        USART0.STATUS  = USART_TXCIF_bm;
+        USART0.TXDATAL = byte;
+        tx_pending     = 1;
+    } else {
+        USART0.CTRLA &= ~USART_DREIE_bm;
+    }
+}
+
+// Start sending queued log records
+static void console_kick(void)
+{
+    USART0.CTRLA |= USART_DREIE_bm;
+}
 
 void console_init(uint32_t baud_rate)
 {
     // Set the baud rate
     USART0.BAUD = (uint16_t)USART0_BAUD_RATE(baud_rate);
 
-    USART0.CTRLC = (USART_CMODE_SYNCHRONOUS_gc + USART_PMODE_DISABLED_gc + USART_SBMODE_1BIT_gc + USART_CHSIZE_8BIT_gc);
+    USART0.CTRLC = (USART_CMODE_ASYNCHRONOUS_gc + USART_PMODE_DISABLED_gc + USART_SBMODE_1BIT_gc + USART_CHSIZE_8BIT_gc);
 
-    USART0.CTRLA |= USART_RXCIE_bm;
+    USART0.CTRLA |= USART_RXCIE_bm + USART_RXSIE_bm;
 
     // Set TX pin as output
     PORTA.DIR |= PIN1_bm;
@@ -37,9 +97,86 @@ void console_init(uint32_t baud_rate)
     // Set RX pin as input
     PORTA.DIR &= ~PIN2_bm;
 
-    // Enable the USART transmitter
-    USART0.CTRLB |= (USART_TXEN_bm + USART_RXEN_bm);
+    // Enable the USART transmitter, and the receiver with start-of-frame
+    // detection, which keeps it listening in standby sleep
+    USART0.CTRLB |= (USART_TXEN_bm + USART_RXEN_bm + USART_SFDEN_bm);
+
+    // Output is tokenised log records, drained by the DRE interrupt
+    tlog_init(console_kick);
+}
+
+bool console_busy(void)
+{
+    if (USART0.CTRLA & USART_DREIE_bm) {
+        return true;
+    }
 
-    // Attach stdout to the USART stream
-    stdout = &USART_stream;
-}
\ No newline at end of file
+    // Wait for the last byte to leave the shift register
+    if (tx_pending && !(USART0.STATUS & USART_TXCIF_bm)) {
+        return true;
+    }
+    tx_pending = 0;
+    return false;
+}
+
+void console_suspend(void)
+{
+    // Hand TX back to the port at the idle level, then let the pull-up hold
+    // it there. Left driven low it would send a break
+    PORTA.OUTSET = PIN1_bm;
+    USART0.CTRLB &= ~USART_TXEN_bm;
+    PORTA.PIN1CTRL |= PORT_PULLUPEN_bm;
+    PORTA.DIRCLR = PIN1_bm;
+}
+
+void console_resume(void)
+{
+    PORTA.DIRSET = PIN1_bm;
+    PORTA.PIN1CTRL &= ~PORT_PULLUPEN_bm;
+    USART0.CTRLB |= USART_TXEN_bm;
+}
+
+bool console_activity(void)
+{
+    if (!activity) {
+        return false;
+    }
+    activity = 0;
+    return true;
+}
+
+bool console_readline(char *buf, uint8_t size)
+{
+    if (!line_ready) {
+        return false;
+    }
+
+    uint8_t len = (line_len < size) ? line_len : size - 1;
+    for (uint8_t i = 0; i < len; i++) {
+        buf[i] = line[i];
+    }
+    buf[len] = '\0';
+
+    // Ready for the next line
+    line_len   = 0;
+    line_ready = 0;
+
+    return true;
+}
+
+bool console_dispatch(const char *line, struct console_cmd const *cmds, uint8_t count)
+{
+    // Split off the command name
+    const char *args = strchr(line, ' ');
+    size_t len       = args ? (size_t)(args - line) : strlen(line);
+    args             = args ? args + 1 : "";
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (strlen(cmds[i].name) == len && strncmp(cmds[i].name, line, len) == 0) {
+            cmds[i].fn(args);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -1,6 +1,44 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
-// Initialize the USART console at the given baud rate
-void console_init(uint32_t baud_rate);
\ No newline at end of file
+// Longest command line accepted, including the terminator
+#define CONSOLE_LINE_MAX 32
+
+// Command handler, given everything after the command name
+typedef void (*console_cmd_fn)(const char *args);
+
+// Console command
+struct console_cmd {
+    const char *name;
+    console_cmd_fn fn;
+};
+
+// Initialize the USART console at the given baud rate. Output is the log
+// records queued with TLOG(), decoded on the host by scripts/tlog_decode.py
+//
+// The receiver keeps listening in standby sleep, and the start of an incoming
+// byte wakes the MCU. Start-up of the main clock eats into the first byte, so
+// at high baud rates that byte may be dropped: send a newline to wake it first
+void console_init(uint32_t baud_rate);
+
+// Is output still being sent? The transmitter stops in standby sleep
+bool console_busy(void);
+
+// Stop the transmitter before sleep, leaving the TX pin an input pulled up to
+// the idle level. The receiver keeps listening, so the console can still wake
+// the MCU
+void console_suspend(void);
+
+// Start the transmitter again after waking
+void console_resume(void);
+
+// Has anything been received since the last call?
+bool console_activity(void);
+
+// Fetch the next complete line received on the console, if there is one
+bool console_readline(char *buf, uint8_t size);
+
+// Run the command matching the first word of a line, false if there is none
+bool console_dispatch(const char *line, struct console_cmd const *cmds, uint8_t count);
@@ -6,6 +6,8 @@
 #include <avr/io.h>
 
 #include "i2c_target.h"
+#include "prof.h"
+#include "pstats.h"
 
 // State machine for I2C target mode
 static enum i2c_state { IDLE, NEW_TRANSACTION, RECEIVED_ADDRESS, RECEIVED_DATA, SENT_DATA };
@@ -41,6 +43,7 @@ static void i2c_target_end_transaction()
 
 static void i2c_target_handle_address_match()
 {
+  pstats_count(PSTATS_EVENT_TWI_TRANSACTIONS, 1);
   i2c_state = NEW_TRANSACTION;
   i2c_ack();
 }
@@ -77,6 +80,8 @@ static void i2c_target_handle_data()
 // I2C target mode interrupt handler
 ISR(TWI0_TWIS_vect)
 {
+  PROF_BEGIN(PROF_ISR_TWIS);
+  pstats_wake(PSTATS_WAKE_TWI);
   if (TWI0.SSTATUS & (TWI_COLL_bm | TWI_BUSERR_bm)) {
     // Handle collisions and bus errors
     i2c_target_end_transaction();
@@ -89,8 +94,10 @@ ISR(TWI0_TWIS_vect)
     }
   } else if (TWI0.SSTATUS & TWI_DIF_bm) {
     // Handle data interrupts
+    pstats_count(PSTATS_EVENT_TWI_BYTES, 1);
     i2c_target_handle_data();
   }
+  PROF_END(PROF_ISR_TWIS);
 }
 
 void i2c_target_init(uint8_t addr, read_register_fn read_fn, write_register_fn write_fn)
@@ -0,0 +1,21 @@
+#include "pm.h"
+
+#include <stddef.h>
+
+void pm_suspend(struct pm_driver const *drivers, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (drivers[i].suspend != NULL) {
+            drivers[i].suspend();
+        }
+    }
+}
+
+void pm_resume(struct pm_driver const *drivers, uint8_t count)
+{
+    for (uint8_t i = count; i-- > 0;) {
+        if (drivers[i].resume != NULL) {
+            drivers[i].resume();
+        }
+    }
+}
@@ -0,0 +1,27 @@
+/**
+ * Power manager hooks around standby sleep.
+ *
+ * - Each driver puts its pins and peripheral into their lowest-current state
+ *   in its suspend hook, and brings them back in its resume hook
+ * - Suspend hooks run in table order, resume hooks in reverse order
+ * - Either hook may be NULL
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Suspend or resume hook
+typedef void (*pm_hook_fn)(void);
+
+// Driver taking part in sleep
+struct pm_driver {
+    pm_hook_fn suspend;
+    pm_hook_fn resume;
+};
+
+// Run every suspend hook, right before sleeping
+void pm_suspend(struct pm_driver const *drivers, uint8_t count);
+
+// Run every resume hook, right after waking
+void pm_resume(struct pm_driver const *drivers, uint8_t count);
@@ -0,0 +1,132 @@
+#include "prof.h"
+
+#ifdef PROF_ENABLE
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "log_msgs.h"
+
+// Timer ticks per microsecond
+#define PROF_TICKS_PER_US (F_CPU / 2000000UL)
+
+// Upper half of the 32-bit tick count, extended by the TCB0 wrap interrupt
+static volatile uint16_t overflows = 0;
+
+// Section statistics, and when and how deeply each running section started
+static struct prof_stat stats[PROF_SECTIONS];
+static uint32_t started[PROF_SECTIONS];
+static uint8_t depth[PROF_SECTIONS];
+
+// Count timer wraps
+ISR(TCB0_INT_vect)
+{
+    TCB0.INTFLAGS = TCB_CAPT_bm;
+    overflows++;
+}
+
+// Current 32-bit tick count
+static uint32_t prof_now()
+{
+    uint16_t cnt, ovf;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        cnt = TCB0.CNT;
+        ovf = overflows;
+
+        // Wrapped since interrupts were disabled, but not counted yet
+        if ((TCB0.INTFLAGS & TCB_CAPT_bm) && cnt < 0x8000) {
+            ovf++;
+        }
+    }
+
+    return ((uint32_t)ovf << 16) | cnt;
+}
+
+void prof_init()
+{
+    prof_reset();
+
+    // Free-running, wrapping at 0xFFFF
+    TCB0.CCMP    = 0xFFFF;
+    TCB0.CNT     = 0;
+    TCB0.CTRLB   = TCB_CNTMODE_INT_gc;
+    TCB0.INTCTRL = TCB_CAPT_bm;
+    TCB0.CTRLA   = TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+}
+
+void prof_reset()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        for (uint8_t i = 0; i < PROF_SECTIONS; i++) {
+            stats[i].min   = UINT32_MAX;
+            stats[i].max   = 0;
+            stats[i].total = 0;
+            stats[i].count  = 0;
+            stats[i].nested = 0;
+        }
+    }
+}
+
+void prof_begin(enum prof_section id)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (depth[id]++ == 0) {
+            started[id] = prof_now();
+        } else if (stats[id].nested < UINT16_MAX) {
+            stats[id].nested++; // Keep timing from the outermost begin
+        }
+    }
+}
+
+void prof_end(enum prof_section id)
+{
+    uint32_t ticks;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (depth[id] == 0 || --depth[id] != 0) {
+            return; // Unmatched, or closing a nested begin
+        }
+        ticks = prof_now() - started[id];
+    }
+    struct prof_stat *stat = &stats[id];
+
+    // Stop accumulating before the total or count overflow
+    if (stat->count == UINT16_MAX || stat->total + ticks < stat->total) {
+        return;
+    }
+
+    if (ticks < stat->min) {
+        stat->min = ticks;
+    }
+    if (ticks > stat->max) {
+        stat->max = ticks;
+    }
+    stat->total += ticks;
+    stat->count++;
+}
+
+void prof_get(enum prof_section id, struct prof_stat *stat)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *stat = stats[id];
+    }
+}
+
+void prof_dump()
+{
+    TLOG_WAIT(LOG_PROF_HEADER);
+    for (uint8_t i = 0; i < PROF_SECTIONS; i++) {
+        struct prof_stat stat;
+        prof_get(i, &stat);
+        if (stat.count == 0) {
+            continue;
+        }
+
+        TLOG_WAIT(LOG_PROF_SECTION, i, stat.count, (uint32_t)(stat.min / PROF_TICKS_PER_US),
+                  (uint32_t)(stat.total / stat.count / PROF_TICKS_PER_US),
+                  (uint32_t)(stat.max / PROF_TICKS_PER_US), stat.nested);
+    }
+}
+
+#endif // PROF_ENABLE
@@ -0,0 +1,68 @@
+/**
+ * Section profiler.
+ *
+ * - Times code sections with a free-running TCB0 counter, at CLK_PER/2
+ * - Keeps the minimum, maximum, total and count for each section
+ * - Sections may nest. A section re-entered before it ends, eg. from an
+ *   interrupt, is timed from the outermost begin to its end, and the inner
+ *   begins are counted as nested rather than timed
+ * - Build with -DPROF_ENABLE to enable, otherwise the macros compile to nothing
+ *   and TCB0 is left untouched
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Profiled sections
+enum prof_section {
+    PROF_I2C_TRANSFER,
+    PROF_LED_REFRESH,
+    PROF_MONITOR_BATT,
+    PROF_CHARGING_STATUS,
+    PROF_BUTTON_UPDATE,
+    PROF_ISR_RTC,
+    PROF_ISR_TWIS,
+    PROF_ISR_USART,
+    PROF_ISR_PORTA,
+    PROF_ISR_PORTB,
+    PROF_ISR_PORTC,
+    PROF_SECTIONS,
+};
+
+// Per-section statistics, in timer ticks
+struct prof_stat {
+    uint32_t min;
+    uint32_t max;
+    uint32_t total;
+    uint16_t count;
+    uint16_t nested;
+};
+
+#ifdef PROF_ENABLE
+
+#define PROF_BEGIN(id) prof_begin(id)
+#define PROF_END(id)   prof_end(id)
+
+// Start the profiling timer and clear the statistics
+void prof_init();
+
+// Clear the statistics
+void prof_reset();
+
+// Mark the start and end of a section
+void prof_begin(enum prof_section id);
+void prof_end(enum prof_section id);
+
+// Get the statistics for a section
+void prof_get(enum prof_section id, struct prof_stat *stat);
+
+// Log the statistics for every section that has run, in microseconds
+void prof_dump();
+
+#else
+
+#define PROF_BEGIN(id) do {} while (0)
+#define PROF_END(id)   do {} while (0)
+
+#endif // PROF_ENABLE
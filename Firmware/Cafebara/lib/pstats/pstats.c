@@ -0,0 +1,81 @@
+#include "pstats.h"
+
+#include <string.h>
+#include <util/atomic.h>
+
+#include "log_msgs.h"
+
+static struct pstats stats;
+
+// Set between pstats_sleep() and the interrupt that ends the sleep
+static volatile uint8_t sleeping = 0;
+
+// State being accounted, and when it was last accounted
+static uint8_t state       = PSTATS_STATE_AWAKE;
+static uint32_t state_from = 0;
+
+void pstats_sleep()
+{
+    sleeping = 1;
+}
+
+void pstats_wake(enum pstats_wake source)
+{
+    if (sleeping) {
+        sleeping = 0;
+        stats.wakeups[source]++;
+    }
+}
+
+void pstats_state(enum pstats_state next, uint32_t millis)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats.state_ms[state] += millis - state_from;
+        state      = next;
+        state_from = millis;
+    }
+}
+
+void pstats_add_time(enum pstats_state add_to, uint32_t ms)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats.state_ms[add_to] += ms;
+    }
+}
+
+void pstats_count(enum pstats_event event, uint16_t n)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        stats.events[event] += n;
+    }
+}
+
+void pstats_get(struct pstats *out)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *out = stats;
+    }
+}
+
+void pstats_reset()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memset(&stats, 0, sizeof(stats));
+    }
+}
+
+void pstats_dump()
+{
+    struct pstats copy;
+    pstats_get(&copy);
+
+    for (uint8_t i = 0; i < PSTATS_WAKES; i++) {
+        TLOG_WAIT(LOG_PSTATS_WAKE, i, copy.wakeups[i]);
+    }
+    for (uint8_t i = 0; i < PSTATS_STATES; i++) {
+        TLOG_WAIT(LOG_PSTATS_STATE, i, copy.state_ms[i] / 1000, (uint16_t)(copy.state_ms[i] % 1000));
+    }
+    for (uint8_t i = 0; i < PSTATS_EVENTS; i++) {
+        TLOG_WAIT(LOG_PSTATS_EVENT, i, copy.events[i]);
+    }
+}
@@ -0,0 +1,77 @@
+/**
+ * Power and wakeup accounting.
+ *
+ * - Counts what wakes the MCU from sleep: only the first interrupt after
+ *   pstats_sleep() is counted, so the counts are causes, not interrupt totals
+ * - Accumulates the time spent in each power state
+ * - Counts bus and LED activity, which costs the MCU awake time
+ * - Counters are 32 bits and wrap
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Interrupts that can end a sleep
+enum pstats_wake {
+    PSTATS_WAKE_BUTTON,
+    PSTATS_WAKE_BQ_INT,
+    PSTATS_WAKE_TEMP_ALERT,
+    PSTATS_WAKE_HPD,
+    PSTATS_WAKE_RTC,
+    PSTATS_WAKE_TWI,
+    PSTATS_WAKE_USART,
+    PSTATS_WAKES,
+};
+
+// Power states time is accounted to
+enum pstats_state {
+    PSTATS_STATE_ON,        // Console powered
+    PSTATS_STATE_CHARGING,  // Console off, charging
+    PSTATS_STATE_AWAKE,     // Console off, MCU awake
+    PSTATS_STATE_STANDBY,   // MCU in standby sleep
+    PSTATS_STATES,
+};
+
+// Counted events
+enum pstats_event {
+    PSTATS_EVENT_I2C_TRANSFERS,   // Controller transfers
+    PSTATS_EVENT_I2C_BYTES,       // Controller bytes, excluding addresses
+    PSTATS_EVENT_TWI_TRANSACTIONS, // Target transactions, from the Pi
+    PSTATS_EVENT_TWI_BYTES,       // Target bytes, excluding addresses
+    PSTATS_EVENT_LED_REFRESHES,   // LED chain updates
+    PSTATS_EVENTS,
+};
+
+// All counters
+struct pstats {
+    uint32_t wakeups[PSTATS_WAKES];
+    uint32_t state_ms[PSTATS_STATES];
+    uint32_t events[PSTATS_EVENTS];
+};
+
+// About to sleep, the next interrupt is counted as the wakeup source
+void pstats_sleep();
+
+// Called at the start of each interrupt that can end a sleep
+void pstats_wake(enum pstats_wake source);
+
+// Account the time since the last call to the state it was in, and switch to
+// a new state. Time not covered by the millisecond count, eg. standby sleep
+// with the RTC stopped, is added with pstats_add_time()
+void pstats_state(enum pstats_state state, uint32_t millis);
+
+// Add time measured elsewhere to a state
+void pstats_add_time(enum pstats_state state, uint32_t ms);
+
+// Count events
+void pstats_count(enum pstats_event event, uint16_t n);
+
+// Get a copy of the counters
+void pstats_get(struct pstats *stats);
+
+// Clear the counters
+void pstats_reset();
+
+// Log the counters
+void pstats_dump();
@@ -1,22 +1,52 @@
 #include "rtc.h"
+#include "prof.h"
+#include "pstats.h"
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>
 
 static volatile uint32_t millis = 0;
 
 static volatile uint8_t enabled = 0;
 
+// Sleep is timed by the RTC counter at 32 Hz, so it only wraps (and wakes the
+// MCU to count it) every ~34 minutes
+static volatile uint16_t sleep_wraps = 0;
+static uint32_t slept_ms = 0;
+
 // Handle periodic interrupts on the RTC
 ISR(RTC_PIT_vect)
 {
+    PROF_BEGIN(PROF_ISR_RTC);
     RTC.PITINTFLAGS     = RTC_PI_bm;
     millis++;
+    PROF_END(PROF_ISR_RTC);
+}
+
+// Count wraps of the sleep timer
+ISR(RTC_CNT_vect)
+{
+    pstats_wake(PSTATS_WAKE_RTC);
+    RTC.INTFLAGS        = RTC_OVF_bm;
+    sleep_wraps++;
 }
 
 void rtc_init()
 {
     if (!enabled) {
+        // Stop the sleep timer, and convert its 32 Hz ticks to ms
+        while (RTC.STATUS) {}
+        RTC.CTRLA       = 0;
+        RTC.INTCTRL     = 0;
+        uint16_t wraps  = sleep_wraps;
+        if (RTC.INTFLAGS & RTC_OVF_bm) { // Wrapped, but not counted yet
+            RTC.INTFLAGS = RTC_OVF_bm;
+            wraps++;
+        }
+        uint32_t ticks  = ((uint32_t)wraps << 16) | RTC.CNT;
+        slept_ms        = (ticks >> 2) * 125 + (((ticks & 3) * 125) >> 2);
+
         RTC.CLKSEL      = RTC_CLKSEL_INT32K_gc;
         RTC.PITINTCTRL  = RTC_PI_bm;
         RTC.PITCTRLA    = RTC_PERIOD_CYC32_gc | RTC_PITEN_bm;
@@ -30,10 +60,29 @@ void rtc_deinit()
         RTC.PITINTCTRL  = 0;
         RTC.PITCTRLA    = 0;
         enabled         = 0;
+
+        // Time the sleep
+        while (RTC.STATUS) {}
+        RTC.CNT         = 0;
+        RTC.PER         = 0xFFFF;
+        sleep_wraps     = 0;
+        RTC.INTFLAGS    = RTC_OVF_bm;
+        RTC.INTCTRL     = RTC_OVF_bm;
+        RTC.CTRLA       = RTC_PRESCALER_DIV1024_gc | RTC_RUNSTDBY_bm | RTC_RTCEN_bm;
     }
 }
 
 uint32_t rtc_millis()
 {
-    return millis;
+    // Four byte loads, the PIT interrupt mustn't land between them
+    uint32_t now;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        now = millis;
+    }
+    return now;
+}
+
+uint32_t rtc_slept_ms()
+{
+    return slept_ms;
 }
\ No newline at end of file
@@ -5,8 +5,12 @@
 // Configure the RTC for ~1ms periodic interrupts
 void rtc_init();
 
-// De-init the RTC for sleep modes
+// De-init the RTC for sleep modes. The millisecond count stops, and a slower
+// counter that keeps running in standby times the sleep instead
 void rtc_deinit();
 
 // Get the current millisecond count since the RTC was started
-uint32_t rtc_millis();
\ No newline at end of file
+uint32_t rtc_millis();
+
+// Length of the last sleep, from rtc_deinit() to rtc_init(), in ms
+uint32_t rtc_slept_ms();
\ No newline at end of file
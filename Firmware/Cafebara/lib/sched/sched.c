@@ -0,0 +1,18 @@
+#include "sched.h"
+
+void sched_run(struct sched_task *tasks, uint8_t count, uint32_t millis)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (millis - tasks[i].last_millis >= tasks[i].period_ms) {
+            tasks[i].last_millis = millis;
+            tasks[i].fn();
+        }
+    }
+}
+
+void sched_expire(struct sched_task *tasks, uint8_t count, uint32_t millis)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        tasks[i].last_millis = millis - tasks[i].period_ms;
+    }
+}
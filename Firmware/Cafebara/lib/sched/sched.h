@@ -0,0 +1,27 @@
+/**
+ * Minimal cooperative scheduler.
+ *
+ * - Runs a static table of periodic tasks from the main loop
+ * - Periods are in milliseconds, driven by an external millisecond counter
+ * - Tasks run to completion, in table order
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Task callback
+typedef void (*sched_task_fn)(void);
+
+// Periodic task
+struct sched_task {
+    sched_task_fn fn;
+    uint16_t period_ms;
+    uint32_t last_millis;
+};
+
+// Run every task whose period has elapsed
+void sched_run(struct sched_task *tasks, uint8_t count, uint32_t millis);
+
+// Make every task due on the next run, eg. after waking from sleep
+void sched_expire(struct sched_task *tasks, uint8_t count, uint32_t millis);
@@ -0,0 +1,122 @@
+#include "tlog.h"
+
+#if defined(AVR)
+#include <avr/io.h>
+#include <util/atomic.h>
+#define TLOG_ATOMIC   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#define TLOG_CAN_WAIT (SREG & CPU_I_bm)
+#else
+#define TLOG_ATOMIC
+#define TLOG_CAN_WAIT 1
+#endif
+
+#if TLOG_BUF_SIZE & (TLOG_BUF_SIZE - 1) || TLOG_BUF_SIZE > 128
+#error "TLOG_BUF_SIZE must be a power of two, up to 128"
+#endif
+
+#define TLOG_MASK (TLOG_BUF_SIZE - 1)
+
+// Free-running indices, masked on access, so head - tail is the length. Bytes,
+// so the consumer can read head without disabling interrupts
+static uint8_t buf[TLOG_BUF_SIZE];
+static volatile uint8_t head = 0;
+static volatile uint8_t tail = 0;
+static volatile uint16_t dropped = 0;
+
+static tlog_kick_fn kick_fn = 0;
+
+void tlog_init(tlog_kick_fn kick)
+{
+    TLOG_ATOMIC {
+        head    = 0;
+        tail    = 0;
+        dropped = 0;
+    }
+    kick_fn = kick;
+}
+
+static inline uint8_t tlog_free(void)
+{
+    return TLOG_BUF_SIZE - (uint8_t)(head - tail);
+}
+
+static inline void tlog_put(uint8_t byte)
+{
+    buf[head & TLOG_MASK] = byte;
+    head++;
+}
+
+bool tlog_write(uint8_t id, void const *args, uint8_t len)
+{
+    uint8_t const *data = args;
+    bool queued         = false;
+
+    TLOG_ATOMIC {
+        if (tlog_free() >= (uint16_t)TLOG_HEADER_LEN + len) {
+            tlog_put(TLOG_SYNC);
+            tlog_put(id);
+            tlog_put(len);
+            for (uint8_t i = 0; i < len; i++) {
+                tlog_put(data[i]);
+            }
+            queued = true;
+        } else if (dropped < UINT16_MAX) {
+            dropped++;
+        }
+    }
+
+    if (queued && kick_fn) {
+        kick_fn();
+    }
+    return queued;
+}
+
+void tlog_write_wait(uint8_t id, void const *args, uint8_t len)
+{
+    // Nothing drains the buffer without a kick function or with interrupts
+    // disabled, so don't wait forever
+    while (kick_fn && TLOG_CAN_WAIT && tlog_free() < (uint16_t)TLOG_HEADER_LEN + len
+           && (uint16_t)TLOG_HEADER_LEN + len <= TLOG_BUF_SIZE) {
+        kick_fn();
+    }
+
+    tlog_write(id, args, len);
+}
+
+bool tlog_pop(uint8_t *byte)
+{
+    bool popped = false;
+
+    TLOG_ATOMIC {
+        if (head != tail) {
+            *byte = buf[tail & TLOG_MASK];
+            tail++;
+            popped = true;
+        }
+    }
+
+    return popped;
+}
+
+uint8_t tlog_read(uint8_t *out, uint8_t max)
+{
+    uint8_t n = 0;
+    while (n < max && tlog_pop(&out[n])) {
+        n++;
+    }
+    return n;
+}
+
+uint8_t tlog_used(void)
+{
+    return (uint8_t)(head - tail);
+}
+
+uint16_t tlog_dropped(void)
+{
+    uint16_t count;
+    TLOG_ATOMIC {
+        count = dropped;
+    }
+    return count;
+}
@@ -0,0 +1,93 @@
+/**
+ * Tokenised binary logging.
+ *
+ * - Each record is a message ID and the raw bytes of its arguments, with no
+ *   formatting on the MCU. The format strings only exist on the host
+ * - Records are queued in a ring buffer and drained by the output, eg. the
+ *   USART data register empty interrupt
+ * - TLOG() never blocks: a record that doesn't fit is dropped and counted.
+ *   TLOG_WAIT() waits for space, for output that must not be lost, eg.
+ *   console command replies. With interrupts disabled it can't wait, and
+ *   drops like TLOG()
+ * - Portable: builds on the host, without the AVR headers
+ *
+ * On the wire, a record is TLOG_SYNC, the message ID, the argument length and
+ * the arguments, little-endian as they are in memory. Text never contains
+ * TLOG_SYNC, so records can be mixed with plain text output.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Ring buffer size, a power of two up to 128
+#ifndef TLOG_BUF_SIZE
+#define TLOG_BUF_SIZE 128
+#endif
+
+// First byte of every record
+#define TLOG_SYNC 0xFE
+
+// Record header: sync, ID, length
+#define TLOG_HEADER_LEN 3
+
+// Called when a record has been queued, eg. to start the transmitter
+typedef void (*tlog_kick_fn)(void);
+
+// Clear the buffer and set the function that starts draining it
+void tlog_init(tlog_kick_fn kick);
+
+// Queue a record, dropping it if there is no room
+bool tlog_write(uint8_t id, void const *args, uint8_t len);
+
+// Queue a record, waiting for room while the buffer drains
+void tlog_write_wait(uint8_t id, void const *args, uint8_t len);
+
+// Take the next byte to send, false if the buffer is empty
+bool tlog_pop(uint8_t *byte);
+
+// Take up to max bytes, returning the number taken
+uint8_t tlog_read(uint8_t *buf, uint8_t max);
+
+// Bytes waiting to be sent
+uint8_t tlog_used(void);
+
+// Records dropped for lack of room
+uint16_t tlog_dropped(void);
+
+// Log a message with up to 6 arguments, each sent as sizeof() bytes. The
+// argument types must match the conversions in the message's format.
+#define TLOG(id, ...)      TLOG_RECORD(tlog_write, id, ##__VA_ARGS__)
+#define TLOG_WAIT(id, ...) TLOG_RECORD(tlog_write_wait, id, ##__VA_ARGS__)
+
+#define TLOG_RECORD(fn, id, ...)                                                     \
+    do {                                                                             \
+        uint8_t _tlog_buf[0 TLOG_EACH(TLOG_SIZE, ##__VA_ARGS__) + 1];                 \
+        uint8_t _tlog_len = 0;                                                       \
+        TLOG_EACH(TLOG_PUT, ##__VA_ARGS__)                                           \
+        fn((uint8_t)(id), _tlog_buf, _tlog_len);                                     \
+    } while (0)
+
+#define TLOG_SIZE(x) +sizeof(x)
+#define TLOG_PUT(x)                                                                  \
+    {                                                                                \
+        __typeof__(x) _tlog_arg = (x);                                               \
+        memcpy(&_tlog_buf[_tlog_len], &_tlog_arg, sizeof(_tlog_arg));                \
+        _tlog_len += sizeof(_tlog_arg);                                              \
+    }
+
+// Apply a macro to each of up to 6 arguments
+#define TLOG_EACH(m, ...) TLOG_CAT(TLOG_EACH_, TLOG_NARGS(__VA_ARGS__))(m, ##__VA_ARGS__)
+#define TLOG_NARGS(...)   TLOG_NARGS_(_, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define TLOG_NARGS_(_, a, b, c, d, e, f, n, ...) n
+#define TLOG_CAT(a, b)  TLOG_CAT_(a, b)
+#define TLOG_CAT_(a, b) a##b
+#define TLOG_EACH_0(m)
+#define TLOG_EACH_1(m, a)      m(a)
+#define TLOG_EACH_2(m, a, ...) m(a) TLOG_EACH_1(m, __VA_ARGS__)
+#define TLOG_EACH_3(m, a, ...) m(a) TLOG_EACH_2(m, __VA_ARGS__)
+#define TLOG_EACH_4(m, a, ...) m(a) TLOG_EACH_3(m, __VA_ARGS__)
+#define TLOG_EACH_5(m, a, ...) m(a) TLOG_EACH_4(m, __VA_ARGS__)
+#define TLOG_EACH_6(m, a, ...) m(a) TLOG_EACH_5(m, __VA_ARGS__)
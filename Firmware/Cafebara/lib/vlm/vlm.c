@@ -0,0 +1,28 @@
+#include "vlm.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+static vlm_fn low_fn = 0;
+
+ISR(BOD_VLM_vect)
+{
+    BOD.INTFLAGS = BOD_VLMIF_bm;
+    if (low_fn) {
+        low_fn();
+    }
+}
+
+void vlm_init(uint8_t level, vlm_fn fn)
+{
+    low_fn = fn;
+
+    BOD.VLMCTRLA = level;
+    BOD.INTFLAGS = BOD_VLMIF_bm;
+    BOD.INTCTRL  = BOD_VLMCFG_BELOW_gc | BOD_VLMIE_bm;
+}
+
+bool vlm_low()
+{
+    return BOD.STATUS & BOD_VLMS_bm;
+}
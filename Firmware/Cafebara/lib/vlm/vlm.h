@@ -0,0 +1,23 @@
+/**
+ * Voltage level monitor: an early warning a set margin above the BOD level,
+ * while VDD is still high enough to act on it.
+ *
+ * - The BOD level and mode come from the BODCFG fuse, and the VLM only runs
+ *   while the BOD is enabled
+ * - The callback runs in the interrupt, as the supply is collapsing: keep it
+ *   to switching loads off, and leave logging and EEPROM writes for later
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*vlm_fn)();
+
+// Call fn when VDD falls below the BOD level plus level, a BOD_VLMLVL_*_gc
+// value
+void vlm_init(uint8_t level, vlm_fn fn);
+
+// Is VDD below the VLM level now?
+bool vlm_low();
@@ -0,0 +1,53 @@
+#include "watchdog.h"
+
+#include <avr/io.h>
+#include <avr/wdt.h>
+
+static uint8_t reset_cause = 0;
+
+// Current deadline, and when the watchdog was last fed
+static uint8_t period       = WDT_PERIOD_OFF_gc;
+static uint32_t fed_millis  = 0;
+
+// Write the configuration, which is protected, once the previous write has
+// reached the watchdog clock domain
+static void watchdog_write(uint8_t ctrla)
+{
+    while (WDT.STATUS & WDT_SYNCBUSY_bm) {}
+    _PROTECTED_WRITE(WDT.CTRLA, ctrla);
+}
+
+void watchdog_init()
+{
+    reset_cause   = RSTCTRL.RSTFR;
+    RSTCTRL.RSTFR = reset_cause;
+
+    period = WDT_PERIOD_OFF_gc;
+    watchdog_write(0);
+}
+
+uint8_t watchdog_reset_cause()
+{
+    return reset_cause;
+}
+
+void watchdog_arm(uint8_t next, uint32_t millis)
+{
+    if (next == period) {
+        return;
+    }
+
+    period     = next;
+    fed_millis = millis;
+    watchdog_write((next == WDT_PERIOD_OFF_gc) ? 0 : (WATCHDOG_WINDOW | next));
+}
+
+void watchdog_feed(uint32_t millis)
+{
+    if (period == WDT_PERIOD_OFF_gc || millis - fed_millis < WATCHDOG_FEED_MS) {
+        return;
+    }
+
+    fed_millis = millis;
+    wdt_reset();
+}
@@ -0,0 +1,36 @@
+/**
+ * Window-mode watchdog.
+ *
+ * - Runs from the 1.024 kHz ULP clock, the same as the RTC
+ * - Feeding inside the closed window, right after the last feed, resets the
+ *   MCU as surely as missing the deadline does, so a loop stuck calling the
+ *   feed is caught too
+ * - Feeds are rate-limited to once every WATCHDOG_FEED_MS, which is past the
+ *   closed window, so the feed can sit in a loop that runs much faster. The
+ *   margin is only ~66 ms: the millis passed in must never read ahead, eg.
+ *   torn by the RTC interrupt, or a feed lands in the closed window
+ */
+
+#pragma once
+
+#include <avr/io.h>
+#include <stdint.h>
+
+// Closed window after each feed, ~62 ms
+#define WATCHDOG_WINDOW  WDT_WINDOW_64CLK_gc
+
+// Time between feeds, in ms of rtc_millis(), comfortably past the window
+#define WATCHDOG_FEED_MS 128
+
+// Capture and clear the reset flags, and stop a watchdog left running
+void watchdog_init();
+
+// Reset flags captured by watchdog_init(), RSTCTRL_*RF_bm
+uint8_t watchdog_reset_cause();
+
+// Set the deadline, a WDT_PERIOD_*_gc value, or stop the watchdog with
+// WDT_PERIOD_OFF_gc. Does nothing if the deadline is unchanged
+void watchdog_arm(uint8_t period, uint32_t millis);
+
+// Feed the watchdog, unless it was fed less than WATCHDOG_FEED_MS ago
+void watchdog_feed(uint32_t millis);
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Generate the battery profile tables from batt_profiles.json.
+
+Each profile's OCV curve is expanded into a direct-index lookup table, so
+the voltage to state of charge mapping on the MCU is a subtraction, a shift
+and one table read. Writes include/batt_profiles.h and src/batt_profiles.c,
+leaving them untouched if nothing changed.
+
+  batt_profiles.py [--project DIR]
+
+Also run by PlatformIO before every build (as an extra script).
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+SOC_OCV_POINTS = 9
+SOC_LUT_SIZE = 256
+SOC_FULL = 0xFF
+
+# BQ25895 register ranges
+CHARGE_MV = (3840, 4608)
+CHARGE_MA = (0, 5056)
+PRECHARGE_MA = (64, 1024)
+TERM_MA = (64, 1024)
+
+HEADER = "/* Generated by scripts/batt_profiles.py from batt_profiles.json, do not edit */\n"
+
+
+def soc_from_ocv(ocv, mv):
+    """The interpolation the firmware used before the lookup tables."""
+    if mv <= ocv[0]:
+        return 0
+    if mv >= ocv[-1]:
+        return SOC_FULL
+    i = 0
+    while mv >= ocv[i + 1]:
+        i += 1
+    soc = (i << 5) + ((mv - ocv[i]) << 5) // (ocv[i + 1] - ocv[i])
+    return min(soc, SOC_FULL)
+
+
+def lut(ocv):
+    """Smallest step covering the curve, and the state of charge at the middle of each step."""
+    base = ocv[0]
+    shift = 0
+    while (SOC_LUT_SIZE << shift) < ocv[-1] - base:
+        shift += 1
+    half = (1 << shift) >> 1
+    return base, shift, [soc_from_ocv(ocv, base + (i << shift) + half) for i in range(SOC_LUT_SIZE)]
+
+
+def check(profile):
+    name = profile.get("name", "?")
+
+    def fail(msg):
+        sys.exit("batt_profiles: %s: %s" % (name, msg))
+
+    if not re.match(r"^[a-z][a-z0-9_]*$", name):
+        fail("name must be a lower-case C identifier")
+    ocv = profile["ocv_mv"]
+    if len(ocv) != SOC_OCV_POINTS or any(b <= a for a, b in zip(ocv, ocv[1:])):
+        fail("ocv_mv must be %d increasing voltages" % SOC_OCV_POINTS)
+    for key, (lo, hi) in (("charge_mv", CHARGE_MV), ("charge_ma", CHARGE_MA),
+                          ("precharge_ma", PRECHARGE_MA), ("term_ma", TERM_MA)):
+        if not lo <= profile[key] <= hi:
+            fail("%s must be %d-%d" % (key, lo, hi))
+    if not profile["cutoff_mv"] <= profile["min_mv"] < ocv[-1]:
+        fail("cutoff_mv <= min_mv < full OCV")
+    if not 0 < profile["capacity_mah"] < 0xFFFF:
+        fail("capacity_mah out of range")
+
+
+def generate(profiles):
+    enum_name = lambda p: "BATT_" + p["name"].upper()
+
+    h = [HEADER, "\n#pragma once\n\n"]
+    h.append("/**\n * Battery profiles, in the order of batt_profiles[].\n */\n")
+    h.append("enum batt_profile_id {\n")
+    for p in profiles:
+        h.append("  /** %s */\n  %s,\n" % (p["description"], enum_name(p)))
+    h.append("\n  BATT_PROFILES,\n};\n")
+
+    c = [HEADER, "\n#include \"batt_profile.h\"\n"]
+    for p in profiles:
+        base, shift, table = lut(p["ocv_mv"])
+        c.append("\n// %s: %u mV + (i << %u) mV\n" % (p["description"], base, shift))
+        c.append("static const uint8_t lut_%s[SOC_LUT_SIZE] = {\n" % p["name"])
+        for i in range(0, SOC_LUT_SIZE, 16):
+            c.append("  " + " ".join("%3u," % v for v in table[i:i + 16]) + "\n")
+        c.append("};\n")
+
+    c.append("\nconst struct batt_profile batt_profiles[BATT_PROFILES] = {\n")
+    for p in profiles:
+        base, shift, _ = lut(p["ocv_mv"])
+        c.append("  [%s] = {\n" % enum_name(p))
+        c.append("    .curve = {\n")
+        c.append("      .ocv         = {%s},\n" % ", ".join(str(v) for v in p["ocv_mv"]))
+        c.append("      .lut         = lut_%s,\n" % p["name"])
+        c.append("      .lut_base_mv = %u,\n" % base)
+        c.append("      .lut_shift   = %u,\n" % shift)
+        c.append("    },\n")
+        for field, key in (("charge_mv", "charge_mv"), ("charge_ma", "charge_ma"),
+                           ("precharge_ma", "precharge_ma"), ("term_ma", "term_ma"),
+                           ("min_mv", "min_mv"), ("cutoff_mv", "cutoff_mv"),
+                           ("capacity_mah", "capacity_mah")):
+            c.append("    .%-12s = %u,\n" % (field, p[key]))
+        c.append("  },\n")
+    c.append("};\n")
+
+    return "".join(h), "".join(c)
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, "w") as f:
+        f.write(text)
+    print("batt_profiles: wrote %s" % path)
+
+
+def main(project):
+    with open(os.path.join(project, "batt_profiles.json")) as f:
+        profiles = json.load(f)["profiles"]
+    if not 0 < len(profiles) < 0xFF:
+        sys.exit("batt_profiles: need 1-254 profiles")
+    for p in profiles:
+        check(p)
+
+    header, source = generate(profiles)
+    write_if_changed(os.path.join(project, "include", "batt_profiles.h"), header)
+    write_if_changed(os.path.join(project, "src", "batt_profiles.c"), source)
+
+
+try:
+    # PlatformIO extra script
+    Import("env")  # noqa: F821
+    main(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+        parser.add_argument("--project", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+        main(parser.parse_args().project)
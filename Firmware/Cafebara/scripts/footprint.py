@@ -0,0 +1,28 @@
+# PlatformIO extra script: adds the "footprint" target, which prints flash,
+# RAM and worst-case stack use for the firmware.
+#
+#   pio run -t footprint
+
+Import("env")
+
+import os
+
+# Per-function stack frames, and a link map to attribute sections to libraries
+env.Append(CCFLAGS=["-fstack-usage"])
+env.Append(LINKFLAGS=["-Wl,-Map,${BUILD_DIR}/${PROGNAME}.map"])
+
+board = env.BoardConfig()
+flash = board.get("upload.maximum_size", 16384)
+ram = board.get("upload.maximum_ram_size", 2048)
+report = os.path.join(env.subst("$PROJECT_DIR"), "scripts", "footprint_report.py")
+
+env.AddCustomTarget(
+    name="footprint",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[
+        '"$PYTHONEXE" "%s" --elf "$BUILD_DIR/${PROGNAME}.elf" --map "$BUILD_DIR/${PROGNAME}.map" '
+        '--build-dir "$BUILD_DIR" --flash %d --ram %d' % (report, flash, ram)
+    ],
+    title="Footprint",
+    description="Flash, RAM and stack use per symbol and library",
+)
@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+"""Flash, RAM and stack footprint of the firmware.
+
+Prints:
+  - section totals against the part's flash and RAM
+  - the largest symbols in flash and RAM
+  - flash and RAM per library, from the link map
+  - worst-case stack depth from main() and from each ISR, using the
+    -fstack-usage frame sizes and the call graph from the disassembly
+
+Run by "pio run -t footprint" (see footprint.py), or by hand:
+  footprint_report.py --elf firmware.elf --map firmware.map --build-dir .pio/build/ATtiny1616
+
+Stack depth limitations:
+  - Indirect calls (function pointers: scheduler tasks, console commands,
+    driver callbacks) are assumed to reach any function that is never called
+    directly, which over-estimates rather than misses a path.
+  - Recursion is reported, and only counted once.
+  - Functions without a frame size (libgcc and other assembly) count as 0.
+"""
+
+import argparse
+import collections
+import os
+import re
+import subprocess
+import sys
+
+# Sections by where they live. On avrxmega3 parts such as the ATtiny1616,
+# .rodata stays in flash, which is mapped into the data space.
+FLASH_SECTIONS = (".text", ".vectors", ".init", ".fini", ".progmem", ".trampolines", ".ctors", ".dtors", ".rodata")
+RAM_SECTIONS = (".bss", ".noinit")
+BOTH_SECTIONS = (".data",)  # Initial values in flash, copied to RAM
+
+CALLS = {"call", "rcall", "callq"}
+JUMPS = {"jmp", "rjmp", "jmpq"}
+INDIRECT = {"icall", "eicall", "ijmp", "eijmp"}
+
+
+def run(tool, *args):
+    try:
+        return subprocess.run([tool] + list(args), check=True, capture_output=True, text=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        sys.exit("footprint: %s failed: %s" % (tool, e))
+
+
+def section_kind(name):
+    if name.startswith(BOTH_SECTIONS):
+        return "both"
+    if name.startswith(FLASH_SECTIONS):
+        return "flash"
+    if name.startswith(RAM_SECTIONS):
+        return "ram"
+    return None
+
+
+def section_totals(prefix, elf):
+    flash = ram = 0
+    for line in run(prefix + "size", "-A", elf).splitlines():
+        fields = line.split()
+        if len(fields) < 3 or not fields[1].isdigit():
+            continue
+        kind = section_kind(fields[0])
+        size = int(fields[1])
+        if kind in ("flash", "both"):
+            flash += size
+        if kind in ("ram", "both"):
+            ram += size
+    return flash, ram
+
+
+def symbols(prefix, elf):
+    """Yields (name, size, kind) for every sized symbol."""
+    for line in run(prefix + "nm", "-S", "--size-sort", elf).splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        size, sym_type, name = int(fields[1], 16), fields[2].lower(), fields[3]
+        if sym_type in "twr":
+            yield name, size, "flash"
+        elif sym_type == "d":
+            yield name, size, "both"
+        elif sym_type == "b":
+            yield name, size, "ram"
+
+
+def owner(path, build_dir):
+    """Library an input file belongs to, from its path in the link map."""
+    archive = re.match(r"(.*?)\((.*)\)$", path)
+    if archive:
+        name = os.path.basename(archive.group(1))
+        return re.sub(r"^lib|\.a$", "", name)
+
+    rel = os.path.relpath(path, build_dir) if build_dir else path
+    parts = rel.replace("\\", "/").split("/")
+    if parts[0] == "src":
+        return "src"
+    if parts[0].startswith("lib") and len(parts) > 2:
+        return parts[1]
+    return parts[0] if len(parts) > 1 else os.path.basename(path)
+
+
+def library_totals(map_file, build_dir):
+    """Flash and RAM per library, from the input sections in the link map."""
+    totals = collections.defaultdict(lambda: [0, 0])
+    in_map = False
+    pending = None
+
+    with open(map_file) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("Linker script and memory map"):
+                in_map = True
+                continue
+            if not in_map:
+                continue
+
+            # Long section names put the address, size and file on the next line
+            m = re.match(r"^ (\.\S+)$", line)
+            if m:
+                pending = m.group(1)
+                continue
+
+            m = re.match(r"^ (\.\S+)?\s+0x[0-9a-fA-F]+\s+0x([0-9a-fA-F]+)\s+(\S.*)$", line)
+            section = (m.group(1) or pending) if m else None
+            pending = None
+            if not m or not section:
+                continue
+
+            size = int(m.group(2), 16)
+            kind = section_kind(section)
+            if not size or not kind:
+                continue
+
+            lib = owner(m.group(3).strip(), build_dir)
+            if kind in ("flash", "both"):
+                totals[lib][0] += size
+            if kind in ("ram", "both"):
+                totals[lib][1] += size
+
+    return totals
+
+
+def frame_sizes(build_dir):
+    """Stack frame per function, from the .su files written by -fstack-usage."""
+    frames = {}
+    dynamic = set()
+    for root, _, files in os.walk(build_dir):
+        for name in files:
+            if not name.endswith(".su"):
+                continue
+            with open(os.path.join(root, name)) as f:
+                for line in f:
+                    fields = line.rstrip("\n").split("\t")
+                    if len(fields) < 3:
+                        continue
+                    func = fields[0].rsplit(":", 1)[-1]
+                    frames[func] = max(frames.get(func, 0), int(fields[1]))
+                    if "dynamic" in fields[2]:
+                        dynamic.add(func)
+    return frames, dynamic
+
+
+def call_graph(prefix, elf):
+    """Direct callees, and the functions making indirect calls."""
+    calls = collections.defaultdict(set)
+    indirect = set()
+    func = None
+
+    for line in run(prefix + "objdump", "-d", elf).splitlines():
+        m = re.match(r"^[0-9a-f]+ <([^>]+)>:$", line)
+        if m:
+            func = m.group(1)
+            continue
+
+        m = re.match(r"^\s+[0-9a-f]+:\s+(?:[0-9a-f]{2} )+\s*(\w+)\s*(.*)$", line)
+        if not m or not func:
+            continue
+        op, operands = m.group(1), m.group(2)
+
+        if op in INDIRECT or (op in CALLS and "*" in operands):
+            indirect.add(func)
+            continue
+        if op not in CALLS and op not in JUMPS:
+            continue
+
+        # Calls and jumps into another function, not to a label in this one.
+        # Jumps to another function are tail calls, and a function calling
+        # itself is recursion.
+        target = re.search(r"<([^>+]+)(\+0x[0-9a-f]+)?>", operands)
+        if target and not target.group(2) and (target.group(1) != func or op in CALLS):
+            calls[func].add(target.group(1))
+
+    return calls, indirect
+
+
+class StackAnalysis:
+    def __init__(self, frames, dynamic, calls, indirect):
+        self.frames = frames
+        self.dynamic = dynamic
+        self.calls = calls
+        self.recursive = set()
+        self.memo = {}
+
+        # Anything compiled and never called directly may be reached through a
+        # function pointer
+        called = set().union(*calls.values()) if calls else set()
+        targets = {f for f in frames if f not in called and not is_root(f)}
+        for func in indirect:
+            self.calls[func] = self.calls[func] | targets
+
+    def depth(self, func, stack=()):
+        """Worst-case stack depth below and including func, and its path."""
+        if func in self.memo:
+            return self.memo[func]
+        if func in stack:
+            self.recursive.add(func)
+            return 0, []
+
+        worst, path = 0, []
+        for callee in self.calls.get(func, ()):
+            d, p = self.depth(callee, stack + (func,))
+            if d > worst:
+                worst, path = d, p
+
+        self.memo[func] = (self.frames.get(func, 0) + worst, [func] + path)
+        return self.memo[func]
+
+
+def is_root(func):
+    return func == "main" or func.startswith("__vector_")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--elf", required=True)
+    parser.add_argument("--map", help="linker map, for the per-library totals")
+    parser.add_argument("--build-dir", help="directory searched for .su files")
+    parser.add_argument("--flash", type=int, default=16384, help="flash size (bytes)")
+    parser.add_argument("--ram", type=int, default=2048, help="RAM size (bytes)")
+    parser.add_argument("--top", type=int, default=15, help="largest symbols to list")
+    parser.add_argument("--prefix", default="avr-", help="binutils prefix")
+    args = parser.parse_args()
+
+    flash, ram = section_totals(args.prefix, args.elf)
+    print("Flash %6d / %6d bytes (%5.1f%%)" % (flash, args.flash, 100.0 * flash / args.flash))
+    print("RAM   %6d / %6d bytes (%5.1f%%), %d left for the stack" %
+          (ram, args.ram, 100.0 * ram / args.ram, args.ram - ram))
+
+    syms = list(symbols(args.prefix, args.elf))
+    for kind, title in (("flash", "flash"), ("ram", "RAM")):
+        rows = [(size, name) for name, size, k in syms if k == kind or k == "both"]
+        rows.sort(reverse=True)
+        print("\nLargest symbols in %s:" % title)
+        for size, name in rows[:args.top]:
+            print("  %6d  %s" % (size, name))
+
+    if args.map:
+        print("\n%-20s %7s %7s" % ("Library", "flash", "RAM"))
+        totals = library_totals(args.map, args.build_dir)
+        for lib, (lib_flash, lib_ram) in sorted(totals.items(), key=lambda t: -t[1][0]):
+            print("%-20s %7d %7d" % (lib, lib_flash, lib_ram))
+
+    if not args.build_dir:
+        return 0
+
+    frames, dynamic = frame_sizes(args.build_dir)
+    if not frames:
+        print("\nNo .su files found, build with -fstack-usage for the stack report")
+        return 0
+
+    calls, indirect = call_graph(args.prefix, args.elf)
+    analysis = StackAnalysis(frames, dynamic, calls, indirect)
+
+    roots = sorted(f for f in set(calls) | set(frames) if is_root(f))
+    print("\nWorst-case stack depth (bytes):")
+    depths = {}
+    for root in roots:
+        depth, path = analysis.depth(root)
+        depths[root] = depth
+        print("  %-16s %5d  %s" % (root, depth, " > ".join(path)))
+
+    # Interrupts don't nest, so the worst case is main plus the deepest ISR
+    isr = max((d for r, d in depths.items() if r != "main"), default=0)
+    total = depths.get("main", 0) + isr
+    print("\nmain + deepest ISR: %d bytes, %d left" % (total, args.ram - ram - total))
+
+    unbounded = sorted(f for f in dynamic if f in frames)
+    if unbounded:
+        print("Dynamic stack use (not bounded): %s" % ", ".join(unbounded))
+    if analysis.recursive:
+        print("Recursion (counted once): %s" % ", ".join(sorted(analysis.recursive)))
+    if indirect:
+        print("Indirect calls from: %s" % ", ".join(sorted(indirect)))
+
+    return 1 if total > args.ram - ram else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Update the firmware from the Pi, through the I2C bootloader.
+
+  i2c_update.py .pio/build/ATtiny1616_boot/firmware.hex
+  i2c_update.py --bus 1 firmware.hex
+
+Needs the bootloader (../CafebaraBoot) in the BOOT section, and firmware built
+with the ATtiny1616_boot environment. Running firmware is sent to the
+bootloader through PI_REG_BOOT first. The firmware is marked invalid until the
+whole image has been written and its CRC checked, so after a failed or
+interrupted update the bootloader stays resident and the update can be run
+again. Uses /dev/i2c-N directly, no other packages.
+"""
+
+import argparse
+import fcntl
+import os
+import re
+import sys
+import time
+
+I2C_SLAVE = 0x0703
+PI_I2C_ADDR = 0x20
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+BOOT_PROTO = os.path.join(HERE, "..", "..", "CafebaraBoot", "include", "boot_proto.h")
+PI_REGS = os.path.join(HERE, "..", "include", "pi_regs.h")
+
+DEFINE_RE = re.compile(r"^#define\s+(\w+)\s+(0x[0-9A-Fa-f]+|\d+)\s*(?://.*)?$", re.M)
+
+
+def load_defines(path):
+    with open(path) as f:
+        return {name: int(value, 0) for name, value in DEFINE_RE.findall(f.read())}
+
+
+def read_hex(path):
+    """Image bytes by address, from an Intel HEX file."""
+    data = {}
+    base = 0
+    with open(path) as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.strip()
+            if not line:
+                continue
+            if not line.startswith(":"):
+                sys.exit("i2c_update: %s:%d: not Intel HEX" % (path, lineno))
+            record = bytes.fromhex(line[1:])
+            if sum(record) & 0xFF:
+                sys.exit("i2c_update: %s:%d: bad checksum" % (path, lineno))
+            count, addr, kind = record[0], (record[1] << 8) | record[2], record[3]
+            payload = record[4:4 + count]
+            if kind == 0x00:
+                for i, byte in enumerate(payload):
+                    data[base + addr + i] = byte
+            elif kind == 0x01:
+                break
+            elif kind == 0x02:
+                base = ((payload[0] << 8) | payload[1]) << 4
+            elif kind == 0x04:
+                base = ((payload[0] << 8) | payload[1]) << 16
+    return data
+
+
+def crc_ccitt(data, crc=0xFFFF):
+    """CRC-16/CCITT as avr-libc's _crc_ccitt_update()."""
+    for byte in data:
+        byte ^= crc & 0xFF
+        byte = (byte ^ (byte << 4)) & 0xFF
+        crc = (((byte << 8) | (crc >> 8)) ^ (byte >> 4) ^ (byte << 3)) & 0xFFFF
+    return crc
+
+
+class Target:
+    def __init__(self, bus, addr):
+        self.fd = os.open("/dev/i2c-%d" % bus, os.O_RDWR)
+        fcntl.ioctl(self.fd, I2C_SLAVE, addr)
+
+    def write(self, data, retries=20):
+        # The target NACKs while the CPU is halted for a page write
+        for attempt in range(retries):
+            try:
+                os.write(self.fd, bytes(data))
+                return
+            except OSError:
+                if attempt == retries - 1:
+                    raise
+                time.sleep(0.005)
+
+    def read(self, count, retries=20):
+        for attempt in range(retries):
+            try:
+                return os.read(self.fd, count)
+            except OSError:
+                if attempt == retries - 1:
+                    raise
+                time.sleep(0.005)
+
+
+class Bootloader:
+    def __init__(self, target, proto):
+        self.target = target
+        self.p = proto
+
+    def status(self):
+        self.target.write([self.p["BOOT_CMD_STATUS"]])
+        block = self.target.read(4)
+        return block[0], block[1], block[2], block[3] << 8
+
+    def command(self, name, args, what):
+        self.target.write([self.p[name]] + list(args))
+        boot_id, status, _, _ = self.status()
+        if boot_id != self.p["BOOT_ID"]:
+            sys.exit("i2c_update: %s: bootloader went away" % what)
+        if status != self.p["BOOT_STATUS_OK"]:
+            names = {v: k for k, v in self.p.items() if k.startswith("BOOT_STATUS_")}
+            sys.exit("i2c_update: %s: %s" % (what, names.get(status, status)))
+
+
+def enter_bootloader(target, proto, regs):
+    """Start the bootloader if the firmware is running, and check it answers."""
+    target.write([proto["BOOT_CMD_STATUS"]])
+    if target.read(1)[0] == proto["BOOT_ID"]:
+        return
+
+    target.write([regs["PI_REG_BOOT"], proto["BOOT_KEY"]])
+    for _ in range(20):
+        time.sleep(0.1)  # configTask picks the request up within 50 ms
+        try:
+            target.write([proto["BOOT_CMD_STATUS"]], retries=1)
+            if target.read(1, retries=1)[0] == proto["BOOT_ID"]:
+                return
+        except OSError:
+            pass
+    sys.exit("i2c_update: no bootloader, is the firmware built with the ATtiny1616_boot environment?")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("hex", help="firmware.hex from the ATtiny1616_boot environment")
+    parser.add_argument("--bus", type=int, default=1, help="I2C bus, /dev/i2c-N")
+    parser.add_argument("--addr", type=lambda v: int(v, 0), default=PI_I2C_ADDR)
+    args = parser.parse_args()
+
+    proto = load_defines(BOOT_PROTO)
+    regs = load_defines(PI_REGS)
+    boot_size, page_size = proto["BOOT_SIZE"], proto["BOOT_PAGE_SIZE"]
+
+    data = read_hex(args.hex)
+    if not data:
+        sys.exit("i2c_update: %s is empty" % args.hex)
+    if min(data) < boot_size:
+        sys.exit("i2c_update: image starts at 0x%04x, inside the bootloader (build with ATtiny1616_boot)" % min(data))
+
+    # Whole pages from the start of the firmware, gaps left erased
+    end = -(-(max(data) + 1) // page_size) * page_size
+    image = bytes(data.get(addr, 0xFF) for addr in range(boot_size, end))
+
+    target = Target(args.bus, args.addr)
+    enter_bootloader(target, proto, regs)
+    boot = Bootloader(target, proto)
+    _, _, flash_page, flash_boot = boot.status()
+    if flash_page != page_size or flash_boot != boot_size:
+        sys.exit("i2c_update: bootloader has %d byte pages at 0x%04x, expected %d at 0x%04x" %
+                 (flash_page, flash_boot, page_size, boot_size))
+
+    start = time.monotonic()
+    boot.command("BOOT_CMD_BEGIN", [proto["BOOT_KEY"]], "begin")
+    for offset in range(0, len(image), page_size):
+        addr = boot_size + offset
+        boot.command("BOOT_CMD_PAGE", [addr & 0xFF, addr >> 8] + list(image[offset:offset + page_size]),
+                     "page 0x%04x" % addr)
+        print("\r%d/%d bytes" % (offset + page_size, len(image)), end="", flush=True)
+    print()
+
+    crc = crc_ccitt(image)
+    boot.command("BOOT_CMD_FINISH", [len(image) & 0xFF, len(image) >> 8, crc & 0xFF, crc >> 8], "finish")
+    print("%d bytes written and checked in %.1fs" % (len(image), time.monotonic() - start))
+
+    target.write([proto["BOOT_CMD_RUN"], proto["BOOT_KEY"]])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Decode the tokenised console output back into text.
+
+  tlog_decode.py /dev/ttyUSB0          serial console, lines typed are sent as commands
+  tlog_decode.py capture.bin           a saved capture
+  tlog_decode.py -                     stdin
+  tlog_decode.py /dev/ttyUSB0 --save capture.bin
+                                       also keep the raw stream, eg. a trace
+                                       for sim/replay
+
+The message table comes from include/log_msgs.h, or from the table written
+next to a firmware build with --table .pio/build/ATtiny1616/firmware.tlog.json.
+Plain text in the stream is passed through.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+import threading
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import tlog_table  # noqa: E402
+
+TLOG_SYNC = 0xFE
+HEADER_LEN = 3
+
+# Conversions, and their argument sizes on the AVR (int is 16 bits)
+CONV_RE = re.compile(r"%(?P<flags>[-+ #0]*)(?P<width>\d*)(?:\.(?P<prec>\d+))?"
+                     r"(?:(?P<len>hh|h|l)?(?P<conv>[diuxXc%])|\{(?P<enum>\w+)\})")
+SIZES = {"hh": 1, "h": 2, None: 2, "l": 4}
+FORMATS = {1: "b", 2: "h", 4: "i"}
+
+
+def format_message(fmt, args, enums):
+    """Render a format with its raw little-endian argument bytes."""
+    out = []
+    pos = 0
+    offset = 0
+
+    for m in CONV_RE.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        if m.group("conv") == "%":
+            out.append("%")
+            continue
+
+        spec = "%" + m.group("flags") + m.group("width") + ("." + m.group("prec") if m.group("prec") else "")
+        if m.group("enum"):
+            size, signed = 1, False
+        elif m.group("conv") == "c":
+            size, signed = 1, False
+        else:
+            size, signed = SIZES[m.group("len")], m.group("conv") in "di"
+
+        if offset + size > len(args):
+            raise ValueError("arguments too short")
+        code = FORMATS[size] if signed else FORMATS[size].upper()
+        value = struct.unpack_from("<" + code, args, offset)[0]
+        offset += size
+
+        if m.group("enum"):
+            names = enums.get(m.group("enum"), [])
+            out.append((spec + "s") % (names[value] if value < len(names) else str(value)))
+        elif m.group("conv") == "c":
+            out.append((spec + "c") % chr(value))
+        else:
+            out.append((spec + m.group("conv")) % value)
+
+    if offset != len(args):
+        raise ValueError("%d argument bytes, format uses %d" % (len(args), offset))
+
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+class Decoder:
+    """Splits a byte stream into text lines and decoded log records."""
+
+    def __init__(self, table):
+        self.messages = {m["id"]: m for m in table["messages"]}
+        self.enums = table["enums"]
+        self.buf = bytearray()
+        self.text = bytearray()
+
+    def feed(self, data):
+        self.buf += data
+        lines = []
+
+        while self.buf:
+            if self.buf[0] != TLOG_SYNC:
+                byte = self.buf.pop(0)
+                if byte == ord("\n"):
+                    lines.append(self.text.decode("ascii", "replace").rstrip("\r"))
+                    self.text.clear()
+                else:
+                    self.text.append(byte)
+                continue
+
+            if len(self.buf) < HEADER_LEN:
+                break
+            msg_id, length = self.buf[1], self.buf[2]
+            if len(self.buf) < HEADER_LEN + length:
+                break
+
+            args = bytes(self.buf[HEADER_LEN:HEADER_LEN + length])
+            msg = self.messages.get(msg_id)
+            if msg is None:
+                # Not a record after all, or a table that doesn't match the
+                # firmware: skip the sync byte and resynchronise
+                del self.buf[0]
+                lines.append("<unknown message %d>" % msg_id)
+                continue
+
+            del self.buf[:HEADER_LEN + length]
+            try:
+                lines.append(format_message(msg["format"], args, self.enums))
+            except (ValueError, struct.error) as e:
+                lines.append("<%s: %s: %s>" % (msg["name"], e, args.hex()))
+
+        return lines
+
+
+def open_source(path, baud):
+    if path == "-":
+        return sys.stdin.buffer, None
+    if os.path.isfile(path):
+        return open(path, "rb"), None
+
+    try:
+        import serial
+    except ImportError:
+        sys.exit("tlog_decode: pyserial is needed to read %s" % path)
+    port = serial.Serial(path, baud, timeout=0.1)
+    return port, port
+
+
+def send_commands(port):
+    for line in sys.stdin:
+        port.write(line.rstrip("\r\n").encode("ascii", "replace") + b"\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="serial port, capture file, or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--table", help="table JSON written by the build")
+    parser.add_argument("--save", help="also write the raw stream to this file")
+    parser.add_argument("--project", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+    args = parser.parse_args()
+
+    if args.table:
+        with open(args.table) as f:
+            table = json.load(f)
+    else:
+        table = tlog_table.load(args.project)
+
+    source, port = open_source(args.source, args.baud)
+    if port:
+        threading.Thread(target=send_commands, args=(port,), daemon=True).start()
+
+    decoder = Decoder(table)
+    save = open(args.save, "wb") if args.save else None
+    try:
+        while True:
+            data = source.read(64) if port else source.read1(4096)
+            if not data:
+                if port:
+                    continue
+                break
+            if save:
+                save.write(data)
+                save.flush()
+            for line in decoder.feed(data):
+                print(line, flush=True)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
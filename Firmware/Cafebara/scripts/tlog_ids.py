@@ -0,0 +1,16 @@
+# PlatformIO extra script: writes the log message table for this build next to
+# the firmware, as ${PROGNAME}.tlog.json, for scripts/tlog_decode.py --table.
+
+Import("env")
+
+import os
+
+table = os.path.join(env.subst("$PROJECT_DIR"), "scripts", "tlog_table.py")
+
+env.AddPostAction(
+    "$BUILD_DIR/${PROGNAME}.elf",
+    env.VerboseAction(
+        '"$PYTHONEXE" "%s" --project "$PROJECT_DIR" -o "$BUILD_DIR/${PROGNAME}.tlog.json"' % table,
+        "Writing log message table",
+    ),
+)
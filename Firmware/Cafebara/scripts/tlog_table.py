@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Log message table for the tokenised console output.
+
+Reads the message IDs and formats from include/log_msgs.h, and the enums
+they print by name, and writes them out as JSON for tlog_decode.py:
+
+  tlog_table.py [--project DIR] [-o table.json]
+
+Also run by PlatformIO on every build (see tlog_ids.py), so each firmware
+build has the table it was built with next to it.
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+import sys
+
+MSG_RE = re.compile(r'X\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+ENUM_REF_RE = re.compile(r"%[-0 ]*\d*\{(\w+)\}")
+
+
+def strip_comments(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    return re.sub(r"//[^\n]*", "", text)
+
+
+def parse_messages(path):
+    with open(path) as f:
+        text = f.read()
+    return [{"id": i, "name": name, "format": bytes(fmt, "utf-8").decode("unicode_escape")}
+            for i, (name, fmt) in enumerate(MSG_RE.findall(text))]
+
+
+def parse_enum(text, name):
+    m = re.search(r"enum\s+%s\s*\{(.*?)\}" % re.escape(name), strip_comments(text), flags=re.S)
+    if not m:
+        return None
+
+    values = {}
+    value = 0
+    for item in m.group(1).split(","):
+        item = item.strip()
+        if not item:
+            continue
+        ident, _, expr = item.partition("=")
+        if expr.strip():
+            value = int(expr.strip(), 0)
+        # Drop the first word of the enumerator, eg. BOOT_START prints as start
+        label = ident.strip().split("_", 1)[-1].lower()
+        values[value] = label
+        value += 1
+    return [values.get(i, str(i)) for i in range(max(values) + 1)] if values else []
+
+
+def find_enum(project, name):
+    headers = []
+    for pattern in ("include/*.h", "src/*.h", "lib/*/*.h", "lib/*/include/*.h"):
+        headers += sorted(glob.glob(os.path.join(project, pattern)))
+    for path in headers:
+        with open(path) as f:
+            values = parse_enum(f.read(), name)
+        if values is not None:
+            return values
+    sys.exit("tlog_table: enum %s not found" % name)
+
+
+def load(project):
+    messages = parse_messages(os.path.join(project, "include", "log_msgs.h"))
+    enums = {}
+    for msg in messages:
+        for name in ENUM_REF_RE.findall(msg["format"]):
+            if name not in enums:
+                enums[name] = find_enum(project, name)
+    return {"messages": messages, "enums": enums}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--project", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+    parser.add_argument("-o", "--output", help="JSON file to write, stdout if not given")
+    args = parser.parse_args()
+
+    table = json.dumps(load(args.project), indent=1)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(table + "\n")
+    else:
+        print(table)
+
+
+if __name__ == "__main__":
+    main()
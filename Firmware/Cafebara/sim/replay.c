@@ -0,0 +1,219 @@
+/*
+ * Charger trace replay.
+ *
+ * The firmware logs each decision right after the reads it was made on, and
+ * before acting on it, so the last value recorded for each register is the
+ * one the decision saw. Reading the faults back from the model clears them,
+ * as on the BQ, until the next recorded read of REG0C.
+ */
+
+#include "replay.h"
+
+#include <string.h>
+
+#include "batt_profile.h"
+#include "bq25895/bq25895_regs.h"
+#include "log_msgs.h"
+#include "power_policy.h"
+#include "trace.h"
+
+static char const *const action_names[] = {"none", "fault", "overtemp", "ship", "empty"};
+static char const *const pin_names[]    = {"button", "hpd", "temp_alert", "bq_int"};
+
+static uint16_t get16(uint8_t const *p)
+{
+  return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(uint8_t const *p)
+{
+  return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static char const *action_name(uint8_t action)
+{
+  return action < sizeof(action_names) / sizeof(action_names[0]) ? action_names[action] : "?";
+}
+
+static void led_name(uint8_t led, char *buf)
+{
+  if (led == POWER_LED_KEEP) {
+    strcpy(buf, "-");
+  }
+  else {
+    snprintf(buf, 4, "%u", led);
+  }
+}
+
+static void replay_time(struct replay *r, uint32_t ms)
+{
+  if (r->decisions == 0 && r->edges == 0) {
+    r->first_ms = ms;
+  }
+  r->last_ms = ms;
+}
+
+// Compare a replayed decision with the recorded one, and report it
+static void replay_decision(struct replay *r, char const *what, char const *inputs, uint32_t ms,
+                            uint8_t rec_action, uint8_t rec_led, enum power_action action, uint8_t led)
+{
+  replay_time(r, ms);
+  r->decisions++;
+  if (rec_led != POWER_LED_KEEP) {
+    if (r->led != POWER_LED_KEEP && rec_led != r->led) {
+      r->led_changes++;
+    }
+    r->led = rec_led;
+  }
+
+  bool match = rec_action == action && rec_led == led;
+  if (!match) {
+    r->mismatches++;
+  }
+  if (r->out == NULL || (match && !r->verbose)) {
+    return;
+  }
+
+  char rec_buf[4], led_buf[4];
+  led_name(rec_led, rec_buf);
+  led_name(led, led_buf);
+  if (match) {
+    fprintf(r->out, "%10lu ms %s (%s): %s led %s\n", (unsigned long)ms, what, inputs,
+            action_name(rec_action), rec_buf);
+  }
+  else {
+    fprintf(r->out, "%10lu ms %s (%s): recorded %s led %s, replayed %s led %s\n", (unsigned long)ms, what,
+            inputs, action_name(rec_action), rec_buf, action_name(action), led_buf);
+  }
+}
+
+static void replay_charger(struct replay *r, uint8_t const *args)
+{
+  uint32_t ms   = get32(args);
+  bool powered  = args[4];
+  uint8_t reg0b = r->model.regs[BQ_REG0B];
+  uint8_t reg0c = r->model.regs[BQ_REG0C];
+
+  struct power_charger charger;
+  uint8_t led;
+  power_charger_read(&r->bq, &charger);
+  enum power_action action = power_charger_decide(&charger, powered, &led);
+
+  char inputs[40];
+  snprintf(inputs, sizeof(inputs), "pwr %u, REG0B 0x%02x REG0C 0x%02x", powered, reg0b, reg0c);
+  replay_decision(r, "charger", inputs, ms, args[5], args[6], action, led);
+}
+
+static void replay_battery(struct replay *r, uint8_t const *args)
+{
+  uint32_t ms = get32(args);
+  uint8_t soc = args[4];
+
+  bq25895_batt_volt_t vbat = 0;
+  uint8_t led;
+  bq25895_get_adc_batt(&r->bq, &vbat);
+  enum power_action action = power_battery_decide(soc, vbat, batt_profiles[r->profile].cutoff_mv, &led);
+
+  char inputs[40];
+  snprintf(inputs, sizeof(inputs), "%u/255, %umV", soc, vbat);
+  replay_decision(r, "battery", inputs, ms, args[5], args[6], action, led);
+}
+
+static void replay_edge(struct replay *r, uint8_t const *args)
+{
+  uint32_t ms = get32(args);
+
+  replay_time(r, ms);
+  r->edges++;
+  if (r->out != NULL && r->verbose) {
+    fprintf(r->out, "%10lu ms %s %u\n", (unsigned long)ms,
+            args[4] < sizeof(pin_names) / sizeof(pin_names[0]) ? pin_names[args[4]] : "?", args[5]);
+  }
+}
+
+static void replay_record(struct replay *r, uint8_t id, uint8_t const *args, uint8_t len)
+{
+  static const struct {
+    uint8_t id;
+    uint8_t len;
+  } lengths[] = {
+    {LOG_TRACE_READ, 2}, {LOG_TRACE_GPIO, 6}, {LOG_TRACE_CHARGER, 7}, {LOG_TRACE_BATTERY, 7},
+    {LOG_BATT_PROFILE, 1}, {LOG_DROPPED, 2},
+  };
+
+  r->records++;
+  for (uint8_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    if (lengths[i].id == id && lengths[i].len != len) {
+      r->bad++;
+      return;
+    }
+  }
+
+  switch (id) {
+    case LOG_TRACE_READ:
+      if (args[0] < BQ25895_MODEL_REGS) {
+        r->model.regs[args[0]] = args[1];
+      }
+      r->reads++;
+      break;
+    case LOG_TRACE_GPIO:
+      replay_edge(r, args);
+      break;
+    case LOG_TRACE_CHARGER:
+      replay_charger(r, args);
+      break;
+    case LOG_TRACE_BATTERY:
+      replay_battery(r, args);
+      break;
+    case LOG_BATT_PROFILE:
+      if (args[0] < BATT_PROFILES) {
+        r->profile = args[0];
+      }
+      break;
+    case LOG_DROPPED:
+      r->dropped = get16(args); // Counted since the firmware started
+      break;
+    default:
+      break; // Not part of the trace
+  }
+}
+
+static void replay_byte(struct replay *r, uint8_t byte)
+{
+  if (r->len == 0 && byte != TLOG_SYNC) {
+    return; // Text between the records
+  }
+
+  r->buf[r->len++] = byte;
+  if (r->len == 2 && byte >= LOG_MSG_COUNT) {
+    // Not a record after all: drop the sync byte and look again from the next
+    r->skipped++;
+    r->len = 0;
+    replay_byte(r, byte);
+    return;
+  }
+  if (r->len < TLOG_HEADER_LEN || r->len < TLOG_HEADER_LEN + r->buf[2]) {
+    return;
+  }
+
+  replay_record(r, r->buf[1], &r->buf[TLOG_HEADER_LEN], r->buf[2]);
+  r->len = 0;
+}
+
+void replay_init(struct replay *r, FILE *out, bool verbose)
+{
+  memset(r, 0, sizeof(*r));
+  bq25895_model_init(&r->model);
+  bq25895_model_bind(&r->model, &r->bq);
+  r->profile = BATT_STOCK;
+  r->led     = POWER_LED_KEEP;
+  r->out     = out;
+  r->verbose = verbose;
+}
+
+void replay_feed(struct replay *r, uint8_t const *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++) {
+    replay_byte(r, data[i]);
+  }
+}
@@ -0,0 +1,86 @@
+/**
+ * Charger trace replay.
+ *
+ * Runs a capture recorded with the console's "trace on" (see trace.h) through
+ * the host build of the firmware's power decisions. The recorded BQ reads are
+ * loaded into the register model, each decision is made again from them by
+ * the same code the firmware runs, and compared with the one recorded. There
+ * is no waiting between records, so hours of trace replay in well under a
+ * second.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bq25895.h"
+#include "bq25895_model.h"
+#include "tlog.h"
+
+/**
+ * Replay state.
+ */
+struct replay {
+  /** Register model holding the last value read of each register, and its handle */
+  bq25895_model_t model;
+  bq25895_t bq;
+
+  /** Cells fitted, from LOG_BATT_PROFILE */
+  uint8_t profile;
+
+  /** LED mode last recorded, POWER_LED_KEEP before the first */
+  uint8_t led;
+
+  /** Mismatches are written here, and with verbose every decision and pin edge */
+  FILE *out;
+  bool verbose;
+
+  /** Records parsed, by kind */
+  uint32_t records;
+  uint32_t reads;
+  uint32_t edges;
+  uint32_t decisions;
+
+  /** Decisions replayed differently from the recording */
+  uint32_t mismatches;
+
+  /** Recorded LED mode changes, flapping shows up here */
+  uint32_t led_changes;
+
+  /** Sync bytes that didn't start a known record, and records of the wrong length */
+  uint32_t skipped;
+  uint32_t bad;
+
+  /** Records the firmware reported dropped, the trace has gaps if not 0 */
+  uint16_t dropped;
+
+  /** Time of the first and last decision or edge, in ms */
+  uint32_t first_ms;
+  uint32_t last_ms;
+
+  /** Record being parsed */
+  uint8_t buf[TLOG_HEADER_LEN + 255];
+  uint16_t len;
+};
+
+/**
+ * Start a replay.
+ *
+ * @param r       Replay state
+ * @param out     Where to report, NULL for nowhere
+ * @param verbose Report every decision and pin edge, not only mismatches
+ */
+void replay_init(struct replay *r, FILE *out, bool verbose);
+
+/**
+ * Replay part of a capture. Text between the records is skipped, and records
+ * may be split across calls.
+ *
+ * @param r    Replay state
+ * @param data Raw console output
+ * @param len  Its length
+ */
+void replay_feed(struct replay *r, uint8_t const *data, size_t len);
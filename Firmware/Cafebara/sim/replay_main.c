@@ -0,0 +1,59 @@
+/*
+ * Replay a charger trace, see replay.h.
+ *
+ *   replay capture.bin       report the mismatches
+ *   replay -v capture.bin    every decision and pin edge too
+ *
+ * Exits with 1 if any decision replays differently from the recording.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "replay.h"
+
+int main(int argc, char **argv)
+{
+  bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+  if (argc != 2 + verbose) {
+    fprintf(stderr, "usage: %s [-v] capture.bin\n", argv[0]);
+    return 2;
+  }
+
+  char const *path = argv[1 + verbose];
+  FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return 2;
+  }
+
+  static struct replay r;
+  replay_init(&r, stdout, verbose);
+
+  clock_t start = clock();
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    replay_feed(&r, buf, n);
+  }
+  double took = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  uint32_t span = r.last_ms - r.first_ms;
+  printf("%lu decisions over %lu.%03lus of trace in %.3fs: %lu mismatched, %lu LED changes\n",
+         (unsigned long)r.decisions, (unsigned long)(span / 1000), (unsigned long)(span % 1000), took,
+         (unsigned long)r.mismatches, (unsigned long)r.led_changes);
+  printf("%lu records, %lu reads, %lu pin edges, %lu bad, %lu bytes skipped\n", (unsigned long)r.records,
+         (unsigned long)r.reads, (unsigned long)r.edges, (unsigned long)r.bad, (unsigned long)r.skipped);
+  if (r.dropped) {
+    printf("firmware dropped %u records, decisions may have missed reads\n", r.dropped);
+  }
+  if (r.decisions == 0) {
+    printf("no decisions, was the trace started with \"trace on\"?\n");
+  }
+
+  if (f != stdin) {
+    fclose(f);
+  }
+  return r.mismatches ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+// Battery health tests: updates at the monitor task's rate, with sleeps
+// reported as loop() does after waking
+
+#include "batt_health.h"
+#include "check.h"
+
+#include <stdio.h>
+
+#define CHARGE_MV 4200
+#define RATED_MAH 3000
+
+static struct batt_health h;
+static uint32_t now;
+
+// Awake for the given time, updating once a second
+static void run(uint32_t ms, int16_t current_ma, uint16_t vbat_mv, int8_t temp_c)
+{
+  for (uint32_t t = 0; t < ms; t += 1000) {
+    now += 1000;
+    batt_health_update(&h, current_ma, vbat_mv, temp_c, CHARGE_MV, RATED_MAH, now);
+  }
+}
+
+// Asleep, with the millisecond clock stopped, then the first update after waking
+static void sleep_for(uint32_t ms, uint16_t vbat_mv, int8_t temp_c)
+{
+  batt_health_slept(&h, ms);
+  now += 1;
+  batt_health_update(&h, 0, vbat_mv, temp_c, CHARGE_MV, RATED_MAH, now);
+}
+
+static void setup(void)
+{
+  now = 1000;
+  batt_health_init(&h, NULL, now);
+}
+
+// A full pack left asleep in the heat is ageing all the while
+static void test_sleep_ages(void)
+{
+  setup();
+  for (uint8_t i = 0; i < 6; i++) {
+    sleep_for(30 * 60000UL, CHARGE_MV - 20, 50);
+    run(5000, 0, CHARGE_MV - 20, 50);
+  }
+  CHECK_EQ(h.data.high_volt_h, 3);
+  CHECK_EQ(h.data.hot_h, 3);
+  CHECK(h.changed);
+
+  // Not at high voltage, nor hot: only the peak temperature is kept
+  setup();
+  sleep_for(10 * 3600000UL, CHARGE_MV - 500, 25);
+  CHECK_EQ(h.data.high_volt_h, 0);
+  CHECK_EQ(h.data.hot_h, 0);
+  CHECK_EQ(h.data.max_temp_c, 25);
+
+  // Sleep doesn't count towards cycles: the current before it isn't known
+  setup();
+  batt_health_slept(&h, 3600000UL);
+  now += 1000;
+  batt_health_update(&h, 1000, 3800, 25, CHARGE_MV, RATED_MAH, now);
+  CHECK_EQ(h.data.cycles_x10, 0);
+}
+
+// Cycles are one rated capacity put in, as measured, however much is taken out
+static void test_cycles(void)
+{
+  setup();
+  run(3600000UL, 1500, 3900, 25);
+  CHECK_EQ(h.data.cycles_x10, 5);
+  run(3600000UL, -3000, 3700, 25);
+  CHECK_EQ(h.data.cycles_x10, 5);
+  run(3600000UL, 1500, 3900, 25);
+  CHECK_EQ(h.data.cycles_x10, 10);
+}
+
+static void test_capacity(void)
+{
+  // From the cut-off to full, in one charge: 2400mAh in
+  setup();
+  batt_health_empty(&h);
+  run(3600000UL, 2000, 3900, 25);
+  run(1440000UL, 1000, 4100, 25);
+  sleep_for(60000, 4100, 25); // Resting in between still counts as one charge
+  CHECK(batt_health_full(&h, RATED_MAH));
+  CHECK_EQ(h.data.capacity_mah, 2400);
+  CHECK_EQ(h.data.measurements, 1);
+  CHECK_EQ(batt_health_soh(&h, RATED_MAH), 80);
+  CHECK(!batt_health_full(&h, RATED_MAH)); // Still terminated on the next update
+
+  // Discharged part of the way: no measurement
+  batt_health_empty(&h);
+  run(1800000UL, 2000, 3900, 25);
+  run(60000, -500, 3800, 25);
+  run(1800000UL, 2000, 3900, 25);
+  CHECK(!batt_health_full(&h, RATED_MAH));
+  CHECK_EQ(h.data.measurements, 1);
+
+  // Topped up from part way, not from the cut-off
+  run(1800000UL, 1000, 3900, 25);
+  CHECK(!batt_health_full(&h, RATED_MAH));
+
+  // A second measurement is averaged in
+  batt_health_empty(&h);
+  run(3600000UL, 2000, 3900, 25);
+  CHECK(batt_health_full(&h, RATED_MAH));
+  CHECK_EQ(h.data.capacity_mah, 2300);
+  CHECK_EQ(h.data.measurements, 2);
+}
+
+int main(void)
+{
+  test_sleep_ages();
+  test_cycles();
+  test_capacity();
+
+  return check_done();
+}
@@ -0,0 +1,94 @@
+// Pack temperature tests: TS readings go through the driver, from the register
+// model, as the firmware reads them
+
+#include "charge_profile.h"
+#include "check.h"
+
+#include <stdio.h>
+
+#include "bq25895/bq25895_regs.h"
+#include "bq25895_model.h"
+
+static bq25895_model_t model;
+static bq25895_t dev;
+
+// Convert a raw TS code, as getPackTemp() does
+static bool ts_code_to_celsius(uint8_t code, int8_t *temp_c)
+{
+  bq25895_ts_pct_t pct;
+  model.regs[BQ_REG10] = code;
+  return bq25895_get_adc_ts(&dev, &pct) && charge_profile_ts_to_celsius(pct, temp_c);
+}
+
+static void test_ts_range(void)
+{
+  int8_t temp = 0;
+
+  // Open or missing NTC: TS sits at REGN, the ADC reads its ceiling
+  CHECK(!ts_code_to_celsius(BQ_TSPCT_VAL_MSK, &temp));
+
+  // One code below is a real, very cold reading
+  CHECK(ts_code_to_celsius(BQ_TSPCT_VAL_MSK - 1, &temp));
+  CHECK(temp >= -20 && temp <= -10);
+
+  // Shorted NTC, below the hot end of the curve
+  CHECK(!ts_code_to_celsius(0, &temp));
+
+  // Room temperature, 20C is 62.4% of REGN
+  CHECK(charge_profile_ts_to_celsius(624, &temp));
+  CHECK_EQ(temp, 20);
+}
+
+// Every code either converts to a temperature that falls as TS rises, or is rejected
+static void test_ts_monotonic(void)
+{
+  int8_t last = 127;
+  uint8_t converted = 0;
+
+  for (uint8_t code = 0; code <= BQ_TSPCT_VAL_MSK; code++) {
+    int8_t temp;
+    if (ts_code_to_celsius(code, &temp)) {
+      CHECK(temp <= last);
+      last = temp;
+      converted++;
+    }
+  }
+  CHECK(converted > 0);
+}
+
+// New configured limits, from the Pi, are derated for the band already selected
+static void test_set_max(void)
+{
+  struct charge_profile prof;
+  bq25895_vchg_max_t vreg = 0;
+
+  charge_profile_init(&prof, 2048, 4208);
+  CHECK(charge_profile_set_max(&prof, &dev, 3072, 4208));
+  CHECK_EQ(prof.ichg_ma, 3072); // No band until the first update
+
+  CHECK(charge_profile_update(&prof, &dev, 5));
+  CHECK_EQ(prof.ichg_ma, 768);
+  CHECK(charge_profile_set_max(&prof, &dev, 4096, 4208));
+  CHECK_EQ(prof.ichg_ma, 1024);
+  CHECK_EQ(prof.vreg_mv, 4208);
+  CHECK(!charge_profile_update(&prof, &dev, 5));
+
+  CHECK(charge_profile_update(&prof, &dev, 49));
+  CHECK(charge_profile_set_max(&prof, &dev, 3072, 4208));
+  CHECK_EQ(prof.ichg_ma, 1536);
+  CHECK_EQ(prof.vreg_mv, 4096);
+  CHECK(bq25895_get_max_charge_voltage(&dev, &vreg));
+  CHECK_EQ(vreg, 4096);
+}
+
+int main(void)
+{
+  bq25895_model_init(&model);
+  bq25895_model_bind(&model, &dev);
+
+  test_ts_range();
+  test_ts_monotonic();
+  test_set_max();
+
+  return check_done();
+}
@@ -0,0 +1,196 @@
+// Replay tests: traces are recorded with the firmware's log encoder, the same
+// records in the same order as main.c, and replayed
+
+#include "replay.h"
+#include "check.h"
+
+#include <stdio.h>
+
+#include "batt_profile.h"
+#include "bq25895/bq25895_regs.h"
+#include "log_msgs.h"
+#include "power_policy.h"
+#include "trace.h"
+
+// The console output, as saved by tlog_decode.py --save
+static uint8_t capture[1 << 16];
+static size_t capture_len;
+
+static struct replay r;
+
+static void capture_kick(void)
+{
+  uint8_t byte;
+  while (tlog_pop(&byte)) {
+    if (capture_len < sizeof(capture)) {
+      capture[capture_len++] = byte;
+    }
+  }
+}
+
+static void setup(void)
+{
+  tlog_init(capture_kick);
+  capture_len = 0;
+  replay_init(&r, NULL, false);
+}
+
+static void replay_capture(void)
+{
+  replay_feed(&r, capture, capture_len);
+  capture_len = 0;
+}
+
+static void trace_read(uint8_t reg, uint8_t value)
+{
+  TLOG(LOG_TRACE_READ, reg, value);
+}
+
+// chargingStatus(): REG0B twice, REG0C, then the decision
+static void trace_charger(uint32_t ms, bool powered, bq25895_charge_state_t state, uint8_t faults,
+                          enum power_action action, uint8_t led)
+{
+  uint8_t reg0b = BQ_PG_STAT_MSK | (uint8_t)(state << BQ_CHRG_STAT_POS);
+  trace_read(BQ_REG0B, reg0b);
+  trace_read(BQ_REG0B, reg0b);
+  trace_read(BQ_REG0C, faults);
+  TLOG(LOG_TRACE_CHARGER, ms, (uint8_t)powered, (uint8_t)action, led);
+}
+
+// monitorBatt(), running from the pack: the ADC block, then the decision
+static void trace_battery(uint32_t ms, uint16_t vbat_mv, uint8_t soc, enum power_action action, uint8_t led)
+{
+  trace_read(BQ_REG0E, (uint8_t)((vbat_mv - BQ_ADC_VAL_OFFSET) / BQ_ADC_VAL_INCR));
+  for (uint8_t reg = BQ_REG0F; reg <= BQ_REG12; reg++) {
+    trace_read(reg, 0);
+  }
+  TLOG(LOG_TRACE_BATTERY, ms, soc, (uint8_t)action, led);
+}
+
+static void test_charger_faults(void)
+{
+  setup();
+  trace_charger(1000, true, BQ_STATE_FAST_CHARGE, BQ_FAULT_BAT, POWER_SHIP, POWER_LED_KEEP);
+  trace_charger(2000, true, BQ_STATE_FAST_CHARGE, BQ_FAULT_THERM & 0x05, POWER_OVERTEMP, POWER_LED_KEEP);
+  trace_charger(3000, true, BQ_STATE_FAST_CHARGE, 0x10, POWER_FAULT, 6);      // Input fault, still charging
+  trace_charger(4000, true, BQ_STATE_NOT_CHARGING, BQ_FAULT_WATCHDOG, POWER_FAULT, 0);
+  trace_charger(5000, false, BQ_STATE_TERMINATED, BQ_FAULT_NONE, POWER_NONE, 7);
+  trace_charger(6000, true, BQ_STATE_NOT_CHARGING, BQ_FAULT_NONE, POWER_NONE, POWER_LED_KEEP);
+  replay_capture();
+
+  CHECK_EQ(r.decisions, 6);
+  CHECK_EQ(r.mismatches, 0);
+  CHECK_EQ(r.reads, 18);
+  CHECK_EQ(r.first_ms, 1000);
+  CHECK_EQ(r.last_ms, 6000);
+  CHECK_EQ(r.bad, 0);
+}
+
+static void test_mismatch(void)
+{
+  setup();
+  // Recorded by a firmware that carried on through a battery over-voltage
+  trace_charger(1000, true, BQ_STATE_FAST_CHARGE, BQ_FAULT_BAT, POWER_NONE, 6);
+  trace_charger(2000, true, BQ_STATE_FAST_CHARGE, BQ_FAULT_NONE, POWER_NONE, 6);
+  replay_capture();
+
+  CHECK_EQ(r.decisions, 2);
+  CHECK_EQ(r.mismatches, 1);
+
+  // The fault was cleared by reading it, not by the next record
+  setup();
+  trace_charger(1000, false, BQ_STATE_NOT_CHARGING, BQ_FAULT_BAT, POWER_SHIP, POWER_LED_KEEP);
+  TLOG(LOG_TRACE_CHARGER, (uint32_t)2000, (uint8_t)0, (uint8_t)POWER_NONE, (uint8_t)0);
+  replay_capture();
+
+  CHECK_EQ(r.mismatches, 0);
+}
+
+static void test_battery(void)
+{
+  setup();
+  // LED flapping across the medium/low boundary
+  for (uint8_t i = 0; i < 10; i++) {
+    uint8_t soc = (i & 1) ? 0x40 : 0x41;
+    trace_battery(1000 * i, 3700, soc, POWER_NONE, (i & 1) ? 3 : 2);
+  }
+  trace_battery(10000, 3700, 0, POWER_EMPTY, POWER_LED_ERROR);
+  replay_capture();
+
+  CHECK_EQ(r.decisions, 11);
+  CHECK_EQ(r.mismatches, 0);
+  CHECK_EQ(r.led_changes, 10);
+
+  // The cut-off comes from the profile the trace started with
+  setup();
+  trace_battery(1000, 2800, 0x80, POWER_NONE, 2);
+  TLOG(LOG_BATT_PROFILE, (uint8_t)BATT_NMC);
+  trace_battery(2000, 2800, 0x80, POWER_EMPTY, POWER_LED_ERROR);
+  replay_capture();
+
+  CHECK_EQ(r.profile, BATT_NMC);
+  CHECK(batt_profiles[BATT_STOCK].cutoff_mv < 2800 && batt_profiles[BATT_NMC].cutoff_mv > 2800);
+  CHECK_EQ(r.mismatches, 0);
+}
+
+static void test_stream(void)
+{
+  static const uint8_t text[]  = "status: batt 3700mV\r\n";
+  static const uint8_t noise[] = {TLOG_SYNC, 0xF0, TLOG_SYNC, LOG_TRACE_CHARGER, 1, 0};
+
+  setup();
+  replay_feed(&r, text, sizeof(text) - 1);
+  replay_feed(&r, noise, sizeof(noise));
+  trace_charger(1000, true, BQ_STATE_PRECHARGE, BQ_FAULT_NONE, POWER_NONE, 6);
+  trace_battery(2000, 3500, 0x10, POWER_NONE, 4);
+  TLOG(LOG_TRACE_GPIO, (uint32_t)2500, (uint8_t)TRACE_BUTTON, (uint8_t)0);
+  TLOG(LOG_DROPPED, (uint16_t)3);
+
+  // Split anywhere, one byte at a time
+  for (size_t i = 0; i < capture_len; i++) {
+    replay_feed(&r, &capture[i], 1);
+  }
+
+  CHECK_EQ(r.skipped, 1);
+  CHECK_EQ(r.bad, 1);
+  CHECK_EQ(r.decisions, 2);
+  CHECK_EQ(r.mismatches, 0);
+  CHECK_EQ(r.edges, 1);
+  CHECK_EQ(r.last_ms, 2500);
+  CHECK_EQ(r.dropped, 3);
+}
+
+// Ten hours at the monitor task's rate, replayed an hour of capture at a time
+static void test_long_trace(void)
+{
+  uint32_t hours = 10;
+
+  setup();
+  for (uint32_t s = 0; s < hours * 3600; s++) {
+    uint8_t soc = 255 - (uint8_t)(s * 255 / (hours * 3600));
+    uint8_t led;
+    power_battery_decide(soc, 3700, batt_profiles[BATT_STOCK].cutoff_mv, &led);
+    trace_charger(s * 1000, true, BQ_STATE_NOT_CHARGING, BQ_FAULT_NONE, POWER_NONE, POWER_LED_KEEP);
+    trace_battery(s * 1000 + 5, 3700, soc, POWER_NONE, led);
+    if (capture_len > sizeof(capture) - 64) {
+      replay_capture();
+    }
+  }
+  replay_capture();
+
+  CHECK_EQ(r.decisions, hours * 3600 * 2);
+  CHECK_EQ(r.mismatches, 0);
+  CHECK_EQ(r.led_changes, 3);
+  CHECK_EQ(r.last_ms - r.first_ms, (hours * 3600 - 1) * 1000 + 5);
+}
+
+int main(void)
+{
+  test_charger_faults();
+  test_mismatch();
+  test_battery();
+  test_stream();
+  test_long_trace();
+
+  return check_done();
+}
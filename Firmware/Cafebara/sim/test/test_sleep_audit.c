@@ -0,0 +1,133 @@
+// Sleep audit tests: the pin and peripheral state main.c leaves going into
+// standby, modelled from setup() and the sleepDrivers[] suspend hooks, checked
+// the same way sleepAudit() checks the real registers
+
+#include "sleep_audit.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PIN(n) (1 << (n))
+
+// Held from outside, or not bonded out, as SLEEP_HELD_* in main.h
+#define HELD_A PIN(0)                               // UPDI
+#define HELD_B (PIN(0) | PIN(1) | PIN(6) | PIN(7))  // I2C, pulled up on the board
+#define HELD_C 0xF0
+
+#define PORT_A 0
+#define PORT_B 1
+#define PORT_C 2
+
+// Pins, as main.h
+#define PA_TX         1 // Shared with the LED data line
+#define PA_BUTTON     2
+#define PB_FAN        2
+#define PB_UNUSED     3
+#define PB_HPD        4
+#define PB_TEMP_ALERT 5
+#define PC_BQ_INT     0
+#define PC_PWR_EN     3
+
+// Everything after pm_suspend(), with the console off
+static void model_suspended(struct sleep_snapshot *snap)
+{
+  memset(snap, 0, sizeof(*snap));
+
+  // PORTA: UPDI; TX left an input pulled up by console_suspend(); BUTTON (RX)
+  // pulled up with its falling-edge interrupt; PA3-7 unused, buffers off
+  struct sleep_port *a = &snap->port[PORT_A];
+  a->input    = (uint8_t)~0;
+  a->buffered = PIN(0) | PIN(PA_TX) | PIN(PA_BUTTON);
+  a->pullup   = PIN(PA_TX) | PIN(PA_BUTTON);
+  a->held     = HELD_A;
+
+  // PORTB: I2C pins left to the target; fan pin driven low by fanSuspend();
+  // PB3 unused; HPD buffer off by hpdSuspend(); TEMP_ALERT pulled up
+  struct sleep_port *b = &snap->port[PORT_B];
+  b->input    = (uint8_t)~PIN(PB_FAN);
+  b->buffered = PIN(0) | PIN(1) | PIN(PB_FAN) | PIN(PB_TEMP_ALERT) | PIN(6) | PIN(7);
+  b->pullup   = PIN(PB_TEMP_ALERT);
+  b->held     = HELD_B;
+
+  // PORTC: BQ_INT pulled up; PC1-2 unused; PWR_EN driven low
+  struct sleep_port *c = &snap->port[PORT_C];
+  c->input    = (uint8_t)~PIN(PC_PWR_EN);
+  c->buffered = PIN(PC_BQ_INT) | PIN(PC_PWR_EN) | 0xF0;
+  c->pullup   = PIN(PC_BQ_INT);
+  c->held     = HELD_C;
+
+  // Fan timer output released, transmitter, I2C controller and ADC stopped
+  snap->periphs = 0;
+}
+
+static void test_clean(void)
+{
+  struct sleep_snapshot snap;
+  struct sleep_leaks leaks;
+
+  model_suspended(&snap);
+  CHECK(!sleep_audit(&snap, &leaks));
+  CHECK_EQ(leaks.floating[PORT_A], 0);
+  CHECK_EQ(leaks.floating[PORT_B], 0);
+  CHECK_EQ(leaks.floating[PORT_C], 0);
+  CHECK_EQ(leaks.periphs, 0);
+
+  // Console on: hpdSuspend() leaves HPD alone, MelonHD drives it
+  model_suspended(&snap);
+  snap.port[PORT_B].buffered |= PIN(PB_HPD);
+  snap.port[PORT_B].held |= PIN(PB_HPD);
+  CHECK(!sleep_audit(&snap, &leaks));
+}
+
+static void test_floating(void)
+{
+  struct sleep_snapshot snap;
+  struct sleep_leaks leaks;
+
+  // HPD buffered while MelonHD is unpowered
+  model_suspended(&snap);
+  snap.port[PORT_B].buffered |= PIN(PB_HPD);
+  CHECK(sleep_audit(&snap, &leaks));
+  CHECK_EQ(leaks.floating[PORT_B], PIN(PB_HPD));
+  CHECK_EQ(leaks.periphs, 0);
+
+  // TX released to an input without the pull-up
+  model_suspended(&snap);
+  snap.port[PORT_A].pullup &= ~PIN(PA_TX);
+  CHECK(sleep_audit(&snap, &leaks));
+  CHECK_EQ(leaks.floating[PORT_A], PIN(PA_TX));
+
+  // An unused pin left with its buffer on, as PB3 was
+  model_suspended(&snap);
+  snap.port[PORT_B].buffered |= PIN(PB_UNUSED);
+  CHECK(sleep_audit(&snap, &leaks));
+  CHECK_EQ(leaks.floating[PORT_B], PIN(PB_UNUSED));
+}
+
+static void test_periphs(void)
+{
+  struct sleep_snapshot snap;
+  struct sleep_leaks leaks;
+
+  // Fan stopped mid-cycle with WO2 still on the pin, and the I2C controller left on
+  model_suspended(&snap);
+  snap.periphs = (1 << SLEEP_FAN_PWM) | (1 << SLEEP_TWI_MASTER);
+  CHECK(sleep_audit(&snap, &leaks));
+  CHECK_EQ(leaks.periphs, (1 << SLEEP_FAN_PWM) | (1 << SLEEP_TWI_MASTER));
+  CHECK_EQ(leaks.floating[PORT_A] | leaks.floating[PORT_B] | leaks.floating[PORT_C], 0);
+
+  // Bits past the known peripherals are ignored
+  model_suspended(&snap);
+  snap.periphs = 1 << SLEEP_PERIPHS;
+  CHECK(!sleep_audit(&snap, &leaks));
+}
+
+int main(void)
+{
+  test_clean();
+  test_floating();
+  test_periphs();
+
+  return check_done();
+}
@@ -0,0 +1,65 @@
+// State of charge tests: the discharge current estimate, and rests the
+// estimator only learns about on waking, as battChargeStatus() reports them
+
+#include "soc.h"
+#include "check.h"
+
+#include <stdio.h>
+
+#include "batt_profile.h"
+
+#define FULL_MV 4204 // Top of the stock curve
+
+static const struct batt_profile *profile = &batt_profiles[BATT_STOCK];
+static struct soc_est est;
+static uint32_t now;
+
+static void setup(uint8_t soc)
+{
+  now = 1000;
+  soc_init(&est, &profile->curve, profile->capacity_mah, soc, now);
+}
+
+// A sag past what the resistance can explain saturates, rather than wrapping
+// round to a charge current
+static void test_current_clamp(void)
+{
+  setup(SOC_FULL);
+  now += 1000;
+  soc_update(&est, 2700, 0, true, 30, now);
+  CHECK_EQ(est.current_ma, INT16_MIN);
+  CHECK(est.soc < SOC_FULL);
+}
+
+static void test_rested(void)
+{
+  CHECK_EQ(soc_from_ocv(&profile->curve, FULL_MV), SOC_FULL);
+
+  // A short nap doesn't let the pack relax, the voltage isn't trusted yet
+  setup(128);
+  now += 1000;
+  soc_rested(&est, FULL_MV, 60000, now);
+  CHECK_EQ(est.soc, 128);
+  CHECK_EQ(est.rest_ms, 60000);
+
+  // Naps adding up to the rest time correct as an observed rest does
+  setup(128);
+  soc_rested(&est, FULL_MV, SOC_REST_MS / 2, now);
+  CHECK_EQ(est.soc, 128);
+  soc_rested(&est, FULL_MV, SOC_REST_MS / 2, now);
+  CHECK_EQ(est.soc, 143);
+
+  // A long sleep moves half way to the voltage
+  setup(128);
+  soc_rested(&est, FULL_MV, SOC_REST_MS, now);
+  CHECK_EQ(est.soc, 191);
+  CHECK_EQ(est.rest_ms, SOC_REST_MS);
+}
+
+int main(void)
+{
+  test_current_clamp();
+  test_rested();
+
+  return check_done();
+}
@@ -0,0 +1,155 @@
+/*
+ * Battery health tracking.
+ *
+ * Cycles are counted on the charge side only, so a cycle is one rated
+ * capacity's worth of charge put into the pack, as measured by the charger.
+ * Sleeps, reported by batt_health_slept(), count towards the hours at high
+ * voltage and temperature on the first update after waking, at the conditions
+ * measured then: a pack left full is ageing all the while.
+ */
+
+#include "batt_health.h"
+
+#include <stddef.h>
+
+#define MS_PER_HOUR 3600000UL
+
+// Longest gap charge is counted over, as the current before it isn't known
+#define BATT_HEALTH_MAX_DT_MS 10000
+
+// Capacity measurements are averaged, each new one with this weight (1/4)
+#define BATT_HEALTH_CAP_SHIFT 2
+
+// Count whole hours from a millisecond accumulator into a saturating counter
+static bool batt_health_hours(uint32_t *ms, uint16_t *hours, uint32_t dt)
+{
+  *ms += dt;
+  if (*ms < MS_PER_HOUR) {
+    return false;
+  }
+  uint32_t h = *ms / MS_PER_HOUR;
+  *ms -= h * MS_PER_HOUR;
+  *hours = (*hours + h > 0xFFFF) ? 0xFFFF : *hours + h;
+  return true;
+}
+
+void batt_health_init(struct batt_health *h, struct batt_health_data const *saved, uint32_t now_ms)
+{
+  if (saved != NULL && saved->cycles_x10 != 0xFFFF) {
+    h->data = *saved;
+  } else {
+    h->data.cycles_x10   = 0;
+    h->data.high_volt_h  = 0;
+    h->data.hot_h        = 0;
+    h->data.capacity_mah = 0;
+    h->data.measurements = 0;
+    h->data.max_temp_c   = BATT_HEALTH_TEMP_UNKNOWN;
+  }
+  h->changed        = false;
+  h->cycle_mas      = 0;
+  h->residue        = 0;
+  h->high_volt_ms   = 0;
+  h->hot_ms         = 0;
+  h->from_empty_mas = 0;
+  h->from_empty     = false;
+  h->last_ms        = now_ms;
+  h->slept_ms       = 0;
+}
+
+void batt_health_update(struct batt_health *h, int16_t current_ma, uint16_t vbat_mv, int8_t temp_c,
+                        uint16_t charge_mv, uint16_t rated_mah, uint32_t now_ms)
+{
+  uint32_t dt = now_ms - h->last_ms;
+  uint32_t aged = dt + h->slept_ms;
+  h->last_ms  = now_ms;
+  h->slept_ms = 0;
+
+  if (vbat_mv + BATT_HEALTH_HIGH_MARGIN_MV >= charge_mv) {
+    h->changed |= batt_health_hours(&h->high_volt_ms, &h->data.high_volt_h, aged);
+  }
+  if (temp_c != BATT_HEALTH_TEMP_UNKNOWN) {
+    if (temp_c >= BATT_HEALTH_HOT_C) {
+      h->changed |= batt_health_hours(&h->hot_ms, &h->data.hot_h, aged);
+    }
+    if (temp_c > h->data.max_temp_c) {
+      h->data.max_temp_c = temp_c;
+      h->changed = true;
+    }
+  }
+
+  if (current_ma <= 0) {
+    if (current_ma < 0) {
+      h->from_empty = false; // Discharged part of the way, no longer a full charge
+    }
+    return;
+  }
+  if (dt > BATT_HEALTH_MAX_DT_MS) {
+    dt = BATT_HEALTH_MAX_DT_MS;
+  }
+
+  // Charge, carrying the sub-mAs remainder between updates
+  uint32_t acc = h->residue + (uint32_t)current_ma * dt;
+  uint32_t mas = acc / 1000;
+  h->residue = acc - mas * 1000;
+  h->from_empty_mas += mas;
+
+  uint32_t tenth_mas = (uint32_t)rated_mah * 360;
+  h->cycle_mas += mas;
+  if (tenth_mas > 0 && h->cycle_mas >= tenth_mas) {
+    uint32_t tenths = h->cycle_mas / tenth_mas;
+    h->cycle_mas -= tenths * tenth_mas;
+    h->data.cycles_x10 = (h->data.cycles_x10 + tenths >= 0xFFFF) ? 0xFFFE : h->data.cycles_x10 + tenths;
+    h->changed = true;
+  }
+}
+
+void batt_health_slept(struct batt_health *h, uint32_t slept_ms)
+{
+  h->slept_ms += slept_ms;
+}
+
+void batt_health_empty(struct batt_health *h)
+{
+  h->from_empty     = true;
+  h->from_empty_mas = 0;
+}
+
+bool batt_health_full(struct batt_health *h, uint16_t rated_mah)
+{
+  bool measured = h->from_empty && h->from_empty_mas / 3600 >= rated_mah / 2;
+  h->from_empty = false;
+  if (!measured) {
+    return false;
+  }
+
+  uint16_t mah = h->from_empty_mas / 3600;
+  if (h->data.capacity_mah == 0) {
+    h->data.capacity_mah = mah;
+  } else {
+    int32_t cap = h->data.capacity_mah;
+    h->data.capacity_mah = cap + (((int32_t)mah - cap) >> BATT_HEALTH_CAP_SHIFT);
+  }
+  if (h->data.measurements < 0xFF) {
+    h->data.measurements++;
+  }
+  h->changed = true;
+  return true;
+}
+
+uint8_t batt_health_soh(struct batt_health const *h, uint16_t rated_mah)
+{
+  if (h->data.capacity_mah == 0 || rated_mah == 0) {
+    return 100;
+  }
+  uint32_t pct = (uint32_t)h->data.capacity_mah * 100 / rated_mah;
+  return (pct > 100) ? 100 : (uint8_t)pct;
+}
+
+uint16_t batt_health_charge_mv(struct batt_health const *h, uint16_t charge_mv)
+{
+  uint32_t derate = (uint32_t)(h->data.cycles_x10 / (BATT_HEALTH_DERATE_CYCLES * 10)) * BATT_HEALTH_DERATE_STEP_MV;
+  if (derate > BATT_HEALTH_DERATE_MAX_MV) {
+    derate = BATT_HEALTH_DERATE_MAX_MV;
+  }
+  return charge_mv - derate;
+}
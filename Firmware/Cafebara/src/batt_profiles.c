@@ -0,0 +1,111 @@
+/* Generated by scripts/batt_profiles.py from batt_profiles.json, do not edit */
+
+#include "batt_profile.h"
+
+// Original pack: 2684 mV + (i << 3) mV
+static const uint8_t lut_stock[SOC_LUT_SIZE] = {
+    0,   2,   3,   4,   6,   7,   9,  10,  12,  13,  14,  16,  17,  19,  20,  22,
+   23,  24,  26,  27,  29,  30,  32,  33,  34,  35,  37,  38,  39,  40,  42,  43,
+   44,  46,  47,  48,  49,  51,  52,  53,  55,  56,  57,  58,  60,  61,  62,  64,
+   65,  66,  67,  69,  70,  71,  72,  74,  75,  76,  78,  79,  80,  81,  83,  84,
+   85,  87,  88,  89,  90,  92,  93,  94,  96,  97,  98, 100, 101, 103, 104, 105,
+  107, 108, 110, 111, 113, 114, 115, 117, 118, 120, 121, 123, 124, 125, 127, 128,
+  129, 131, 132, 133, 135, 136, 137, 138, 140, 141, 142, 144, 145, 146, 147, 149,
+  150, 151, 152, 154, 155, 156, 158, 159, 160, 162, 163, 164, 166, 167, 169, 170,
+  172, 173, 174, 176, 177, 179, 180, 182, 183, 184, 186, 187, 189, 190, 192, 193,
+  194, 195, 197, 198, 199, 200, 202, 203, 204, 206, 207, 208, 209, 211, 212, 213,
+  215, 216, 217, 218, 220, 221, 222, 224, 225, 226, 228, 229, 231, 232, 233, 235,
+  236, 238, 239, 241, 242, 243, 245, 246, 248, 249, 251, 252, 253, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+// 4.2V NMC 18650/21700 cells: 3000 mV + (i << 3) mV
+static const uint8_t lut_nmc[SOC_LUT_SIZE] = {
+    0,   0,   1,   1,   2,   3,   3,   4,   4,   5,   5,   6,   7,   7,   8,   8,
+    9,   9,  10,  11,  11,  12,  12,  13,  13,  14,  15,  15,  16,  16,  17,  17,
+   18,  19,  19,  20,  20,  21,  21,  22,  23,  23,  24,  24,  25,  25,  26,  27,
+   27,  28,  28,  29,  29,  30,  31,  31,  32,  34,  37,  39,  41,  44,  46,  48,
+   51,  53,  55,  58,  60,  62,  65,  68,  72,  75,  78,  81,  84,  88,  91,  94,
+   97, 101, 105, 108, 112, 116, 119, 123, 127, 130, 132, 135, 138, 141, 144, 147,
+  150, 152, 155, 158, 161, 163, 165, 168, 170, 172, 175, 177, 179, 182, 184, 186,
+  189, 191, 193, 195, 197, 200, 202, 204, 206, 208, 210, 212, 214, 217, 219, 221,
+  223, 225, 226, 228, 230, 232, 233, 235, 237, 238, 240, 242, 244, 245, 247, 249,
+  250, 252, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+// 4.35V high-voltage LiPo cells: 3000 mV + (i << 3) mV
+static const uint8_t lut_lihv[SOC_LUT_SIZE] = {
+    0,   0,   1,   1,   2,   2,   3,   3,   4,   4,   5,   5,   6,   6,   7,   7,
+    8,   8,   9,   9,  10,  10,  11,  11,  12,  12,  13,  13,  14,  14,  15,  15,
+   16,  16,  16,  17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,
+   23,  24,  24,  25,  25,  26,  26,  27,  27,  28,  28,  29,  29,  30,  30,  31,
+   31,  33,  35,  37,  39,  41,  43,  45,  48,  50,  52,  54,  56,  58,  60,  62,
+   65,  68,  71,  73,  76,  79,  82,  85,  88,  91,  93,  96, 100, 103, 106, 109,
+  112, 116, 119, 122, 125, 128, 131, 133, 136, 138, 141, 144, 146, 149, 151, 154,
+  156, 159, 161, 163, 165, 168, 170, 172, 174, 176, 178, 180, 182, 185, 187, 189,
+  191, 193, 195, 197, 198, 200, 202, 204, 206, 208, 209, 211, 213, 215, 217, 218,
+  220, 222, 224, 226, 227, 229, 230, 232, 234, 235, 237, 238, 240, 242, 243, 245,
+  246, 248, 250, 251, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+const struct batt_profile batt_profiles[BATT_PROFILES] = {
+  [BATT_STOCK] = {
+    .curve = {
+      .ocv         = {2684, 2864, 3064, 3264, 3444, 3644, 3824, 4024, 4204},
+      .lut         = lut_stock,
+      .lut_base_mv = 2684,
+      .lut_shift   = 3,
+    },
+    .charge_mv    = 4208,
+    .charge_ma    = 4096,
+    .precharge_ma = 128,
+    .term_ma      = 256,
+    .min_mv       = 2700,
+    .cutoff_mv    = 2500,
+    .capacity_mah = 6000,
+  },
+  [BATT_NMC] = {
+    .curve = {
+      .ocv         = {3000, 3450, 3560, 3640, 3710, 3800, 3910, 4030, 4180},
+      .lut         = lut_nmc,
+      .lut_base_mv = 3000,
+      .lut_shift   = 3,
+    },
+    .charge_mv    = 4208,
+    .charge_ma    = 3008,
+    .precharge_ma = 128,
+    .term_ma      = 192,
+    .min_mv       = 3300,
+    .cutoff_mv    = 3000,
+    .capacity_mah = 6000,
+  },
+  [BATT_LIHV] = {
+    .curve = {
+      .ocv         = {3000, 3520, 3640, 3730, 3810, 3910, 4030, 4170, 4330},
+      .lut         = lut_lihv,
+      .lut_base_mv = 3000,
+      .lut_shift   = 3,
+    },
+    .charge_mv    = 4352,
+    .charge_ma    = 3008,
+    .precharge_ma = 128,
+    .term_ma      = 192,
+    .min_mv       = 3350,
+    .cutoff_mv    = 3000,
+    .capacity_mah = 6000,
+  },
+};
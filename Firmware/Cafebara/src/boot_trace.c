@@ -0,0 +1,51 @@
+/*
+ * Boot and power-on phase timestamps.
+ *
+ * Phases that have not been reached read as BOOT_TRACE_NONE and are skipped
+ * when dumping.
+ */
+
+#include "boot_trace.h"
+
+#include "log_msgs.h"
+
+#define BOOT_TRACE_NONE 0xFFFFFFFF
+
+static uint32_t marks[BOOT_PHASES] = {
+  [0 ... BOOT_PHASES - 1] = BOOT_TRACE_NONE,
+};
+
+void boot_trace_mark(enum boot_phase phase, uint32_t millis)
+{
+  if (phase >= BOOT_PHASES) {
+    return;
+  }
+
+  if (phase == PWRON_PRESS) {
+    for (uint8_t i = PWRON_PRESS + 1; i < BOOT_PHASES; i++) {
+      marks[i] = BOOT_TRACE_NONE;
+    }
+  }
+  marks[phase] = millis;
+}
+
+void boot_trace_dump(void)
+{
+  uint32_t prev = BOOT_TRACE_NONE;
+
+  for (uint8_t i = 0; i < BOOT_PHASES; i++) {
+    if (i == PWRON_PRESS) {
+      prev = BOOT_TRACE_NONE; // Power-on is timed from the button press
+    }
+    if (marks[i] == BOOT_TRACE_NONE) {
+      continue;
+    }
+
+    if (prev == BOOT_TRACE_NONE) {
+      TLOG_WAIT(LOG_BOOT_PHASE, i, marks[i]);
+    } else {
+      TLOG_WAIT(LOG_BOOT_PHASE_NEXT, i, marks[i], marks[i] - prev);
+    }
+    prev = marks[i];
+  }
+}
@@ -0,0 +1,48 @@
+/*
+ * Runtime charge configuration.
+ */
+
+#include "charge_cfg.h"
+
+#include "bq25895/bq25895_regs.h"
+
+// Largest value a BQ register field can hold
+#define FIELD_MAX(name) (BQ_##name##_OFFSET + BQ_##name##_INCR * (BQ_##name##_MSK >> BQ_##name##_POS))
+
+// Whether a value is in range and on a step of a BQ register field, so what
+// is stored is exactly what the BQ gets programmed with
+#define FIELD_OK(name, v) \
+  ((v) >= BQ_##name##_OFFSET && (v) <= FIELD_MAX(name) && ((v) - BQ_##name##_OFFSET) % BQ_##name##_INCR == 0)
+
+uint8_t charge_cfg_check(const struct charge_cfg *cfg, uint16_t max_mv, uint16_t max_ma)
+{
+  const uint16_t *v = cfg->value;
+
+  if (!FIELD_OK(ICHG, v[CHARGE_CFG_CHRG_CURRENT]) || v[CHARGE_CFG_CHRG_CURRENT] > max_ma) {
+    return CHARGE_CFG_CHRG_CURRENT;
+  }
+  if (!FIELD_OK(IPRECHG, v[CHARGE_CFG_PRE_CURRENT]) || v[CHARGE_CFG_PRE_CURRENT] > v[CHARGE_CFG_CHRG_CURRENT]) {
+    return CHARGE_CFG_PRE_CURRENT;
+  }
+  if (!FIELD_OK(ITERM, v[CHARGE_CFG_TERM_CURRENT]) || v[CHARGE_CFG_TERM_CURRENT] > v[CHARGE_CFG_CHRG_CURRENT]) {
+    return CHARGE_CFG_TERM_CURRENT;
+  }
+  if (!FIELD_OK(VCHG_MAX, v[CHARGE_CFG_CHRG_VOLTAGE]) || v[CHARGE_CFG_CHRG_VOLTAGE] > max_mv) {
+    return CHARGE_CFG_CHRG_VOLTAGE;
+  }
+  if (v[CHARGE_CFG_FAN_SPEED] > 0xFF) {
+    return CHARGE_CFG_FAN_SPEED;
+  }
+  return CHARGE_CFG_FIELDS;
+}
+
+uint8_t charge_cfg_diff(const struct charge_cfg *a, const struct charge_cfg *b)
+{
+  uint8_t changed = 0;
+  for (uint8_t i = 0; i < CHARGE_CFG_FIELDS; i++) {
+    if (a->value[i] != b->value[i]) {
+      changed |= CHARGE_CFG_BIT(i);
+    }
+  }
+  return changed;
+}
@@ -0,0 +1,132 @@
+/*
+ * Load-aware charge current control.
+ *
+ * When the BQ is regulating (input DPM, thermal regulation or a sagging VBUS),
+ * the setpoint is pulled down to just below the current the charger is actually
+ * delivering, and that value becomes the ceiling. While the BQ is not regulating
+ * the setpoint climbs back one ICHG step at a time up to the ceiling, and the
+ * ceiling itself is only relaxed slowly. This keeps the operating point just
+ * outside DPM instead of oscillating around it.
+ */
+
+#include "charge_ctrl.h"
+
+// Lowest setpoint the controller will back off to
+#define CHARGE_CTRL_MIN_MA      512
+
+// Margin kept below the measured charge current when backing off
+#define CHARGE_CTRL_BACKOFF_MA  128
+
+// Setpoint step when probing upwards (one ICHG LSB)
+#define CHARGE_CTRL_STEP_MA     64
+
+// Updates without regulation before the setpoint is raised by one step
+#define CHARGE_CTRL_HOLDOFF     4
+
+// Updates without regulation before the ceiling is raised by one step
+#define CHARGE_CTRL_RELAX       30
+
+// VBUS below this is treated as the source collapsing, even without DPM
+#define CHARGE_CTRL_VBUS_MIN_MV 4300
+
+void charge_ctrl_init(struct charge_ctrl *ctrl, uint16_t limit_ma)
+{
+  ctrl->limit_ma    = limit_ma;
+  ctrl->setpoint_ma = limit_ma;
+  charge_ctrl_reset(ctrl);
+}
+
+void charge_ctrl_reset(struct charge_ctrl *ctrl)
+{
+  ctrl->ceiling_ma   = ctrl->limit_ma;
+  ctrl->stable_ticks = 0;
+  ctrl->relax_ticks  = 0;
+}
+
+// Program a new setpoint, if it differs from the current one
+static bool charge_ctrl_apply(struct charge_ctrl *ctrl, bq25895_t const *dev, uint16_t target)
+{
+  if (target == ctrl->setpoint_ma) {
+    return true;
+  }
+
+  if (!bq25895_set_charge_current(dev, target)) {
+    return false;
+  }
+
+  ctrl->setpoint_ma = target;
+  return true;
+}
+
+bool charge_ctrl_set_limit(struct charge_ctrl *ctrl, bq25895_t const *dev, uint16_t limit_ma)
+{
+  uint16_t target = ctrl->setpoint_ma;
+
+  if (ctrl->ceiling_ma >= ctrl->limit_ma) {
+    // Nothing learned below the old limit, so follow the new one
+    ctrl->ceiling_ma = limit_ma;
+    target           = limit_ma;
+  } else if (ctrl->ceiling_ma > limit_ma) {
+    ctrl->ceiling_ma = limit_ma;
+  }
+
+  ctrl->limit_ma = limit_ma;
+  if (target > limit_ma) {
+    target = limit_ma;
+  }
+
+  return charge_ctrl_apply(ctrl, dev, target);
+}
+
+bool charge_ctrl_update(struct charge_ctrl *ctrl, bq25895_t const *dev)
+{
+  bool dpm, therm;
+  bq25895_vbus_volt_t vbus;
+  bq25895_chg_current_t ichgr;
+
+  if (!bq25895_is_in_dpm(dev, &dpm) || !bq25895_is_overtemp(dev, &therm) ||
+      !bq25895_get_adc_vbus(dev, &vbus) || !bq25895_get_adc_charge_current(dev, &ichgr)) {
+    return false;
+  }
+
+  uint16_t target = ctrl->setpoint_ma;
+
+  if (dpm || therm || vbus < CHARGE_CTRL_VBUS_MIN_MV) {
+    // Back off to just below what the charger can actually deliver,
+    // and always by at least one step so the BQ leaves regulation
+    target = (ichgr > CHARGE_CTRL_BACKOFF_MA) ? ichgr - CHARGE_CTRL_BACKOFF_MA : 0;
+    if (target + CHARGE_CTRL_STEP_MA > ctrl->setpoint_ma) {
+      target = (ctrl->setpoint_ma > CHARGE_CTRL_STEP_MA) ? ctrl->setpoint_ma - CHARGE_CTRL_STEP_MA : 0;
+    }
+    if (target < CHARGE_CTRL_MIN_MA) {
+      target = CHARGE_CTRL_MIN_MA;
+    }
+
+    ctrl->ceiling_ma   = target;
+    ctrl->stable_ticks = 0;
+    ctrl->relax_ticks  = 0;
+  } else {
+    // Slowly allow the ceiling back up, in case the load has dropped
+    if (++ctrl->relax_ticks >= CHARGE_CTRL_RELAX) {
+      ctrl->ceiling_ma += CHARGE_CTRL_STEP_MA;
+      ctrl->relax_ticks = 0;
+    }
+    if (ctrl->ceiling_ma > ctrl->limit_ma) {
+      ctrl->ceiling_ma = ctrl->limit_ma;
+    }
+
+    // Probe upwards, one step per hold-off period
+    if (++ctrl->stable_ticks >= CHARGE_CTRL_HOLDOFF) {
+      ctrl->stable_ticks = 0;
+      if (ctrl->setpoint_ma + CHARGE_CTRL_STEP_MA <= ctrl->ceiling_ma) {
+        target = ctrl->setpoint_ma + CHARGE_CTRL_STEP_MA;
+      }
+    }
+  }
+
+  if (target > ctrl->limit_ma) {
+    target = ctrl->limit_ma;
+  }
+
+  return charge_ctrl_apply(ctrl, dev, target);
+}
@@ -0,0 +1,127 @@
+/*
+ * Temperature-compensated (JEITA-style) charge profile.
+ */
+
+#include "charge_profile.h"
+
+// Degrees either side of a band boundary before switching bands
+#define CHARGE_PROFILE_HYST 2
+
+// A temperature band, covering everything up to (and including) max_c
+struct charge_band {
+  int8_t max_c;       // Upper edge of the band, degrees C
+  uint8_t ichg_pct;   // Charge current, % of the configured current
+  uint8_t vreg_drop;  // Charge voltage reduction, in 16 mV steps
+};
+
+// Charge profile, from coldest to hottest
+static const struct charge_band bands[] = {
+  {0,   0,   0},  // Below 0C: no charging
+  {10,  25,  0},  // 0-10C: reduced current, lithium plating risk
+  {20,  50,  0},  // 10-20C
+  {45,  100, 0},  // 20-45C: full rate
+  {50,  50,  7},  // 45-50C: reduced current, VREG -112mV
+  {60,  25,  7},  // 50-60C
+  {127, 0,   0},  // Above 60C: no charging
+};
+
+#define BAND_COUNT (sizeof(bands) / sizeof(bands[0]))
+
+// TS voltage (0.1% of REGN) at -20C to 70C in 5C steps, for a 103AT NTC with
+// RT1 = 5.24k and RT2 = 30.31k
+#define NTC_MIN_C  -20
+#define NTC_STEP_C 5
+static const uint16_t ntc_curve[] = {
+  806, 793, 778, 759, 738, 713, 686, 656, 624, 589,
+  554, 517, 480, 444, 408, 374, 341, 311, 282,
+};
+
+#define NTC_COUNT (sizeof(ntc_curve) / sizeof(ntc_curve[0]))
+
+// The TS ADC tops out at code 127, 80.0% of REGN, short of the -20C point.
+// A reading there is TS pulled up to REGN by an open or missing NTC, not a
+// cold pack
+#define TS_SATURATED 800
+
+void charge_profile_init(struct charge_profile *prof, uint16_t ichg_max_ma, uint16_t vreg_max_mv)
+{
+  prof->ichg_max_ma = ichg_max_ma;
+  prof->vreg_max_mv = vreg_max_mv;
+  prof->band        = CHARGE_PROFILE_NO_BAND;
+  prof->ichg_ma     = ichg_max_ma;
+  prof->vreg_mv     = vreg_max_mv;
+}
+
+// Find the band for a temperature, with hysteresis against the current band
+static uint8_t charge_profile_select(uint8_t band, int8_t temp_c)
+{
+  if (band >= BAND_COUNT) {
+    band = 0;
+    while (band < BAND_COUNT - 1 && temp_c > bands[band].max_c) {
+      band++;
+    }
+    return band;
+  }
+
+  while (band < BAND_COUNT - 1 && temp_c > bands[band].max_c + CHARGE_PROFILE_HYST) {
+    band++;
+  }
+  while (band > 0 && temp_c < bands[band - 1].max_c - CHARGE_PROFILE_HYST) {
+    band--;
+  }
+  return band;
+}
+
+bool charge_profile_update(struct charge_profile *prof, bq25895_t const *dev, int8_t temp_c)
+{
+  uint8_t band = charge_profile_select(prof->band, temp_c);
+  if (band == prof->band) {
+    return false;
+  }
+
+  uint16_t vreg = prof->vreg_max_mv - bands[band].vreg_drop * 16;
+  if (vreg != prof->vreg_mv || prof->band == CHARGE_PROFILE_NO_BAND) {
+    if (!bq25895_set_max_charge_voltage(dev, vreg)) {
+      return false; // Retry on the next update
+    }
+    prof->vreg_mv = vreg;
+  }
+
+  prof->band    = band;
+  prof->ichg_ma = (uint16_t)(((uint32_t)prof->ichg_max_ma * bands[band].ichg_pct) / 100);
+  return true;
+}
+
+bool charge_profile_set_max(struct charge_profile *prof, bq25895_t const *dev, uint16_t ichg_max_ma,
+                            uint16_t vreg_max_mv)
+{
+  prof->ichg_max_ma = ichg_max_ma;
+  prof->vreg_max_mv = vreg_max_mv;
+  prof->ichg_ma     = ichg_max_ma;
+  prof->vreg_mv     = vreg_max_mv;
+  if (prof->band != CHARGE_PROFILE_NO_BAND) {
+    prof->ichg_ma = (uint16_t)(((uint32_t)ichg_max_ma * bands[prof->band].ichg_pct) / 100);
+    prof->vreg_mv = vreg_max_mv - bands[prof->band].vreg_drop * 16;
+  }
+
+  // Always written, the BQ may have been reset to its defaults
+  return bq25895_set_max_charge_voltage(dev, prof->vreg_mv);
+}
+
+bool charge_profile_ts_to_celsius(bq25895_ts_pct_t pct, int8_t *temp_c)
+{
+  if (pct >= TS_SATURATED || pct > ntc_curve[0] || pct < ntc_curve[NTC_COUNT - 1]) {
+    return false;
+  }
+
+  // The curve falls with temperature, find the segment and interpolate
+  uint8_t i = 0;
+  while (pct < ntc_curve[i + 1]) {
+    i++;
+  }
+
+  uint16_t span = ntc_curve[i] - ntc_curve[i + 1];
+  uint16_t pos  = ntc_curve[i] - pct;
+  *temp_c = (int8_t)(NTC_MIN_C + i * NTC_STEP_C + (pos * NTC_STEP_C + span / 2) / span);
+  return true;
+}
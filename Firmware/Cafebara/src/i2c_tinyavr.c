@@ -5,19 +5,61 @@
 #if defined(AVR)
 
 #include <avr/io.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 
 #include "i2c.h"
+#include "prof.h"
+#include "pstats.h"
 
 // Is the I2C bus configured yet?
 static bool configured = false;
 
-// Calculate the value for the I2C baud rate register
-// NOTE: This is approximate, and doesn't take into account rise time
-static inline uint8_t i2c_baud(uint32_t frequency)
+// Maximum number of targets with their own bus speed
+#define I2C_SPEED_TARGETS 4
+
+// Bus timing for each mode, from the I2C specification
+struct i2c_timing {
+  uint32_t frequency;
+  uint16_t rise_ns;  // Maximum SCL rise time
+  uint16_t low_ns;   // Minimum SCL low period
+};
+
+static const struct i2c_timing timings[] = {
+  [I2C_MODE_STANDARD]  = { 100000, 1000, 4700 },
+  [I2C_MODE_FAST]      = { 400000,  300, 1300 },
+  [I2C_MODE_FAST_PLUS] = {1000000,  120,  500 },
+};
+#define I2C_MODES (sizeof(timings) / sizeof(timings[0]))
+
+// Convert nanoseconds to peripheral clock cycles, rounding up
+#define I2C_NS_TO_CYCLES(ns) ((int32_t)(((F_CPU / 1000UL) * (ns) + 999999UL) / 1000000UL))
+
+// Per-target bus speeds
+static struct {
+  uint8_t addr;
+  uint8_t mode;
+} speeds[I2C_SPEED_TARGETS];
+static uint8_t num_speeds = 0;
+
+// Default mode, and the mode the bus is currently running at
+static uint8_t default_mode;
+static uint8_t current_mode;
+
+// Calculate the value for the I2C baud rate register, as per the datasheet:
+//   f_SCL = f_CLK_PER / (10 + 2 * BAUD + f_CLK_PER * t_rise)
+// Assuming the worst case rise time keeps f_SCL at or below the mode's limit,
+// and BAUD is raised if needed to meet the minimum SCL low period:
+//   t_low = (BAUD + 5) / f_CLK_PER - t_of
+static inline uint8_t i2c_baud(struct i2c_timing const *timing)
 {
-  int32_t baud = ((F_CPU / frequency) - 10) / 2;
+  int32_t rise_cycles = I2C_NS_TO_CYCLES(timing->rise_ns);
+  int32_t low_cycles  = I2C_NS_TO_CYCLES(timing->low_ns);
+  int32_t cycles      = (F_CPU + timing->frequency - 1) / timing->frequency;
+  int32_t baud        = (cycles - 10 - rise_cycles + 1) / 2;
 
+  if (baud < low_cycles - 5)
+    baud = low_cycles - 5;
   if (baud < 0)
     return 0;
   if (baud > 255)
@@ -26,35 +68,157 @@ static inline uint8_t i2c_baud(uint32_t frequency)
   return (uint8_t)baud;
 }
 
-// Wait for bus to return to idle state
-static inline void i2c_wait_for_idle()
+// Switch the bus to the given mode, only while idle. MBAUD may only change
+// with the controller disabled, and FMPEN with the target disabled as well,
+// so the target is only interrupted when the drive strength has to change
+static inline void i2c_set_mode(uint8_t mode)
 {
-  while (!(TWI0.MSTATUS & TWI_BUSSTATE_IDLE_gc));
+  if (mode == current_mode)
+    return;
+
+  uint8_t mctrla = TWI0.MCTRLA;
+  TWI0.MCTRLA = mctrla & ~TWI_ENABLE_bm;
+
+  // Fast mode plus needs the stronger output drivers
+  uint8_t ctrla = (mode == I2C_MODE_FAST_PLUS) ? (TWI0.CTRLA | TWI_FMPEN_bm) : (TWI0.CTRLA & ~TWI_FMPEN_bm);
+  if (ctrla != TWI0.CTRLA) {
+    uint8_t sctrla = TWI0.SCTRLA;
+    TWI0.SCTRLA = sctrla & ~TWI_ENABLE_bm;
+    TWI0.CTRLA  = ctrla;
+    TWI0.SCTRLA = sctrla;
+  }
+
+  TWI0.MBAUD  = i2c_baud(&timings[mode]);
+  TWI0.MCTRLA = mctrla;
+  if (mctrla & TWI_ENABLE_bm) {
+    TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc; // Re-enabling leaves the bus state unknown
+  }
+  current_mode = mode;
+}
+
+// Look up the bus speed for a target
+static inline uint8_t i2c_target_mode(uint8_t addr)
+{
+  for (uint8_t i = 0; i < num_speeds; i++) {
+    if (speeds[i].addr == addr)
+      return speeds[i].mode;
+  }
+
+  return default_mode;
+}
+
+// Bus pins, for recovery
+#define I2C_PORT      PORTB
+#define I2C_SCL_bm    (1 << 0)
+#define I2C_SDA_bm    (1 << 1)
+
+// Half an SCL period during recovery (~100 kHz)
+#define I2C_RECOVER_US 5
+
+// Checks of the pins before recovery, I2C_RECOVER_US apart (~100 us)
+#define I2C_STUCK_CHECKS 20
+
+// Longest wait for the bus, covering a byte at 100 kHz plus clock stretching
+#define I2C_TIMEOUT_MS 5
+
+// Wait loop iterations in I2C_TIMEOUT_MS, at roughly 8 cycles per iteration
+#define I2C_WAIT_LOOPS ((uint16_t)(F_CPU / 1000UL * I2C_TIMEOUT_MS / 8))
+
+// Error counters
+static struct i2c_stats stats;
+
+static inline void i2c_count(uint16_t *counter)
+{
+  if (*counter < 0xFFFF)
+    (*counter)++;
+}
+
+// Wait for any of the given status flags, returns false on timeout
+static inline bool i2c_wait_for(uint8_t flags)
+{
+  for (uint16_t i = I2C_WAIT_LOOPS; i; i--) {
+    if (TWI0.MSTATUS & flags)
+      return true;
+  }
+
+  return false;
+}
+
+// Wait for bus to return to idle state, returns false on timeout
+static inline bool i2c_wait_for_idle()
+{
+  for (uint16_t i = I2C_WAIT_LOOPS; i; i--) {
+    if ((TWI0.MSTATUS & TWI_BUSSTATE_gm) == TWI_BUSSTATE_IDLE_gc)
+      return true;
+  }
+
+  return false;
 }
 
 // Send stop condition
-static inline void i2c_stop()
+static inline bool i2c_stop()
 {
   TWI0.MCTRLB |= TWI_MCMD_STOP_gc;
-  i2c_wait_for_idle();
+  return i2c_wait_for_idle();
 }
 
-int i2c_configure(uint8_t mode)
+// Count a failed transfer, freeing the bus if it has been left in a bad state
+static int i2c_fail(int err)
 {
-  // Set the I2C frequency
-  switch (mode) {
-    case I2C_MODE_STANDARD:
-      TWI0.MBAUD = i2c_baud(100000);
+  switch (err) {
+    case -I2C_ERR_NACK:
+      i2c_count(&stats.nack);
+      if (!i2c_stop()) {
+        i2c_count(&stats.timeout);
+        i2c_recover();
+      }
       break;
-    case I2C_MODE_FAST:
-      TWI0.MBAUD = i2c_baud(400000);
+    case -I2C_ERR_ARB_LOST:
+      i2c_count(&stats.arb_lost);
+      i2c_wait_for_idle(); // Let the other controller finish
+      break;
+    case -I2C_ERR_BUS:
+      i2c_count(&stats.bus_err);
+      i2c_recover();
+      break;
+    case -I2C_ERR_TIMEOUT:
+      i2c_count(&stats.timeout);
+      if (!i2c_stop())
+        i2c_recover(); // Only clocks the bus if a target is holding SDA
       break;
-    default:
-      return -I2C_ERR;
   }
 
-  // Enable the I2C controller
-  TWI0.MCTRLA = TWI_ENABLE_bm;
+  return err;
+}
+
+// Check the status after an address or data byte
+static inline int i2c_check()
+{
+  uint8_t status = TWI0.MSTATUS;
+
+  if (status & TWI_ARBLOST_bm)
+    return -I2C_ERR_ARB_LOST;
+  if (status & TWI_BUSERR_bm)
+    return -I2C_ERR_BUS;
+  if (status & TWI_RXACK_bm)
+    return -I2C_ERR_NACK;
+
+  return 0;
+}
+
+int i2c_configure(uint8_t mode)
+{
+  if (mode >= I2C_MODES)
+    return -I2C_ERR;
+
+  // Set the I2C frequency
+  default_mode = mode;
+  current_mode = I2C_MODES;
+  i2c_set_mode(mode);
+
+  // Enable the I2C controller, with the bus timeout so a transfer abandoned by
+  // another controller doesn't leave the bus marked as busy
+  TWI0.MCTRLA = TWI_TIMEOUT_200US_gc | TWI_ENABLE_bm;
 
   // Set the bus state to idle
   TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
@@ -68,7 +232,110 @@ int i2c_configure(uint8_t mode)
   return 0;
 }
 
-int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+int i2c_set_speed(uint8_t addr, uint8_t mode)
+{
+  if (mode >= I2C_MODES)
+    return -I2C_ERR;
+
+  // Update an existing entry
+  for (uint8_t i = 0; i < num_speeds; i++) {
+    if (speeds[i].addr == addr) {
+      speeds[i].mode = mode;
+      return 0;
+    }
+  }
+
+  if (num_speeds >= I2C_SPEED_TARGETS)
+    return -I2C_ERR;
+
+  speeds[num_speeds].addr = addr;
+  speeds[num_speeds].mode = mode;
+  num_speeds++;
+
+  return 0;
+}
+
+// Check for a target holding SDA low with SCL released. SCL going low is
+// another controller's transfer, or a target stretching the clock
+static bool i2c_stuck(void)
+{
+  for (uint8_t i = 0; i < I2C_STUCK_CHECKS; i++) {
+    if ((I2C_PORT.IN & (I2C_SCL_bm | I2C_SDA_bm)) != I2C_SCL_bm)
+      return false;
+    _delay_us(I2C_RECOVER_US);
+  }
+
+  return true;
+}
+
+int i2c_recover(void)
+{
+  // Only clock a bus that is actually stuck
+  if (!i2c_stuck()) {
+    if ((I2C_PORT.IN & (I2C_SCL_bm | I2C_SDA_bm)) != (I2C_SCL_bm | I2C_SDA_bm))
+      return -I2C_ERR_BUS;
+    return 0;
+  }
+
+  // Take the pins from the TWI, controller and target both, and drive them
+  // open drain
+  uint8_t sctrla = TWI0.SCTRLA;
+  TWI0.SCTRLA = sctrla & ~TWI_ENABLE_bm;
+  TWI0.MCTRLA &= ~TWI_ENABLE_bm;
+  I2C_PORT.OUTCLR = I2C_SCL_bm | I2C_SDA_bm;
+  I2C_PORT.DIRCLR = I2C_SCL_bm | I2C_SDA_bm;
+
+  // Up to 9 clocks, until the target releases SDA
+  for (uint8_t i = 0; i < 9 && !(I2C_PORT.IN & I2C_SDA_bm); i++) {
+    I2C_PORT.DIRSET = I2C_SCL_bm;
+    _delay_us(I2C_RECOVER_US);
+    I2C_PORT.DIRCLR = I2C_SCL_bm;
+    _delay_us(I2C_RECOVER_US);
+  }
+
+  // STOP condition: SDA rising while SCL is high
+  I2C_PORT.DIRSET = I2C_SCL_bm;
+  _delay_us(I2C_RECOVER_US);
+  I2C_PORT.DIRSET = I2C_SDA_bm;
+  _delay_us(I2C_RECOVER_US);
+  I2C_PORT.DIRCLR = I2C_SCL_bm;
+  _delay_us(I2C_RECOVER_US);
+  I2C_PORT.DIRCLR = I2C_SDA_bm;
+  _delay_us(I2C_RECOVER_US);
+
+  i2c_count(&stats.recoveries);
+
+  // Hand the pins back
+  TWI0.MCTRLA |= TWI_ENABLE_bm;
+  TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
+  TWI0.SCTRLA  = sctrla;
+
+  if (!(I2C_PORT.IN & I2C_SDA_bm) || !(I2C_PORT.IN & I2C_SCL_bm))
+    return -I2C_ERR_BUS;
+
+  return 0;
+}
+
+void i2c_suspend(void)
+{
+  TWI0.MCTRLA &= ~TWI_ENABLE_bm;
+}
+
+void i2c_resume(void)
+{
+  TWI0.MCTRLA |= TWI_ENABLE_bm;
+  TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
+}
+
+void i2c_get_stats(struct i2c_stats *out)
+{
+  // Counted from the main loop, copied from the TWI target interrupt too
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    *out = stats;
+  }
+}
+
+static int i2c_transfer_msgs(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
 {
   // Check if the I2C bus is configured
   if (!configured)
@@ -81,11 +348,22 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
   if (!num_msgs)
     return 0;
 
+  // Wait for any other controller to finish with the bus. The Pi shares the
+  // bus, so a long transfer of its own is reported, not cleared
+  if (!i2c_wait_for_idle()) {
+    i2c_count(&stats.timeout);
+    return -I2C_ERR_TIMEOUT;
+  }
+
+  // Run the bus at the target's speed, now that it is idle
+  i2c_set_mode(i2c_target_mode(addr));
+
   // Send the messages
   do {
     // Stop flag from previous message?
     if (flags & I2C_MSG_STOP) {
-      i2c_stop();
+      if (!i2c_stop())
+        return i2c_fail(-I2C_ERR_TIMEOUT);
     }
 
     // Get flags for new message, keep start flag if present
@@ -97,18 +375,13 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
       TWI0.MADDR = (addr << 1) | (flags & I2C_MSG_READ);
 
       // Wait for write or read interrupt flag
-      while (!(TWI0.MSTATUS & (TWI_WIF_bm | TWI_RIF_bm)));
-
-      // Check for errors
-      if (TWI0.MSTATUS & TWI_ARBLOST_bm) {
-        // Arbitration lost
-        i2c_wait_for_idle();
-        return -I2C_ERR;
-      } else if (TWI0.MSTATUS & TWI_RXACK_bm) {
-        // Address not acknowledged by client
-        i2c_stop();
-        return -I2C_ERR;
-      }
+      if (!i2c_wait_for(TWI_WIF_bm | TWI_RIF_bm))
+        return i2c_fail(-I2C_ERR_TIMEOUT);
+
+      // Check for errors, or the address not being acknowledged by the client
+      int err = i2c_check();
+      if (err)
+        return i2c_fail(err);
 
       flags &= ~I2C_MSG_RESTART;
     }
@@ -120,7 +393,8 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
       // Read
       while (buf < buf_end) {
         // Wait for read interrupt flag
-        while (!(TWI0.MSTATUS & TWI_RIF_bm));
+        if (!i2c_wait_for(TWI_RIF_bm))
+          return i2c_fail(-I2C_ERR_TIMEOUT);
 
         // Read byte
         *buf++ = TWI0.MDATA;
@@ -140,17 +414,13 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
         TWI0.MDATA = *buf++;
 
         // Wait for write to complete
-        while (!(TWI0.MSTATUS & TWI_WIF_bm));
+        if (!i2c_wait_for(TWI_WIF_bm))
+          return i2c_fail(-I2C_ERR_TIMEOUT);
 
-        // Check for errors
-        if (TWI0.MSTATUS & (TWI_ARBLOST_bm | TWI_BUSERR_bm))
-          return -I2C_ERR;
-
-        // Check for NACK
-        if (TWI0.MSTATUS & TWI_RXACK_bm) {
-          i2c_stop();
-          return -I2C_ERR;
-        }
+        // Check for errors and NACK
+        int err = i2c_check();
+        if (err)
+          return i2c_fail(err);
       }
     }
 
@@ -160,8 +430,25 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
   } while (num_msgs);
 
   // Send final stop condition
-  i2c_stop();
+  if (!i2c_stop())
+    return i2c_fail(-I2C_ERR_TIMEOUT);
   return 0;
 }
 
+int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+{
+  PROF_BEGIN(PROF_I2C_TRANSFER);
+  int ret = i2c_transfer_msgs(addr, msgs, num_msgs);
+  PROF_END(PROF_I2C_TRANSFER);
+
+  uint16_t bytes = 0;
+  for (uint8_t i = 0; i < num_msgs; i++) {
+    bytes += msgs[i].len;
+  }
+  pstats_count(PSTATS_EVENT_I2C_TRANSFERS, 1);
+  pstats_count(PSTATS_EVENT_I2C_BYTES, bytes);
+
+  return ret;
+}
+
 #endif // defined(AVR)
\ No newline at end of file
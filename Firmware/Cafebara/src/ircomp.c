@@ -0,0 +1,159 @@
+/*
+ * Battery IR compensation calibration.
+ *
+ * R = dV / dI is measured between the programmed charge current and half of it.
+ * Only a fraction of R is compensated: part of the measured drop is inside the
+ * cells, and compensating that as well would push them above VREG.
+ */
+
+#include "ircomp.h"
+
+// Samples averaged at each charge current
+#define IRCOMP_SAMPLES     4
+
+// Updates to wait after changing ICHG, so the ADC reflects the new current
+#define IRCOMP_SETTLE      3
+
+// Smallest current step that gives a usable measurement (BATV LSB is 20 mV).
+// The step is half the setpoint, so IRCOMP_MIN_SETPOINT_MA is twice this
+#define IRCOMP_MIN_STEP_MA (IRCOMP_MIN_SETPOINT_MA / 2)
+
+// Percentage of the measured resistance to compensate
+#define IRCOMP_COMP_PCT    50
+
+// BATV this close to VREG means the BQ is already in constant-voltage mode
+#define IRCOMP_CV_MARGIN   100
+
+// BAT_COMP and VCLAMP step sizes
+#define IRCOMP_COMP_STEP   20
+#define IRCOMP_CLAMP_STEP  32
+
+// Calibration sequence
+enum { STEP_IDLE, STEP_HIGH, STEP_SETTLE, STEP_LOW };
+
+bool ircomp_start(struct ircomp *cal, uint16_t setpoint_ma, uint16_t limit_ma, uint16_t vreg_mv)
+{
+  if (setpoint_ma < IRCOMP_MIN_SETPOINT_MA) {
+    cal->state = STEP_IDLE;
+    return false;
+  }
+  cal->state       = STEP_HIGH;
+  cal->ticks       = 0;
+  cal->setpoint_ma = setpoint_ma;
+  cal->limit_ma    = limit_ma;
+  cal->vreg_mv     = vreg_mv;
+  cal->v_sum[0]    = cal->v_sum[1] = 0;
+  cal->i_sum[0]    = cal->i_sum[1] = 0;
+  return true;
+}
+
+void ircomp_abort(struct ircomp *cal, bq25895_t const *dev)
+{
+  if (cal->state == STEP_SETTLE || cal->state == STEP_LOW) {
+    bq25895_set_charge_current(dev, cal->setpoint_ma);
+  }
+  cal->state = STEP_IDLE;
+}
+
+bool ircomp_busy(struct ircomp const *cal)
+{
+  return cal->state != STEP_IDLE;
+}
+
+// Convert the accumulated samples into BAT_COMP and VCLAMP values
+static bool ircomp_compute(struct ircomp *cal)
+{
+  int32_t dv = (int32_t)(cal->v_sum[0] - cal->v_sum[1]);
+  int32_t di = (int32_t)(cal->i_sum[0] - cal->i_sum[1]);
+
+  if (di < (int32_t)IRCOMP_MIN_STEP_MA * IRCOMP_SAMPLES) {
+    return false;
+  }
+  if (dv <= 0) {
+    return false; // No drop resolved, not a usable measurement
+  }
+
+  cal->measured_mohm = (uint16_t)((dv * 1000) / di);
+  if (cal->measured_mohm == 0) {
+    return false;
+  }
+
+  uint16_t comp = (uint32_t)cal->measured_mohm * IRCOMP_COMP_PCT / 100;
+  comp -= comp % IRCOMP_COMP_STEP;
+  if (comp > IRCOMP_MAX_MOHM) {
+    comp = IRCOMP_MAX_MOHM;
+  }
+
+  // Clamp at the worst-case drop across the compensated resistance
+  uint32_t clamp = ((uint32_t)comp * cal->limit_ma + 999) / 1000;
+  clamp = ((clamp + IRCOMP_CLAMP_STEP - 1) / IRCOMP_CLAMP_STEP) * IRCOMP_CLAMP_STEP;
+  if (clamp > IRCOMP_MAX_CLAMP) {
+    clamp = IRCOMP_MAX_CLAMP;
+  }
+
+  cal->comp_mohm = (uint8_t)comp;
+  cal->clamp_mv  = (uint8_t)clamp;
+  return true;
+}
+
+enum ircomp_result ircomp_update(struct ircomp *cal, bq25895_t const *dev)
+{
+  if (cal->state == STEP_IDLE) {
+    return IRCOMP_IDLE;
+  }
+
+  bool dpm, therm;
+  bq25895_batt_volt_t batv;
+  bq25895_chg_current_t ichgr;
+
+  if (!bq25895_is_in_dpm(dev, &dpm) || !bq25895_is_overtemp(dev, &therm) ||
+      !bq25895_get_adc_batt(dev, &batv) || !bq25895_get_adc_charge_current(dev, &ichgr)) {
+    ircomp_abort(cal, dev);
+    return IRCOMP_FAILED;
+  }
+
+  // The current must be set by ICHG alone for the measurement to mean anything
+  if (dpm || therm || batv + IRCOMP_CV_MARGIN >= cal->vreg_mv) {
+    ircomp_abort(cal, dev);
+    return IRCOMP_FAILED;
+  }
+
+  switch (cal->state) {
+    case STEP_HIGH:
+      cal->v_sum[0] += batv;
+      cal->i_sum[0] += ichgr;
+      if (++cal->ticks >= IRCOMP_SAMPLES) {
+        if (!bq25895_set_charge_current(dev, cal->setpoint_ma / 2)) {
+          ircomp_abort(cal, dev);
+          return IRCOMP_FAILED;
+        }
+        cal->state = STEP_SETTLE;
+        cal->ticks = 0;
+      }
+      return IRCOMP_BUSY;
+
+    case STEP_SETTLE:
+      if (++cal->ticks >= IRCOMP_SETTLE) {
+        cal->state = STEP_LOW;
+        cal->ticks = 0;
+      }
+      return IRCOMP_BUSY;
+
+    case STEP_LOW:
+      cal->v_sum[1] += batv;
+      cal->i_sum[1] += ichgr;
+      if (++cal->ticks < IRCOMP_SAMPLES) {
+        return IRCOMP_BUSY;
+      }
+      break;
+  }
+
+  ircomp_abort(cal, dev); // Restore the charge current
+
+  if (!ircomp_compute(cal) || !bq25895_set_comp_resistor(dev, cal->comp_mohm) ||
+      !bq25895_set_voltage_clamp(dev, cal->clamp_mv)) {
+    return IRCOMP_FAILED;
+  }
+
+  return IRCOMP_DONE;
+}
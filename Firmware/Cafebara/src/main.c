@@ -5,25 +5,57 @@
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <avr/power.h>
+#include <string.h>
 
+#include <util/atomic.h>
 #include <util/delay.h>
 
 #include "aled.h"         // Include several of loopj's useful utility libraries
+#include "led_anim.h"
 #include "button.h"       // Partially modified to suit Cafebara
 #include "console.h"
 #include "rtc.h"
+#include "sched.h"
 #include "gpio.h"
 #include "i2c.h"
-//#include "i2c_target.h" 
+#include "i2c_target.h"
+#include "log_msgs.h"
+#include "pi_regs.h"
+#include "pm.h"
+#include "prof.h"
+#include "pstats.h"
+#include "vlm.h"
+#include "watchdog.h"
 
 #include "bq25895.h"      // Based on jefflongo's BQ24292i driver
 #include "bq25895/bq25895_regs.h"
 
+#include "batt_health.h"
+#include "batt_profile.h"
+#include "boot_trace.h"
+#include "charge_cfg.h"
+#include "charge_ctrl.h"
+#include "charge_profile.h"
+#include "ircomp.h"
+#include "power_policy.h"
+#include "runtime_est.h"
+#include "sleep_audit.h"
+#include "soc.h"
+#include "stack.h"
+#include "tmp1075.h"
+
+#ifdef BOOTLOADER
+#include "boot_proto.h"
+#endif
+
 #define BAUD_RATE 115200
 
 //#define CAFEBARA_I2C 0x50
 
 #define PI_I2C_ADDR 0x20
+#define BQ_WRITE_MAX 4  // Longest register write to the BQ, in bytes
+
+#define TMP1075_ADDR 0x48
 
 //#define HUSB238A_ADDR 0x42
 
@@ -33,6 +65,31 @@
 #define ADDR_TERMCURRENT  0x06
 #define ADDR_CHRGVOLTAGE  0x08
 #define ADDR_FANSPEED     0x0A
+#define ADDR_BATCOMP      0x0B
+#define ADDR_VCLAMP       0x0C
+#define ADDR_IRCOMPAGE    0x0D
+#define ADDR_BATTRES      0x0E
+#define ADDR_BATTCAP      0x10
+#define ADDR_SOC          0x12
+#define ADDR_BATTPROFILE  0x14
+#define ADDR_WDTRESETS    0x15
+#define ADDR_HEALTH       0x16  // struct batt_health_data, through 0x1F
+
+#define IRCOMP_RECAL_SESSIONS 20  // Re-measure IR compensation every 20 charge sessions
+#define IRCOMP_RETRY_TICKS    60  // Wait before retrying a failed measurement
+
+#define SOC_SAVE_DELTA        4   // Save the state of charge after it moves ~1.5%
+#define BATT_CACHE_MS         1500 // Battery reading still trusted at power-on
+#define SOC_UNKNOWN           0xFFFF
+#define CONSOLE_IDLE_MS       30000 // Stay awake this long after the console was last used
+#define OVERTEMP_COOL_MS      120000UL // Fan at full speed for 2 minutes after an over-temperature fault
+#define WDT_DEADLINE_ON       WDT_PERIOD_1KCLK_gc // ~1s while the console is powered
+#define WDT_DEADLINE_AWAKE    WDT_PERIOD_4KCLK_gc // ~4s otherwise, covers a one-shot ADC conversion
+#define PIN_EVENT_BUTTON      (1 << 0) // Pin events raised by the port interrupts, see handlePinEvents()
+#define PIN_EVENT_TEMP_ALERT  (1 << 1)
+#define PIN_EVENT_HPD         (1 << 2)
+#define PIN_EVENT_BQ_INT      (1 << 3)
+#define VLM_LEVEL             BOD_VLMLVL_15ABOVE_gc // ~3.0V over the 2.6V BOD, well into LDO dropout, under monitorBatt()'s cut-off
 
 /*
 TODO: 
@@ -49,7 +106,13 @@ const uint8_t ver = 0x01;   // v0.3 (ver / 10)
 bool isPowered = false;     // Is the Wii U powered?
 bool isCharging = false;    // Is the BQ charging the batteries?
 bool isOverTemp = false;    // Is the Wii U (or an IC) too hot?
+uint32_t overTempMillis = 0; // When the over-temperature cool-down started
 bool isFault = false;       // Is there a fault?
+volatile bool isBrownOut = false; // Was the console cut off by the VLM, and not dealt with yet?
+volatile uint8_t pinEvents = 0;   // PIN_EVENT_* raised by the port interrupts, not handled yet
+uint16_t stackHigh = 0;           // Stack high-water mark, sampled by monitorTask()
+bool monitorReq = false;          // Battery check asked for by consoleOff(), before the next sleep
+bool isTracing = false;     // Recording BQ reads, pin edges and power decisions, see trace.h
 
 bool isUSBCVideo = false;   // Is MelonHD active and outputting video over USBC?
 
@@ -57,9 +120,8 @@ bool isBusMaster = true;    // Is the ATtiny the master of the I2C bus?
 
 uint8_t battCharge = 0x00;  // 0x00-0xFF, representing 0-100% charge
 uint16_t battVolt = 3700;
-const uint16_t minBattVolt  = 2700;
+uint32_t battVoltMillis = 0; // When battVolt was last measured
 const uint16_t maxInCurrent = 3250;
-const uint16_t battChrgLevels[9] = {2684, 2864, 3064, 3264, 3444, 3644, 3824, 4024, 4204};
 bq25895_fault_t pwrErrorStatus = BQ_FAULT_NONE;
 bq25895_charge_state_t chargeStatus = BQ_STATE_NOT_CHARGING;
 
@@ -70,6 +132,32 @@ uint16_t  preCurrent  = 128;    // 128mA
 uint16_t  termCurrent = 256;    // 256mA
 uint16_t  chrgVoltage = 4208;   // 4.208V
 uint8_t   fanSpeed    = 0xFF;   // 100% speed
+uint8_t   batComp     = 0;      // 0mOhm IR compensation, until calibrated
+uint8_t   vClamp      = 0;      // 0mV IR compensation clamp
+uint8_t   irCompAge   = 0xFF;   // Charge sessions since IR calibration, 0xFF if never calibrated
+uint16_t  battRes     = 150;    // 150mOhm pack resistance, until measured
+uint16_t  battCapacity = 6000;  // 6000mAh
+uint16_t  savedCharge = SOC_UNKNOWN; // State of charge last saved to the EEPROM
+uint8_t   wdtResets   = 0;      // Watchdog resets since the EEPROM was blank
+uint8_t   battProfileId = BATT_STOCK; // Cells fitted, see batt_profiles.json
+
+const struct batt_profile *battProfile = &batt_profiles[BATT_STOCK];
+struct batt_health battHealth; // Cycles, ageing and measured capacity of the cells fitted
+volatile uint8_t battProfileReq = 0xFF; // Profile to switch to from the config task, 0xFF if none
+
+struct charge_cfg cfgShadow;              // Configuration staged by the Pi
+volatile uint8_t cfgStatus = PI_CFG_IDLE; // Result of the last commit, see PI_CFG_*
+volatile bool statsResetReq = false;      // Power stats reset requested by the Pi
+uint8_t cfgField = 0xFF;                  // Field rejected by the last commit, 0xFF if none
+#ifdef BOOTLOADER
+volatile bool bootReq = false;            // Bootloader requested by the Pi
+#endif
+
+bool isFastCharging = false;    // Is the BQ in a fast-charge session?
+uint8_t irCompRetry = 0;        // Ticks until the IR calibration can be tried again
+uint32_t restedMs = 0;          // Time the pack has been resting while the MCU slept
+bool isConsoleAttached = false; // Has the console been used in the last CONSOLE_IDLE_MS?
+uint32_t consoleMillis = 0;     // When the console last received anything
 
 const bool ilimEnabled = false;
 
@@ -83,49 +171,180 @@ void getEEPROM() {
     termCurrent = eeprom_read_word(ADDR_TERMCURRENT);
     chrgVoltage = eeprom_read_word(ADDR_CHRGVOLTAGE);
     fanSpeed = eeprom_read_byte(ADDR_FANSPEED);
+    batComp = eeprom_read_byte(ADDR_BATCOMP);
+    vClamp = eeprom_read_byte(ADDR_VCLAMP);
+    irCompAge = eeprom_read_byte(ADDR_IRCOMPAGE);
+    battRes = eeprom_read_word(ADDR_BATTRES);
+    battCapacity = eeprom_read_word(ADDR_BATTCAP);
+    savedCharge = eeprom_read_word(ADDR_SOC);
+    battProfileId = eeprom_read_byte(ADDR_BATTPROFILE);
+  }
+
+  if (battProfileId >= BATT_PROFILES) { // Saved before profiles existed
+    battProfileId = BATT_STOCK;
+  }
+  battProfile = &batt_profiles[battProfileId];
+  if (chrgVoltage > battProfile->charge_mv) { // Never charge past what the cells allow
+    chrgVoltage = battProfile->charge_mv;
+  }
+  if (chrgCurrent > battProfile->charge_ma) {
+    chrgCurrent = battProfile->charge_ma;
+  }
+
+  if (batComp > IRCOMP_MAX_MOHM || vClamp > IRCOMP_MAX_CLAMP) { // Never calibrated
+    batComp = 0;
+    vClamp = 0;
+    irCompAge = 0xFF;
+  }
+
+  if (battRes == 0 || battRes > 1000) { // Not measured yet
+    battRes = 150;
+  }
+  if (battCapacity == 0 || battCapacity == 0xFFFF) {
+    battCapacity = 6000;
+  }
+  if (savedCharge > SOC_FULL) {
+    savedCharge = SOC_UNKNOWN;
   }
 
   if (eeprom_read_byte(ADDR_VER) != ver) {
     eeprom_write_byte(ADDR_VER, ver);
   }
+
+  struct batt_health_data health; // Blank until the first counters are saved
+  eeprom_read_block(&health, (const void *)ADDR_HEALTH, sizeof(health));
+  batt_health_init(&battHealth, &health, rtc_millis());
+}
+
+// Count watchdog resets across power cycles, saturating at 0xFE (0xFF is a blank EEPROM)
+void countResets() {
+  wdtResets = eeprom_read_byte(ADDR_WDTRESETS);
+  if (wdtResets == 0xFF) {
+    wdtResets = 0;
+  }
+  if ((watchdog_reset_cause() & RSTCTRL_WDRF_bm) && wdtResets < 0xFE) {
+    eeprom_write_byte(ADDR_WDTRESETS, ++wdtResets);
+  }
+  TLOG(LOG_RESET_CAUSE, watchdog_reset_cause(), wdtResets);
 }
 
 // BQ I2C write
-bool i2c_bq_write(uint8_t addr, uint8_t reg, void const* buf, size_t len, void* context) {
-  uint8_t *byte_buf = (uint8_t *)buf;
-  if (i2c_reg_write_byte(addr, reg, byte_buf[0]) != 0) {
+bool i2c_bq_write(uint16_t addr, uint8_t reg, void const* buf, size_t len, void* context) {
+  uint8_t msg[BQ_WRITE_MAX + 1];
+  if (len > BQ_WRITE_MAX) {
     return false;
   }
-  return true;
+  msg[0] = reg;
+  memcpy(&msg[1], buf, len);
+  return i2c_write(addr, msg, len + 1) == 0;
 }
-// BQ I2C read
-bool i2c_bq_read(uint8_t addr, uint8_t reg, void const* buf, size_t len, void* context) {
-  if (i2c_reg_read_byte(addr, reg, buf) != 0) {
+// BQ I2C read, the BQ auto-increments the register address for longer reads
+bool i2c_bq_read(uint16_t addr, uint8_t reg, void* buf, size_t len, void* context) {
+  if (i2c_write_read(addr, &reg, 1, buf, len) != 0) {
     return false;
   }
+  if (isTracing) { // Everything the firmware sees from the BQ, for replay
+    for (uint8_t i = 0; i < len; i++) {
+      TLOG(LOG_TRACE_READ, (uint8_t)(reg + i), ((uint8_t *)buf)[i]);
+    }
+  }
   return true;
 }
+// Back off while waiting for a BQ ADC conversion
+void bq_delay(uint16_t ms, void* context) {
+  while (ms--) {
+    _delay_ms(1);
+  }
+}
 
 bq25895_t bq = {
   .write = i2c_bq_write,
   .read = i2c_bq_read,
+  .delay = bq_delay,
+};
+bq25895_adc_t bqAdc;
+bq25895_adc_req_t adcReq;
+bool adcFresh = false;
+bool adcContinuous = false; // BQ ADC in continuous mode, where it ignores one-shot starts
+
+struct charge_ctrl chrgCtrl;
+struct charge_profile chrgProfile;
+struct ircomp irCal;
+struct soc_est socEst;
+struct runtime_est runtimeEst;
+struct sleep_leaks sleepLeaks;  // Found going into the last sleep
+bool sleepLeaksNew = false;     // Differs from the sleep before, not logged yet
+int8_t packTemp = BATT_HEALTH_TEMP_UNKNOWN; // Last pack temperature read, in degrees C
+
+struct console_cmd commands[] = {
+  {"status", cmdStatus},
+  {"boot",   cmdBoot},
+  {"i2c",    cmdI2C},
+  {"stack",  cmdStack},
+  {"batt",   cmdBatt},
+  {"power",  cmdPower},
+  {"health", cmdHealth},
+  {"sleep",  cmdSleep},
+  {"trace",  cmdTrace},
+#ifdef PROF_ENABLE
+  {"prof",   cmdProf},
+#endif
+};
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+struct sched_task tasks[] = {
+  {monitorTask,      1000},
+  {configTask,       50},
+  {adcTask,          10},
+  {chargeControl,    1000},
+  {chargeProfile,    5000},
+  {consoleTask,      50},
+  {publishRegisters, 50},
+  {ledTask,          20},
+};
+#define TASK_COUNT (sizeof(tasks) / sizeof(tasks[0]))
+
+// Suspended in this order before sleep, resumed in reverse
+struct pm_driver sleepDrivers[] = {
+  {fanSuspend,      fanResume},
+  {console_suspend, console_resume}, // Also parks the LED data pin, shared with TX
+  {i2c_suspend,     i2c_resume},
+  {hpdSuspend,      hpdResume},
 };
+#define SLEEP_DRIVER_COUNT (sizeof(sleepDrivers) / sizeof(sleepDrivers[0]))
 
 bool setup() {
+#ifdef BOOTLOADER
+  // Started by the bootloader after an update, rather than from a reset
+  bool keepPower = GPIOR0 == BOOT_HANDOFF && (GPIOR1 & BOOT_HANDOFF_POWERED);
+  GPIOR0 = 0;
+#else
+  bool keepPower = false;
+#endif
+  watchdog_init(); // Reset cause, before anything else can reset
+  watchdog_arm(WDT_DEADLINE_AWAKE, 0);
   button_init(&pwr_button, BUTTON.port, BUTTON.num, NULL, buttonHeld);
   rtc_init();
-  set_sleep_mode(SLEEP_MODE_PWR_DOWN); // Set sleep to low power mode
+  set_sleep_mode(SLEEP_MODE_STANDBY); // Set sleep to low power mode, where the console can still wake us
   sleep_enable(); // Enable sleeping, don't activate sleep yet though
 
   setupUSART();
 
   sei(); // Enable interrupts
-
-  // Set unused pins to outputs
-  PORTA.DIRSET |= (1 << 3) + (1 << 4) + (1 << 5) + (1 << 6) + (1 << 7); // PA3, PA4, PA5, PA6, PA7
-  PORTC.DIRSET |= (1 << 1) + (1 << 2);   // PC1, PC2
+#ifdef PROF_ENABLE
+  prof_init();
+#endif
+  boot_trace_mark(BOOT_START, rtc_millis());
+
+  for (uint8_t i = 0; i < UNUSED_PIN_COUNT; i++) {
+    gpio_input(UNUSED_PINS[i]);
+    gpio_config(UNUSED_PINS[i], PORT_ISC_INPUT_DISABLE_gc);
+  }
 
   getEEPROM(); // Get settings from EEPROM
+  countResets();
+  syncConfigShadow();
+  boot_trace_mark(BOOT_EEPROM, rtc_millis());
 
   gpio_input(BUTTON);
   gpio_config(BUTTON, PORT_PULLUPEN_bm | PORT_ISC_FALLING_gc);
@@ -144,29 +363,112 @@ bool setup() {
   initFan();
   setFan(false, 0x00); // Turn off fan initially
 
-  gpio_set_low(PWR_EN); // Makes sure console is off
+  if (!keepPower) {
+    gpio_set_low(PWR_EN); // Makes sure console is off
+  }
   gpio_output(PWR_EN);
+  vlm_init(VLM_LEVEL, brownOut); // Hard cut-off, monitorBatt() is the soft one
 
-  //i2c_target_init(CAFEBARA_I2C, handle_register_read, handle_register_write);  // Init hardware I2C
-  i2c_configure(I2C_MODE_STANDARD); // Setup I2C
+  i2c_configure(I2C_MODE_STANDARD); // Setup I2C, unknown targets stay at 100 kHz
+  i2c_set_speed(BQ_ADDR, I2C_MODE_FAST);
+  i2c_set_speed(TMP1075_ADDR, I2C_MODE_FAST);
+  i2c_target_init(PI_I2C_ADDR, handle_register_read, handle_register_write); // Expose registers to the Pi
 
   led_init();
+  boot_trace_mark(BOOT_IO, rtc_millis());
   if (!i2c_detect(BQ_ADDR) || !bq25895_is_present(&bq)) {  // Check that the BQ is present on the bus
     return false;
   }
+  charge_profile_init(&chrgProfile, chrgCurrent, chargeVoltage());
   setupBQ();
-  
+  boot_trace_mark(BOOT_BQ, rtc_millis());
+
+  getBattVoltage();
+  soc_init(&socEst, &battProfile->curve, battCapacity,
+           (savedCharge != SOC_UNKNOWN) ? (uint8_t)savedCharge : soc_from_ocv(&battProfile->curve, battVolt),
+           rtc_millis());
+  restedMs = SOC_REST_MS; // Off for who knows how long, blend the saved state with the pack voltage
+  runtime_est_init(&runtimeEst);
+  if (keepPower) {
+    consoleOn(); // Still on from before the update, catch up with it
+  }
+  publishRegisters();
+  boot_trace_mark(BOOT_READY, rtc_millis());
+
   return true;
 }
 
+// Is someone using the console? Stays true until it has been quiet for CONSOLE_IDLE_MS
+bool consoleAttached() {
+  if (console_activity()) {
+    consoleMillis = rtc_millis();
+    isConsoleAttached = true;
+  }
+  else if (isConsoleAttached && rtc_millis() - consoleMillis > CONSOLE_IDLE_MS) {
+    isConsoleAttached = false;
+  }
+  return isConsoleAttached;
+}
+
+// Act on the pin events raised by the port interrupts, from the main loop
+void handlePinEvents() {
+  uint8_t events;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    events = pinEvents;
+    pinEvents = 0;
+  }
+  if (events & PIN_EVENT_BUTTON) {
+    traceGpio(TRACE_BUTTON, BUTTON); // The press itself is picked up by button_update()
+  }
+  if (events & PIN_EVENT_TEMP_ALERT) {
+    traceGpio(TRACE_TEMP_ALERT, TEMP_ALERT);
+    overTemp();
+  }
+  if (events & PIN_EVENT_HPD) {
+    traceGpio(TRACE_HPD, HPD);
+    checkHPDstatus();
+  }
+  if (events & PIN_EVENT_BQ_INT) {
+    traceGpio(TRACE_BQ_INT, BQ_INT);
+    monitorBatt();
+  }
+}
+
 void loop() {
   button_update(&pwr_button, rtc_millis());
-  if (gpio_read(BUTTON) != false) {
+  handlePinEvents();
+  if (monitorReq) {
+    monitorReq = false;
+    monitorBatt();
+  }
+  pstats_state(isPowered ? PSTATS_STATE_ON : isCharging ? PSTATS_STATE_CHARGING : PSTATS_STATE_AWAKE, rtc_millis());
+  if (gpio_read(BUTTON) != false && !isPowered && !isCharging && !led_anim_busy() && !adcReq.pending &&
+      !console_busy() && !consoleAttached() && !isOverTemp && !pinEvents && !monitorReq) {
+    watchdog_arm(WDT_PERIOD_OFF_gc, rtc_millis()); // Nothing runs to feed it
     rtc_deinit();
-    sleep_cpu(); // The console isn't on, nor is it charging. Enter sleep to save power.
+    pm_suspend(sleepDrivers, SLEEP_DRIVER_COUNT);
+    sleepAudit();
+    pstats_sleep();
+    cli();
+    if (!pinEvents) { // Raised since the check above, handle it before sleeping
+      sei();
+      sleep_cpu(); // Nothing to regulate. Enter sleep to save power. sei() lets nothing in before it
+    }
+    sei();
+    rtc_init();
+    pm_resume(sleepDrivers, SLEEP_DRIVER_COUNT);
+    if (sleepLeaksNew) {
+      sleepLeaksNew = false;
+      logSleepLeaks();
+    }
+    pstats_add_time(PSTATS_STATE_STANDBY, rtc_slept_ms());
+    batt_health_slept(&battHealth, rtc_slept_ms()); // Still ageing, with rtc_millis() stopped
+    sched_expire(tasks, TASK_COUNT, rtc_millis()); // Catch up after waking
+    restedMs += rtc_slept_ms();
   }
-  monitorBatt();
-  _delay_ms(500);
+  watchdog_arm(isPowered ? WDT_DEADLINE_ON : WDT_DEADLINE_AWAKE, rtc_millis());
+  sched_run(tasks, TASK_COUNT, rtc_millis());
+  watchdog_feed(rtc_millis()); // Only fed here, while the tasks keep being dispatched, never from an interrupt
 }
 
 void setupUSART() {
@@ -179,21 +481,44 @@ void overTemp() {
   setFan(true, 0xff); // Fan at full-speed, to cool down console
   powerLED(5);
   isOverTemp = true;
-  for (int i; i < (2 * 60); i++) {
-    _delay_ms(1000);  // 2 minutes to cool down
+  overTempMillis = rtc_millis(); // Cooled down by the monitor task, without blocking
+}
+
+
+// VDD sagging under the console's load, from the VLM interrupt. Drop the load
+// now, the rest of the shutdown follows from the config task
+void brownOut() {
+  if (!isPowered) {
+    return;
   }
-  isOverTemp = false;
-  setFan(false, 0x00); // disable cooling fan
+  gpio_set_low(PWR_EN);
+  setFan(false, 0x00);
+  isBrownOut = true;
 }
 
+// Finish a shutdown started by brownOut(), once the supply has recovered
+void brownOutShutdown() {
+  if (isPowered) {
+    consoleOff();
+  }
+  TLOG(LOG_BROWNOUT, battVolt, battCharge);
+  savedCharge = battCharge; // The pack may not come back, save what is known now
+  eeprom_update_word(ADDR_SOC, savedCharge);
+  powerLED(5);
+}
 
 void buttonHeld() {
   if (isPowered) {
     consoleOff(); // Is console on? Turn it off.
   }
   else {
-    getBattVoltage();
-    if (((battVolt > minBattVolt) || isCharging) && !isOverTemp && (pwrErrorStatus == BQ_FAULT_NONE)) { 
+    boot_trace_mark(PWRON_PRESS, pwr_button.last_millis);
+    boot_trace_mark(PWRON_HELD, rtc_millis());
+    if (rtc_millis() - battVoltMillis > BATT_CACHE_MS) {
+      getBattVoltage(); // Only convert if the monitor hasn't just done so
+    }
+    boot_trace_mark(PWRON_BATT, rtc_millis());
+    if (((battVolt > battProfile->min_mv) || isCharging) && !isOverTemp && (pwrErrorStatus == BQ_FAULT_NONE)) { 
     // Check that either the battery is charged enough, or console is charging, 
     // AND make sure there are no over-temp issues
     // AND make sure there are no power errors
@@ -203,24 +528,33 @@ void buttonHeld() {
       powerLED(5); // Flash red light, battery too low OR over temp OR misc power error
     }
   }
-  while (pwr_button.button_state != BUTTON_RELEASED) {
-    button_update(&pwr_button, rtc_millis());
-  }
 }
 
 void chargingStatus() {
-  bq25895_is_charger_connected(&bq, &isCharging);
-  bq25895_get_charge_state(&bq, &chargeStatus);
-  bq25895_check_faults(&bq, &pwrErrorStatus);
+  PROF_BEGIN(PROF_CHARGING_STATUS);
+  bool wasCharging = isCharging;
+  struct power_charger charger;
+  uint8_t led;
+  power_charger_read(&bq, &charger);
+  enum power_action action = power_charger_decide(&charger, isPowered, &led);
+  if (isTracing) { // Before acting, which reads the BQ again
+    TLOG(LOG_TRACE_CHARGER, rtc_millis(), (uint8_t)isPowered, (uint8_t)action, led);
+  }
+  isCharging = charger.connected;
+  chargeStatus = charger.state;
+  pwrErrorStatus = charger.faults;
   if (pwrErrorStatus != BQ_FAULT_NONE) { // Uh oh, *something* is wrong
+    TLOG(LOG_FAULT, pwrErrorStatus);
     isFault = true;
     consoleOff();
-    powerLED(5);
-    if (pwrErrorStatus & BQ_FAULT_THERM) { // oh jeez stuff is hot this is really bad
+    powerLED(POWER_LED_ERROR);
+    if (action == POWER_OVERTEMP) { // oh jeez stuff is hot this is really bad
+      PROF_END(PROF_CHARGING_STATUS);
       overTemp();
       return;
     }
-    else if (pwrErrorStatus & BQ_FAULT_BAT) { // ???? the battery is TOO charged????
+    else if (action == POWER_SHIP) { // ???? the battery is TOO charged????
+      PROF_END(PROF_CHARGING_STATUS);
       enableShipping();
       return; // Unnecessary since the board's gonna power off anyway
     }
@@ -229,23 +563,88 @@ void chargingStatus() {
     isFault = false;
   }
 
-  if (chargeStatus == BQ_STATE_NOT_CHARGING) {
-    isCharging = false;
-    if (!isPowered) {
-      powerLED(0); // Not on, not charging
+  isCharging = chargeStatus != BQ_STATE_NOT_CHARGING;
+  if (isCharging) {
+    checkHPDstatus();
+  }
+  if (led != POWER_LED_KEEP) {
+    powerLED(led);
+  }
+  if (isCharging != wasCharging && !isPowered) {
+    setAdcContinuous(isCharging); // Charge control needs the ADC while charging
+  }
+  _delay_ms(100);
+  PROF_END(PROF_CHARGING_STATUS);
+}
+
+void chargeControl() {
+  if (chargeStatus != BQ_STATE_FAST_CHARGE) {
+    if (ircomp_busy(&irCal)) {
+      ircomp_abort(&irCal, &bq);
     }
+    isFastCharging = false;
+    return;
   }
-  else {
-    isCharging = true;
-    checkHPDstatus();
-    if (chargeStatus == BQ_STATE_TERMINATED) { // Finished charging
-      powerLED(7);
+
+  if (!isFastCharging) { // New charge session
+    isFastCharging = true;
+    irCompRetry = 0;
+    if (irCompAge < IRCOMP_RECAL_SESSIONS) {
+      irCompAge++;
+      eeprom_update_byte(ADDR_IRCOMPAGE, irCompAge);
     }
-    else {
-      powerLED(6); // Charging, not complete
+  }
+
+  if (!ircomp_busy(&irCal) && irCompAge >= IRCOMP_RECAL_SESSIONS) {
+    if (irCompRetry > 0) {
+      irCompRetry--;
+    }
+    else if (!ircomp_start(&irCal, chrgCtrl.setpoint_ma, chrgCurrent, chrgProfile.vreg_mv)) {
+      irCompRetry = IRCOMP_RETRY_TICKS; // Charging too slowly to measure, try again later
     }
   }
-  _delay_ms(100);
+
+  if (ircomp_busy(&irCal)) { // Hold ICHG steady while measuring
+    switch (ircomp_update(&irCal, &bq)) {
+      case IRCOMP_DONE: // Never 0 mOhm, see ircomp_update()
+        batComp = irCal.comp_mohm;
+        vClamp = irCal.clamp_mv;
+        battRes = irCal.measured_mohm;
+        irCompAge = 0;
+        writeToEEPROM();
+        break;
+      case IRCOMP_FAILED:
+        irCompRetry = IRCOMP_RETRY_TICKS;
+        break;
+      default:
+        break;
+    }
+    return;
+  }
+
+  charge_ctrl_update(&chrgCtrl, &bq); // Keep ICHG just below the DPM point
+}
+
+bool getPackTemp(int8_t *temp) {
+  bq25895_ts_pct_t ts;
+  if (bq25895_get_adc_ts(&bq, &ts) && charge_profile_ts_to_celsius(ts, temp)) {
+    return true; // Pack NTC
+  }
+  return tmp1075_get_temp(TMP1075_ADDR, temp); // No NTC fitted, use the board sensor
+}
+
+void chargeProfile() {
+  int8_t temp;
+  if (!getPackTemp(&temp)) {
+    return;
+  }
+  packTemp = temp;
+  if (charge_profile_update(&chrgProfile, &bq, temp)) { // Moved into a new temperature band
+    if (ircomp_busy(&irCal)) {
+      ircomp_abort(&irCal, &bq);
+    }
+    charge_ctrl_set_limit(&chrgCtrl, &bq, chrgProfile.ichg_ma);
+  }
 }
 
 void initFan() {
@@ -255,92 +654,118 @@ void initFan() {
   TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV1_gc | TCA_SINGLE_ENABLE_bm;
 }
 
+// Also stops the fan from brownOut(), in the VLM interrupt, so the read-modify-
+// write of CTRLA mustn't be split by it
 void setFan(bool active, uint8_t speed) {
   if (active && speed > 0x00) {
-    TCA0.SINGLE.CTRLA = TCA0.SINGLE.CTRLA | 0b00000001;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      TCA0.SINGLE.CTRLA = TCA0.SINGLE.CTRLA | 0b00000001;
+    }
     TCA0.SINGLE.CMP2 = speed;
   }
   else {
-    TCA0.SINGLE.CTRLA = TCA0.SINGLE.CTRLA & ~(0b00000001);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      TCA0.SINGLE.CTRLA = TCA0.SINGLE.CTRLA & ~(0b00000001);
+    }
   }
 }
 
+// A stopped timer leaves the PWM output at whatever level it stopped on, so
+// hand the pin back to the port unless the fan is meant to be running
+void fanSuspend() {
+  if (!(TCA0.SINGLE.CTRLA & TCA_SINGLE_ENABLE_bm)) {
+    gpio_set_low(FAN);
+    TCA0.SINGLE.CTRLB &= ~TCA_SINGLE_CMP2EN_bm;
+  }
+}
+
+void fanResume() {
+  TCA0.SINGLE.CTRLB |= TCA_SINGLE_CMP2EN_bm;
+}
+
+// LED brightness levels, perceptual (equivalent to 50% and 25% duty)
+#define LED_BRIGHT 199
+#define LED_DIM    156
+
 void powerLED(uint8_t mode) {
   /*
   0 = All LEDs off
   1 = Full charge -- Green
   2 = Medium charge -- Yellow
   3 = Low charge -- Orange
-  4 = About to run out -- Red
+  4 = About to run out -- Red pulse
   5 = Low-power shutdown, or other error -- Couple red flashes
-  6 = Charging -- Soft blue
+  6 = Charging -- Soft blue breathing
   7 = Charging, full -- Soft pink
   */
+  uint32_t now = rtc_millis();
   switch (mode) {
-    case 0:
-      setLED(0x00, 0x00, 0x00, 0.0, false);
-    break;
-
     case 1:
-      setLED(0x00, 0xFF, 0x00, 0.5, true); // Green
+      led_anim_start(&LED_SOLID, 0x00FF00, LED_BRIGHT, LED_REPEAT_FOREVER, now); // Green
     break;
 
     case 2:
-      setLED(0xFF, 0xFF, 0x00, 0.5, true); // Yellow
+      led_anim_start(&LED_SOLID, 0xFFFF00, LED_BRIGHT, LED_REPEAT_FOREVER, now); // Yellow
     break;
 
     case 3:
-      setLED(0xFF, 0x80, 0x00, 0.5, true); // Orange
+      led_anim_start(&LED_SOLID, 0xFF8000, LED_BRIGHT, LED_REPEAT_FOREVER, now); // Orange
     break;
 
     case 4:
-      setLED(0xFF, 0x00, 0x00, 0.5, true); // Red
+      led_anim_start(&LED_PULSE, 0xFF0000, LED_BRIGHT, LED_REPEAT_FOREVER, now); // Red
     break;
 
     case 5:
-      for (int i = 0; i < 5; i++) { // Flash red
-        setLED(0xFF, 0x00, 0x00, 0.5, true);
-        _delay_ms(100);
-        setLED(0x00, 0x00, 0x00, 0.0, false);
-        _delay_ms(100);
-      }
-      powerLED(0);
+      led_anim_start(&LED_BLINK, 0xFF0000, LED_BRIGHT, 5, now); // Flash red, then back to whatever is next
     break;
 
     case 6:
-      setLED(0x00, 0x00, 0xFF, 0.25, true); // Dim blue
+      led_anim_start(&LED_BREATHE, 0x0000FF, LED_DIM, LED_REPEAT_FOREVER, now); // Dim blue
     break;
 
     case 7:
-      setLED(0xFF, 0xB7, 0xC5, 0.25, true); // Dim sakura pink
+      led_anim_start(&LED_SOLID, 0xFFB7C5, LED_DIM, LED_REPEAT_FOREVER, now); // Dim sakura pink
     break;
 
     default:
-      powerLED(0); // off
+      led_anim_start(&LED_SOLID, 0x000000, 0, LED_REPEAT_FOREVER, now); // off
     break;
   }
 }
 
-void consoleOn() {
-  bq25895_set_adc_cont(&bq, true);
+void ledTask() {
+  led_anim_update(rtc_millis());
+}
 
-  gpio_set_high(PWR_EN); // Activate regs
+void consoleOn() {
+  gpio_set_high(PWR_EN); // Activate regs first, the rest can wait
   isPowered = true;
+  boot_trace_mark(PWRON_ENABLE, rtc_millis());
+  TLOG(LOG_POWER_ON, battVolt);
+
+  setAdcContinuous(true);
+  charge_ctrl_reset(&chrgCtrl); // System load changed, relearn the charge current
 
   setFan(true, fanSpeed); // Enable fan
 
   monitorBatt();
+  boot_trace_mark(PWRON_DONE, rtc_millis());
 }
 
 void consoleOff() {
-  bq25895_set_adc_cont(&bq, false);
+  setAdcContinuous(isCharging); // Charge control still needs the ADC
 
   gpio_set_low(PWR_EN); // Deactivate regs
   isPowered = false;
+  TLOG(LOG_POWER_OFF, battVolt);
+  charge_ctrl_reset(&chrgCtrl);
 
   setFan(false, 0x00);
 
-  monitorBatt();
+  // Battery check from the main loop, not from here: monitorBatt() and
+  // chargingStatus() both turn the console off, and would recurse
+  monitorReq = true;
 }
 
 void enableShipping() {
@@ -352,15 +777,36 @@ void setupBQ() {
   bq25895_set_iin_max(&bq, maxInCurrent);
   bq25895_set_vsys_min(&bq, 3000);
   bq25895_set_charge_config(&bq, BQ_CHG_CONFIG_ENABLE);
-  bq25895_set_charge_current(&bq, chrgCurrent);
+  applyChargeLimits();
   bq25895_set_term_current(&bq, termCurrent);
   bq25895_set_precharge_current(&bq, preCurrent);
-  bq25895_set_max_charge_voltage(&bq, chrgVoltage);
   bq25895_set_recharge_offset(&bq, BQ_VRECHG_100MV);
   bq25895_set_batlow_voltage(&bq, BQ_VBATLOW_3000MV);
   bq25895_set_charge_termination(&bq, true);
   bq25895_set_max_temp(&bq, BQ_MAX_TEMP_100C);
-  bq25895_set_adc_cont(&bq, isPowered);
+  bq25895_set_comp_resistor(&bq, batComp);
+  bq25895_set_voltage_clamp(&bq, vClamp);
+  setAdcContinuous(isPowered || isCharging);
+  if (chrgProfile.band == CHARGE_PROFILE_NO_BAND) {
+    chargeProfile(); // Derate for the pack's temperature from the start, not after the first task period
+  }
+}
+
+// Program the configured charge current and voltage, derated for the pack's
+// temperature band, and start the current controller again from there
+bool applyChargeLimits() {
+  bool ok = charge_profile_set_max(&chrgProfile, &bq, chrgCurrent, chargeVoltage());
+  ok &= bq25895_set_charge_current(&bq, chrgProfile.ichg_ma);
+  charge_ctrl_init(&chrgCtrl, chrgProfile.ichg_ma);
+  return ok;
+}
+
+// Switch the BQ ADC between continuous and one-shot conversions, keeping track
+// of which, as a one-shot start in continuous mode is ignored
+void setAdcContinuous(bool enable) {
+  if (bq25895_set_adc_cont(&bq, enable)) {
+    adcContinuous = enable;
+  }
 }
 
 void writeToEEPROM() {
@@ -369,6 +815,12 @@ void writeToEEPROM() {
   eeprom_write_word(ADDR_TERMCURRENT, termCurrent);
   eeprom_write_word(ADDR_CHRGVOLTAGE, chrgVoltage);
   eeprom_write_byte(ADDR_FANSPEED, fanSpeed);
+  eeprom_write_byte(ADDR_BATCOMP, batComp);
+  eeprom_write_byte(ADDR_VCLAMP, vClamp);
+  eeprom_update_byte(ADDR_IRCOMPAGE, irCompAge);
+  eeprom_write_word(ADDR_BATTRES, battRes);
+  eeprom_write_word(ADDR_BATTCAP, battCapacity);
+  eeprom_write_byte(ADDR_BATTPROFILE, battProfileId);
 }
 
 void applyChanges() {
@@ -378,95 +830,674 @@ void applyChanges() {
 }
 
 void getBattVoltage() {
-  if (!isPowered) {
-    bq25895_trigger_adc_read(&bq);
-    _delay_ms(200);
+  bool ok = true;
+  if (adcFresh) {
+    adcFresh = false; // Conversion just finished in the background
+  }
+  else if (adcContinuous) {
+    ok = bq25895_read_adc(&bq, &bqAdc); // Latest continuous result, at most a second old
+  }
+  else {
+    ok = bq25895_adc_convert(&bq, &bqAdc); // One-shot, returns as soon as the conversion completes
+  }
+  battVolt = bqAdc.batt_mv;
+  if (ok) {
+    battVoltMillis = rtc_millis(); // A failed read leaves the last reading, as old as it was
   }
-  bq25895_get_adc_batt(&bq, &battVolt);
 }
 
-void setLED(uint8_t r, uint8_t g, uint8_t b, float bright, bool enabled) {
-  if (!enabled) {
-    led_clear_all();
+// Switch to another set of cells: their charge limits, and a fresh estimate from their OCV curve
+void selectBattProfile(uint8_t id) {
+  battProfileId = id;
+  battProfile = &batt_profiles[id];
+  chrgVoltage = battProfile->charge_mv;
+  chrgCurrent = battProfile->charge_ma;
+  preCurrent = battProfile->precharge_ma;
+  termCurrent = battProfile->term_ma;
+  battCapacity = battProfile->capacity_mah;
+
+  // Calibration and charge state belong to the old cells
+  batComp = 0;
+  vClamp = 0;
+  irCompAge = 0xFF;
+  battRes = 150;
+  savedCharge = SOC_UNKNOWN;
+  batt_health_init(&battHealth, NULL, rtc_millis());
+  eeprom_update_block(&battHealth.data, (void *)ADDR_HEALTH, sizeof(battHealth.data));
+
+  applyChanges();
+  syncConfigShadow();
+  soc_init(&socEst, &battProfile->curve, battCapacity, soc_from_ocv(&battProfile->curve, battVolt), rtc_millis());
+  battCharge = socEst.soc;
+  TLOG(LOG_BATT_PROFILE, battProfileId);
+}
+
+void getChargeConfig(struct charge_cfg *cfg) {
+  cfg->value[CHARGE_CFG_CHRG_CURRENT] = chrgCurrent;
+  cfg->value[CHARGE_CFG_PRE_CURRENT] = preCurrent;
+  cfg->value[CHARGE_CFG_TERM_CURRENT] = termCurrent;
+  cfg->value[CHARGE_CFG_CHRG_VOLTAGE] = chrgVoltage;
+  cfg->value[CHARGE_CFG_FAN_SPEED] = fanSpeed;
+}
+
+// Show the live configuration in the Pi's configuration window, dropping anything staged
+void syncConfigShadow() {
+  struct charge_cfg live;
+  getChargeConfig(&live);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    cfgShadow = live;
   }
-  else {
-    uint32_t color = 0x000000;
-    r = (uint8_t)(r * bright);
-    g = (uint8_t)(g * bright);
-    b = (uint8_t)(b * bright);
-    color = (g << 16) + (r << 8) + b; // WS2812 and compatible use GRB
-    led_set_all(color);
+}
+
+// Apply the configuration staged by the Pi: validated as a whole first, then
+// only the fields that changed are written to the BQ and the EEPROM
+void applyPiConfig() {
+  uint8_t field = charge_cfg_check(&cfgShadow, battProfile->charge_mv, battProfile->charge_ma);
+  if (field != CHARGE_CFG_FIELDS) {
+    TLOG(LOG_CONFIG_REJECTED, field);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { // Read together by the Pi
+      cfgField = field;
+      cfgStatus = PI_CFG_INVALID;
+    }
+    return;
+  }
+
+  struct charge_cfg live;
+  getChargeConfig(&live);
+  uint8_t changed = charge_cfg_diff(&live, &cfgShadow);
+  bool ok = true;
+
+  if (changed & CHARGE_CFG_BIT(CHARGE_CFG_CHRG_CURRENT)) {
+    chrgCurrent = cfgShadow.value[CHARGE_CFG_CHRG_CURRENT];
+    eeprom_update_word(ADDR_CHRGCURRENT, chrgCurrent);
+  }
+  if (changed & CHARGE_CFG_BIT(CHARGE_CFG_PRE_CURRENT)) {
+    preCurrent = cfgShadow.value[CHARGE_CFG_PRE_CURRENT];
+    ok &= bq25895_set_precharge_current(&bq, preCurrent);
+    eeprom_update_word(ADDR_PRECURRENT, preCurrent);
+  }
+  if (changed & CHARGE_CFG_BIT(CHARGE_CFG_TERM_CURRENT)) {
+    termCurrent = cfgShadow.value[CHARGE_CFG_TERM_CURRENT];
+    ok &= bq25895_set_term_current(&bq, termCurrent);
+    eeprom_update_word(ADDR_TERMCURRENT, termCurrent);
+  }
+  if (changed & CHARGE_CFG_BIT(CHARGE_CFG_CHRG_VOLTAGE)) {
+    chrgVoltage = cfgShadow.value[CHARGE_CFG_CHRG_VOLTAGE];
+    eeprom_update_word(ADDR_CHRGVOLTAGE, chrgVoltage);
+  }
+  if (changed & (CHARGE_CFG_BIT(CHARGE_CFG_CHRG_CURRENT) | CHARGE_CFG_BIT(CHARGE_CFG_CHRG_VOLTAGE))) {
+    // Derated for the current temperature band straight away, not on the next band change
+    ok &= applyChargeLimits();
+  }
+  if (changed & CHARGE_CFG_BIT(CHARGE_CFG_FAN_SPEED)) {
+    fanSpeed = cfgShadow.value[CHARGE_CFG_FAN_SPEED];
+    setFan(isPowered, fanSpeed);
+    eeprom_update_byte(ADDR_FANSPEED, fanSpeed);
+  }
+
+  if (!ok) {
+    setupBQ(); // Don't leave the BQ with part of the change, send all of it again
+  }
+  TLOG(LOG_CONFIG_APPLIED, changed, (uint8_t)ok);
+  publishRegisters(); // The new settings, before the Pi sees the commit done
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    cfgField = 0xFF;
+    cfgStatus = ok ? PI_CFG_OK : PI_CFG_BUS_ERROR;
+  }
+}
+
+// Requests from the Pi and the console, handled here rather than in the interrupt that received them
+void configTask() {
+  if (isBrownOut) {
+    isBrownOut = false;
+    brownOutShutdown();
+  }
+  if (statsResetReq) {
+    statsResetReq = false;
+    pstats_reset();
+  }
+  if (cfgStatus == PI_CFG_PENDING) {
+    applyPiConfig();
+  }
+  if (battProfileReq != 0xFF) {
+    uint8_t id = battProfileReq;
+    battProfileReq = 0xFF;
+    if (id != battProfileId) {
+      selectBattProfile(id);
+    }
+  }
+#ifdef BOOTLOADER
+  if (bootReq) {
+    enterBootloader();
+  }
+#endif
+}
+
+#ifdef BOOTLOADER
+// Hand over to the bootloader without a reset, so the console and the Pi stay powered
+void enterBootloader() {
+  watchdog_arm(WDT_PERIOD_OFF_gc, rtc_millis()); // Nothing feeds it from here
+  cli();
+  TWI0.SCTRLA = 0; // The bootloader polls the target itself
+  TWI0.MCTRLA = 0;
+  GPIOR0 = BOOT_HANDOFF;
+  ((void (*)(void))0)();
+}
+#endif
+
+// Periodic battery check, without blocking on the ADC when it has to be triggered
+void monitorTask() {
+  if (isOverTemp && rtc_millis() - overTempMillis >= OVERTEMP_COOL_MS) {
+    isOverTemp = false;
+    setFan(false, 0x00); // disable cooling fan
+  }
+  stackHigh = stack_high_water(); // Scans up to the whole painted stack, not for the TWI interrupt
+
+  if (isPowered || adcContinuous) {
+    monitorBatt(); // Continuous conversions, nothing to start
+  }
+  else if (!adcReq.pending) {
+    if (!bq25895_adc_start(&bq, &adcReq, adcDone, NULL)) {
+      monitorBatt();
+    }
+  }
+}
+
+void adcTask() {
+  bq25895_adc_poll(&bq, &adcReq);
+}
+
+void adcDone(bool ok, bq25895_adc_t const* adc, void* context) {
+  if (ok) {
+    bqAdc = *adc;
+    adcFresh = true;
+  }
+  monitorBatt();
+}
+
+// Charge voltage to program, the configured one lowered as the pack ages
+uint16_t chargeVoltage() {
+  return batt_health_charge_mv(&battHealth, chrgVoltage);
+}
+
+// Save the health counters when they've moved, and follow the charge voltage as it is derated
+void saveHealth() {
+  if (!battHealth.changed) {
+    return;
+  }
+  battHealth.changed = false;
+  eeprom_update_block(&battHealth.data, (void *)ADDR_HEALTH, sizeof(battHealth.data));
+
+  uint16_t vreg = chargeVoltage();
+  if (vreg != chrgProfile.vreg_max_mv) {
+    charge_profile_set_max(&chrgProfile, &bq, chrgCurrent, vreg); // Keeping the hot band's reduction
+    TLOG(LOG_HEALTH_VREG, vreg);
   }
-  led_refresh();
+}
+
+// Pack ran down to the cut-off: measure its capacity as it is charged back up
+void battEmpty() {
+  batt_health_empty(&battHealth);
+}
+
+// Charge terminated: the pack's capacity is measured, if it was charged from the cut-off
+void battFull() {
+  if (!batt_health_full(&battHealth, battProfile->capacity_mah)) {
+    return;
+  }
+  battCapacity = battHealth.data.capacity_mah;
+  eeprom_update_word(ADDR_BATTCAP, battCapacity);
+  soc_init(&socEst, &battProfile->curve, battCapacity, socEst.soc, rtc_millis());
+  TLOG(LOG_HEALTH_CAPACITY, battCapacity, batt_health_soh(&battHealth, battProfile->capacity_mah),
+       battHealth.data.measurements);
+  saveHealth();
 }
 
 void battChargeStatus() {
   chargingStatus();
+  getBattVoltage();
+
+  bq25895_chg_current_t ichg = 0;
+  if (isCharging) {
+    bq25895_get_adc_charge_current(&bq, &ichg);
+  }
   if (chargeStatus == BQ_STATE_TERMINATED) { // Fully-charged
-    battCharge = 0xff;
-    return;
+    soc_set_full(&socEst);
+    battFull();
   }
-  getBattVoltage();
-  _delay_ms(100);
-  
-  float tmp;
-
-  for (int i = 0; i < 8; i++) {
-    if ((battVolt >= battChrgLevels[i]) && (battVolt < battChrgLevels[i+1])) {
-      tmp = i + ((battVolt - battChrgLevels[i]) / (battChrgLevels[i+1] - battChrgLevels[i]));
-      tmp *= 0x20;
-      battCharge = (uint8_t)tmp;
-      return;
-    }
+  else if (restedMs && !isCharging && !isPowered) { // Pack rested while the MCU slept
+    soc_rested(&socEst, battVolt, restedMs, rtc_millis());
+  }
+  else {
+    soc_update(&socEst, battVolt, ichg, isPowered, battRes, rtc_millis());
+  }
+  restedMs = 0;
+  battCharge = socEst.soc;
+  runtime_est_update(&runtimeEst, socEst.current_ma, battVolt, socEst.charge_mas, socEst.capacity_mas);
+  // Health counts the charge the BQ measured, not the estimate the state of charge scales
+  batt_health_update(&battHealth, isCharging ? (int16_t)ichg : socEst.current_ma, battVolt, packTemp,
+                     battProfile->charge_mv, battProfile->capacity_mah, rtc_millis());
+  saveHealth();
+
+  // Keep the estimate across power loss, without wearing out the EEPROM
+  if (savedCharge == SOC_UNKNOWN || battCharge >= savedCharge + SOC_SAVE_DELTA ||
+      battCharge + SOC_SAVE_DELTA <= savedCharge || (battCharge == SOC_FULL && savedCharge != SOC_FULL)) {
+    savedCharge = battCharge;
+    eeprom_update_word(ADDR_SOC, savedCharge);
   }
 }
 
 void monitorBatt() {
+  PROF_BEGIN(PROF_MONITOR_BATT);
   battChargeStatus();
-  _delay_ms(100);
   if (isCharging || !isPowered) { 
     // If not turned on, or if charging, let the chargingStatus function handle it
-    powerLED(0);
+    PROF_END(PROF_MONITOR_BATT);
     return;
   }
-  if (battVolt < minBattVolt) {
-    consoleOff(); // Battery too low, emergency shutdown
-    powerLED(5); // Show flashing red for error
+  uint8_t led;
+  enum power_action action = power_battery_decide(battCharge, battVolt, battProfile->cutoff_mv, &led);
+  if (isTracing) {
+    TLOG(LOG_TRACE_BATTERY, rtc_millis(), battCharge, (uint8_t)action, led);
+  }
+  if (action == POWER_EMPTY) {
+    PROF_END(PROF_MONITOR_BATT);
+    battEmpty();
+    consoleOff(); // Battery empty, or sagging dangerously low, emergency shutdown
+    powerLED(led); // Show flashing red for error
     return;
   }
-  if (battVolt > battChrgLevels[5]) {
-    powerLED(1); // High charge
+  powerLED(led); // Charge level
+  PROF_END(PROF_MONITOR_BATT);
+}
+
+// Record an edge on an input pin while tracing
+void traceGpio(enum trace_pin pin, gpio_t gpio) {
+  if (isTracing) {
+    TLOG(LOG_TRACE_GPIO, rtc_millis(), (uint8_t)pin, (uint8_t)gpio_read(gpio));
+  }
+}
+
+void checkHPDstatus() {
+  isUSBCVideo = gpio_read(HPD);
+}
+
+// HPD floats while MelonHD is unpowered
+void hpdSuspend() {
+  if (!isPowered) {
+    gpio_config(HPD, PORT_ISC_INPUT_DISABLE_gc);
+  }
+}
+
+void hpdResume() {
+  gpio_config(HPD, PORT_ISC_BOTHEDGES_gc);
+  checkHPDstatus();
+}
+
+static void snapshotPort(PORT_t *port, uint8_t held, struct sleep_port *out) {
+  out->input = ~port->DIR;
+  out->buffered = 0;
+  out->pullup = 0;
+  out->held = held;
+  for (uint8_t i = 0; i < 8; i++) {
+    uint8_t ctrl = (&port->PIN0CTRL)[i];
+    if ((ctrl & PORT_ISC_gm) != PORT_ISC_INPUT_DISABLE_gc) {
+      out->buffered |= 1 << i;
+    }
+    if (ctrl & PORT_PULLUPEN_bm) {
+      out->pullup |= 1 << i;
+    }
+  }
+}
+
+// Check nothing is left drawing current, right before sleeping. Logged after waking, when it changes
+void sleepAudit() {
+  struct sleep_snapshot snap;
+  snapshotPort(&PORTA, SLEEP_HELD_A, &snap.port[0]);
+  snapshotPort(&PORTB, SLEEP_HELD_B | (isPowered ? (1 << HPD.num) : 0), &snap.port[1]);
+  snapshotPort(&PORTC, SLEEP_HELD_C, &snap.port[2]);
+
+  snap.periphs = 0;
+  if ((TCA0.SINGLE.CTRLB & TCA_SINGLE_CMP2EN_bm) && !(TCA0.SINGLE.CTRLA & TCA_SINGLE_ENABLE_bm)) {
+    snap.periphs |= 1 << SLEEP_FAN_PWM;
   }
-  else if (battVolt > battChrgLevels[2]) {
-    powerLED(2); // Medium charge
+  if (USART0.CTRLB & USART_TXEN_bm) {
+    snap.periphs |= 1 << SLEEP_USART_TX;
   }
-  else if (battVolt > battChrgLevels[1]) {
-    powerLED(3); // Low charge
+  if (TWI0.MCTRLA & TWI_ENABLE_bm) {
+    snap.periphs |= 1 << SLEEP_TWI_MASTER;
   }
-  else if (battVolt <= battChrgLevels[1]) {
-    powerLED(4); // ABOUT TO RUN OUT
+  if (ADC0.CTRLA & ADC_ENABLE_bm) {
+    snap.periphs |= 1 << SLEEP_ADC;
+  }
+
+  struct sleep_leaks leaks;
+  sleep_audit(&snap, &leaks);
+  if (memcmp(&leaks, &sleepLeaks, sizeof(leaks)) != 0) {
+    sleepLeaks = leaks;
+    sleepLeaksNew = true;
   }
 }
 
-void checkHPDstatus() {
-  isUSBCVideo = gpio_read(HPD);
+void logSleepLeaks() {
+  bool leaky = false;
+  for (uint8_t i = 0; i < SLEEP_AUDIT_PORTS; i++) {
+    if (sleepLeaks.floating[i]) {
+      TLOG_WAIT(LOG_SLEEP_FLOATING, (char)('A' + i), sleepLeaks.floating[i]);
+      leaky = true;
+    }
+  }
+  for (uint8_t i = 0; i < SLEEP_PERIPHS; i++) {
+    if (sleepLeaks.periphs & (1 << i)) {
+      TLOG_WAIT(LOG_SLEEP_PERIPH, i);
+      leaky = true;
+    }
+  }
+  if (!leaky) {
+    TLOG_WAIT(LOG_SLEEP_CLEAN);
+  }
 }
 
-void communicateWithPi() {
-  /*
-  Register key:
-  - 0x01: Status flags, uint8_t. Bits 0-3 represent isPowered, isCharging, isFault, and isUSBCVideo respectively. Bits 4-5 represent chargeStatus.
-  - 0x02: Power error status, pwrErrorStatus. 8-bit unsigned int.
-  - 0x03: Fan speed, fanSpeed. 8-bit unsigned int.
-  - 0x04: Battery charge percentage, battCharge. 8-bit unsigned int.
-  - 0x05: Battery voltage (mV), battVolt. 16-bit word.
-  - 0x06: Charging current, chrgCurrent. 16-bit word.
-  - 0x07: Pre-charge current, preCurrent. 16-bit word.
-  - 0x08: Termination charge current, termCurrent. 16-bit word.
-  - 0x09: Charging voltage, chrgVoltage. 16-bit word.
-  */
+// Register being read as a 16-bit pair, and its latched high byte
+uint8_t regLatchAddr = 0xFF;
+uint8_t regLatch = 0x00;
+
+// 16-bit values served to the Pi, copied as a whole from the main loop, so the
+// TWI interrupt never reads one half-way through an update or works one out
+struct pi_snapshot {
+  uint16_t battVolt;
+  uint16_t chrgCurrent;
+  uint16_t preCurrent;
+  uint16_t termCurrent;
+  uint16_t chrgVoltage;
+  uint16_t tteMin;
+  uint16_t ttfMin;
+  int16_t battCurrent;
+  uint16_t cycles;
+  uint16_t highVoltHours;
+  uint16_t hotHours;
+  uint16_t capacity;
+  uint16_t health;
+  uint16_t chrgVoltageAged;
+  uint16_t stackHigh;
+};
+struct pi_snapshot piRegs;
+
+void publishRegisters() {
+  struct pi_snapshot snap;
+  snap.battVolt = battVolt;
+  snap.chrgCurrent = chrgCurrent;
+  snap.preCurrent = preCurrent;
+  snap.termCurrent = termCurrent;
+  snap.chrgVoltage = chrgVoltage;
+  snap.tteMin = runtimeEst.tte_min;
+  snap.ttfMin = runtimeEst.ttf_min;
+  snap.battCurrent = runtime_est_current(&runtimeEst);
+  snap.cycles = battHealth.data.cycles_x10;
+  snap.highVoltHours = battHealth.data.high_volt_h;
+  snap.hotHours = battHealth.data.hot_h;
+  snap.capacity = battHealth.data.capacity_mah;
+  snap.health = ((uint16_t)battHealth.data.measurements << 8) | batt_health_soh(&battHealth, battProfile->capacity_mah);
+  snap.chrgVoltageAged = chargeVoltage();
+  snap.stackHigh = stackHigh;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    piRegs = snap;
+  }
 }
 
+// Power stats in the Pi register map: wakeups, then minutes in each state, then events
+uint16_t readStatsWord(uint8_t index) {
+  struct pstats stats;
+  pstats_get(&stats);
+
+  if (index < PSTATS_WAKES) {
+    return stats.wakeups[index];
+  }
+  index -= PSTATS_WAKES;
+  if (index < PSTATS_STATES) {
+    return stats.state_ms[index] / 60000;
+  }
+  return stats.events[index - PSTATS_STATES];
+}
+
+// I2C controller error counters in the Pi register map
+uint16_t readI2CStatsWord(uint8_t reg) {
+  struct i2c_stats stats;
+  i2c_get_stats(&stats);
+
+  switch (reg) {
+    case PI_REG_I2C_NACK:      return stats.nack;
+    case PI_REG_I2C_ARB_LOST:  return stats.arb_lost;
+    case PI_REG_I2C_BUS_ERR:   return stats.bus_err;
+    case PI_REG_I2C_TIMEOUT:   return stats.timeout;
+    default:                   return stats.recoveries;
+  }
+}
+
+uint16_t readRegisterWord(uint8_t reg) {
+  if (reg >= PI_REG_CFG_FIRST && reg < PI_REG_CFG_COMMIT) {
+    return cfgShadow.value[(reg - PI_REG_CFG_FIRST) >> 1];
+  }
+  if (reg >= PI_REG_PSTATS_FIRST && reg < PI_REG_PSTATS_RESET) {
+    return readStatsWord((reg - PI_REG_PSTATS_FIRST) >> 1);
+  }
+
+  switch (reg) {
+    case PI_REG_BATT_VOLT:     return piRegs.battVolt;
+    case PI_REG_CHRG_CURRENT:  return piRegs.chrgCurrent;
+    case PI_REG_PRE_CURRENT:   return piRegs.preCurrent;
+    case PI_REG_TERM_CURRENT:  return piRegs.termCurrent;
+    case PI_REG_CHRG_VOLTAGE:  return piRegs.chrgVoltage;
+    case PI_REG_TIME_TO_EMPTY: return piRegs.tteMin;
+    case PI_REG_TIME_TO_FULL:  return piRegs.ttfMin;
+    case PI_REG_BATT_CURRENT:  return (uint16_t)piRegs.battCurrent;
+    case PI_REG_I2C_NACK:
+    case PI_REG_I2C_ARB_LOST:
+    case PI_REG_I2C_BUS_ERR:
+    case PI_REG_I2C_TIMEOUT:
+    case PI_REG_I2C_RECOVERIES: return readI2CStatsWord(reg);
+    case PI_REG_STACK_HIGH:    return piRegs.stackHigh;
+    case PI_REG_BATT_PROFILE:  return ((uint16_t)BATT_PROFILES << 8) | battProfileId;
+    case PI_REG_RESET_CAUSE:   return ((uint16_t)wdtResets << 8) | watchdog_reset_cause();
+    case PI_REG_CFG_COMMIT:    return ((uint16_t)cfgField << 8) | cfgStatus;
+    case PI_REG_CYCLES:        return piRegs.cycles;
+    case PI_REG_HIGH_VOLT_HOURS: return piRegs.highVoltHours;
+    case PI_REG_HOT_HOURS:     return piRegs.hotHours;
+    case PI_REG_CAPACITY:      return piRegs.capacity;
+    case PI_REG_HEALTH:        return piRegs.health;
+    case PI_REG_CHRG_VOLTAGE_AGED: return piRegs.chrgVoltageAged;
+#ifdef BOOTLOADER
+    case PI_REG_BOOT:          return BOOT_ID;
+#endif
+    default:                   return 0xFFFF;
+  }
+}
+
+int handle_register_read(uint8_t reg, uint8_t *value) {
+  switch (reg) {
+    case PI_REG_VERSION:
+      *value = ver;
+      return 0;
+    case PI_REG_STATUS:
+      *value = (isPowered ? PI_STATUS_POWERED : 0) | (isCharging ? PI_STATUS_CHARGING : 0) |
+               (isFault ? PI_STATUS_FAULT : 0) | (isUSBCVideo ? PI_STATUS_USBC_VIDEO : 0) |
+               (chargeStatus << PI_STATUS_CHRG_POS);
+      return 0;
+    case PI_REG_FAULT:
+      *value = pwrErrorStatus;
+      return 0;
+    case PI_REG_FAN_SPEED:
+      *value = fanSpeed;
+      return 0;
+    case PI_REG_CHARGE:
+      *value = battCharge;
+      return 0;
+  }
+
+  if (reg < PI_REG_BATT_VOLT || reg >= PI_REG_END) {
+    *value = 0xFF; // Unused register
+    return -1;
+  }
+
+  if (((reg - PI_REG_BATT_VOLT) & 1) == 0) { // Low byte, latch the high byte
+    uint16_t word = readRegisterWord(reg);
+    *value = word & 0xFF;
+    regLatch = word >> 8;
+    regLatchAddr = reg + 1;
+  }
+  else if (regLatchAddr == reg) { // High byte, following the low byte
+    *value = regLatch;
+    regLatchAddr = 0xFF;
+  }
+  else { // High byte on its own
+    *value = readRegisterWord(reg - 1) >> 8;
+  }
+  return 0;
+}
+
+int handle_register_write(uint8_t reg, uint8_t value) {
+  if (reg >= PI_REG_CFG_FIRST && reg < PI_REG_CFG_COMMIT) {
+    if (cfgStatus == PI_CFG_PENDING) {
+      return -1; // Being applied, stage again after the commit
+    }
+    uint16_t *field = &cfgShadow.value[(reg - PI_REG_CFG_FIRST) >> 1];
+    if (((reg - PI_REG_CFG_FIRST) & 1) == 0) {
+      *field = (*field & 0xFF00) | value;
+    }
+    else {
+      *field = (*field & 0x00FF) | ((uint16_t)value << 8);
+    }
+    return 0;
+  }
+
+  switch (reg) {
+    case PI_REG_CFG_COMMIT:
+      if (cfgStatus == PI_CFG_PENDING) {
+        return -1;
+      }
+      if (value == PI_CFG_COMMIT) {
+        cfgStatus = PI_CFG_PENDING; // Applied by the config task, not from the interrupt
+        return 0;
+      }
+      if (value == PI_CFG_REVERT) {
+        syncConfigShadow();
+        return 0;
+      }
+      return -1;
+    case PI_REG_PSTATS_RESET:
+      if (value == PI_PSTATS_RESET) {
+        statsResetReq = true;
+        return 0;
+      }
+      return -1;
+    case PI_REG_BATT_PROFILE:
+      if (value < BATT_PROFILES) {
+        battProfileReq = value;
+        return 0;
+      }
+      return -1;
+#ifdef BOOTLOADER
+    case PI_REG_BOOT:
+      if (value == BOOT_KEY) {
+        bootReq = true; // Entered from the config task, once the transfer is over
+        return 0;
+      }
+      return -1;
+#endif
+  }
+  return -1; // Everything else is read-only
+}
+
+void consoleTask() {
+  char line[CONSOLE_LINE_MAX];
+  if (console_readline(line, sizeof(line)) && !console_dispatch(line, commands, COMMAND_COUNT)) {
+    TLOG_WAIT(LOG_CONSOLE_UNKNOWN);
+  }
+}
+
+void cmdStatus(const char *args) {
+  TLOG_WAIT(LOG_STATUS_BATT, battVolt, (uint16_t)battCharge, runtime_est_current(&runtimeEst),
+            runtime_est_power(&runtimeEst));
+  TLOG_WAIT(LOG_STATUS_TIME, runtimeEst.tte_min, runtimeEst.ttf_min);
+  TLOG_WAIT(LOG_STATUS_PWR, (uint8_t)isPowered, (uint8_t)isCharging, (uint8_t)chargeStatus, pwrErrorStatus);
+  TLOG_WAIT(LOG_DROPPED, tlog_dropped());
+}
+
+void cmdBoot(const char *args) {
+  TLOG_WAIT(LOG_RESET_CAUSE, watchdog_reset_cause(), wdtResets);
+  boot_trace_dump();
+}
+
+void cmdI2C(const char *args) {
+  struct i2c_stats stats;
+  i2c_get_stats(&stats);
+  TLOG_WAIT(LOG_I2C_STATS, stats.nack, stats.arb_lost, stats.bus_err, stats.timeout, stats.recoveries);
+}
+
+void cmdStack(const char *args) {
+  TLOG_WAIT(LOG_STACK, stack_high_water(), stack_size());
+}
+
+// "batt" shows the active profile, "batt <n>" switches to profile n
+void cmdBatt(const char *args) {
+  if (*args) {
+    uint8_t id = 0;
+    for (; *args >= '0' && *args <= '9'; args++) {
+      id = id * 10 + (*args - '0');
+    }
+    if (*args || id >= BATT_PROFILES) {
+      TLOG_WAIT(LOG_CONSOLE_UNKNOWN);
+      return;
+    }
+    battProfileReq = id;
+    return;
+  }
+  TLOG_WAIT(LOG_BATT_PROFILE, battProfileId);
+}
+
+// "power" dumps the wakeup and power state counters, "power reset" clears them
+void cmdPower(const char *args) {
+  if (strcmp(args, "reset") == 0) {
+    pstats_reset();
+    return;
+  }
+  pstats_dump();
+}
+
+// "health" shows how the pack has aged
+void cmdHealth(const char *args) {
+  TLOG_WAIT(LOG_HEALTH_CYCLES, battHealth.data.cycles_x10 / 10, battHealth.data.cycles_x10 % 10,
+            battHealth.data.high_volt_h, battHealth.data.hot_h, battHealth.data.max_temp_c);
+  TLOG_WAIT(LOG_HEALTH_CAPACITY, battHealth.data.capacity_mah, batt_health_soh(&battHealth, battProfile->capacity_mah),
+            battHealth.data.measurements);
+  TLOG_WAIT(LOG_HEALTH_VREG, chargeVoltage());
+}
+
+// "sleep" shows what the audit found going into the last sleep
+void cmdSleep(const char *args) {
+  logSleepLeaks();
+}
+
+// "trace on" records for sim/replay, "trace off" stops
+void cmdTrace(const char *args) {
+  if (strcmp(args, "on") == 0) {
+    TLOG_WAIT(LOG_BATT_PROFILE, battProfileId); // The replay needs the cells' cut-off
+    isTracing = true;
+    return;
+  }
+  isTracing = false;
+}
+
+#ifdef PROF_ENABLE
+void cmdProf(const char *args) {
+  if (strcmp(args, "reset") == 0) {
+    prof_reset();
+    return;
+  }
+  prof_dump();
+}
+#endif
+
 int main() {
   if (!setup()) {
     return 0;
@@ -477,28 +1508,39 @@ int main() {
   return 1;
 }
 
+// The port interrupts only note what happened. The main loop acts on it, with
+// interrupts enabled and the watchdog fed by the scheduler as usual
 ISR(PORTA_PORT_vect) {
-  rtc_init();
-  button_update(&pwr_button, rtc_millis());
+  PROF_BEGIN(PROF_ISR_PORTA);
+  // Every start bit on the shared RX pin lands here first. If the receiver saw
+  // one, its interrupt tells a console byte from a press once the frame is in
+  if (!(USART0.STATUS & USART_RXSIF_bm)) {
+    pstats_wake(PSTATS_WAKE_BUTTON);
+  }
+  pinEvents |= PIN_EVENT_BUTTON;
   PORTA.INTFLAGS = 0xFF;
-  loop();
+  PROF_END(PROF_ISR_PORTA);
 }
 
 ISR(PORTB_PORT_vect) {
+  PROF_BEGIN(PROF_ISR_PORTB);
+  pstats_wake(gpio_read_intflag(HPD) ? PSTATS_WAKE_HPD : PSTATS_WAKE_TEMP_ALERT);
   if (gpio_read_intflag(TEMP_ALERT) || !gpio_read(TEMP_ALERT)) {
-    overTemp();
+    pinEvents |= PIN_EVENT_TEMP_ALERT;
   }
   if (gpio_read_intflag(HPD)) {
-    checkHPDstatus();
+    pinEvents |= PIN_EVENT_HPD;
   }
   PORTB.INTFLAGS = 0xFF;
-  loop();
+  PROF_END(PROF_ISR_PORTB);
 }
 
 ISR(PORTC_PORT_vect) {
+  PROF_BEGIN(PROF_ISR_PORTC);
+  pstats_wake(PSTATS_WAKE_BQ_INT);
   if (gpio_read_intflag(BQ_INT) || !gpio_read(BQ_INT)) {
-    monitorBatt();
+    pinEvents |= PIN_EVENT_BQ_INT;
   }
   PORTC.INTFLAGS = 0xFF;
-  loop();
+  PROF_END(PROF_ISR_PORTC);
 }
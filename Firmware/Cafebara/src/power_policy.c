@@ -0,0 +1,69 @@
+/*
+ * Power decisions.
+ *
+ * Any fault turns the console off. Thermal and battery over-voltage faults
+ * go further, and leave the LED to the shutdown that follows. Otherwise the
+ * LED follows the charge state, and the pack's charge while running from it.
+ */
+
+#include "power_policy.h"
+
+bool power_charger_read(bq25895_t const *bq, struct power_charger *c)
+{
+  bool ok = bq25895_is_charger_connected(bq, &c->connected);
+  ok &= bq25895_get_charge_state(bq, &c->state);
+  ok &= bq25895_check_faults(bq, &c->faults);
+  return ok;
+}
+
+enum power_action power_charger_decide(struct power_charger const *c, bool powered, uint8_t *led)
+{
+  enum power_action action = POWER_NONE;
+
+  *led = POWER_LED_KEEP;
+  if (c->faults != BQ_FAULT_NONE) {
+    if (c->faults & BQ_FAULT_THERM) {
+      return POWER_OVERTEMP;
+    }
+    if (c->faults & BQ_FAULT_BAT) {
+      return POWER_SHIP;
+    }
+    action = POWER_FAULT;
+    powered = false; // Turned off before the LED is shown
+  }
+
+  if (c->state == BQ_STATE_NOT_CHARGING) {
+    if (!powered) {
+      *led = 0; // Not on, not charging
+    }
+  }
+  else if (c->state == BQ_STATE_TERMINATED) {
+    *led = 7; // Finished charging
+  }
+  else {
+    *led = 6; // Charging, not complete
+  }
+  return action;
+}
+
+enum power_action power_battery_decide(uint8_t soc, uint16_t vbat_mv, uint16_t cutoff_mv, uint8_t *led)
+{
+  if (soc == 0 || vbat_mv < cutoff_mv) {
+    *led = POWER_LED_ERROR; // Empty, or sagging dangerously low under load
+    return POWER_EMPTY;
+  }
+
+  if (soc > 0xA0) {
+    *led = 1; // High charge
+  }
+  else if (soc > 0x40) {
+    *led = 2; // Medium charge
+  }
+  else if (soc > 0x20) {
+    *led = 3; // Low charge
+  }
+  else {
+    *led = 4; // About to run out
+  }
+  return POWER_NONE;
+}
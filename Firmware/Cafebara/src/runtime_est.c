@@ -0,0 +1,71 @@
+/*
+ * Incremental time-to-empty / time-to-full estimation.
+ *
+ * Time to empty is based on power rather than current, as the console's
+ * regulators draw roughly constant power: the current rises as the pack sags.
+ */
+
+#include "runtime_est.h"
+
+// Averaging weight of each new sample, as a shift (1/32, ~30 s at 1 Hz)
+#define RUNTIME_EST_SHIFT 5
+
+// Below this the pack is considered idle, and no estimate is given
+#define RUNTIME_EST_IDLE_MA 20
+
+void runtime_est_init(struct runtime_est *rt)
+{
+  rt->current_avg = 0;
+  rt->power_avg   = 0;
+  rt->tte_min     = RUNTIME_UNKNOWN;
+  rt->ttf_min     = RUNTIME_UNKNOWN;
+}
+
+int16_t runtime_est_current(struct runtime_est const *rt)
+{
+  return (int16_t)(rt->current_avg >> RUNTIME_EST_SHIFT);
+}
+
+int32_t runtime_est_power(struct runtime_est const *rt)
+{
+  return rt->power_avg >> RUNTIME_EST_SHIFT;
+}
+
+// Clamp a minute count into the 16-bit register range
+static uint16_t runtime_est_minutes(uint32_t min)
+{
+  return (min >= RUNTIME_UNKNOWN) ? RUNTIME_UNKNOWN - 1 : (uint16_t)min;
+}
+
+void runtime_est_update(struct runtime_est *rt, int16_t current_ma, uint16_t vbat_mv, uint32_t charge_mas,
+                        uint32_t capacity_mas)
+{
+  int32_t current = current_ma;
+  int32_t power   = (current * vbat_mv) / 1000;
+
+  // Restart the averages when switching between charging and discharging,
+  // rather than waiting for the old direction to decay
+  if ((current < 0) != (rt->current_avg < 0)) {
+    rt->current_avg = current * (1L << RUNTIME_EST_SHIFT);
+    rt->power_avg   = power * (1L << RUNTIME_EST_SHIFT);
+  } else {
+    rt->current_avg += current - (rt->current_avg >> RUNTIME_EST_SHIFT);
+    rt->power_avg += power - (rt->power_avg >> RUNTIME_EST_SHIFT);
+  }
+
+  int32_t avg_ma = runtime_est_current(rt);
+  int32_t avg_mw = runtime_est_power(rt);
+
+  rt->tte_min = RUNTIME_UNKNOWN;
+  rt->ttf_min = RUNTIME_UNKNOWN;
+
+  if (avg_ma <= -RUNTIME_EST_IDLE_MA && avg_mw < 0) {
+    // Remaining energy (mA*min * mV) over the power drawn (uW)
+    uint32_t energy = (charge_mas / 60) * vbat_mv;
+    rt->tte_min     = runtime_est_minutes(energy / ((uint32_t)(-avg_mw) * 1000));
+  } else if (avg_ma >= RUNTIME_EST_IDLE_MA && charge_mas < capacity_mas) {
+    rt->ttf_min = runtime_est_minutes(((capacity_mas - charge_mas) / 60) / (uint32_t)avg_ma);
+  } else if (avg_ma >= RUNTIME_EST_IDLE_MA) {
+    rt->ttf_min = 0;
+  }
+}
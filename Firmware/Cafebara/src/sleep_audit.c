@@ -0,0 +1,26 @@
+/*
+ * Sleep current audit.
+ *
+ * A floating input with its buffer on drifts through the switching threshold
+ * and draws crossbar current: it needs a pull-up, something outside driving
+ * it, or the buffer off. Outputs are fine in either state, as long as nothing
+ * else is driving the same net.
+ */
+
+#include "sleep_audit.h"
+
+bool sleep_audit(struct sleep_snapshot const *snap, struct sleep_leaks *leaks)
+{
+  bool leaky = false;
+
+  for (uint8_t i = 0; i < SLEEP_AUDIT_PORTS; i++) {
+    struct sleep_port const *p = &snap->port[i];
+    leaks->floating[i] = p->input & p->buffered & ~p->pullup & ~p->held;
+    leaky |= leaks->floating[i] != 0;
+  }
+
+  leaks->periphs = snap->periphs & ((1 << SLEEP_PERIPHS) - 1);
+  leaky |= leaks->periphs != 0;
+
+  return leaky;
+}
@@ -0,0 +1,154 @@
+/*
+ * Fixed-point battery state-of-charge estimator.
+ *
+ * The correction is a fixed-gain blend rather than a full Kalman filter: a
+ * small gain once the pack has been resting for a while (the OCV is trusted),
+ * and none at all while current is flowing (only the coulomb count is).
+ */
+
+#include "soc.h"
+
+// Current below which the pack is considered to be at rest
+#define SOC_REST_MA      50
+
+// Blend towards OCV while resting, and after a long unobserved rest (as a shift)
+#define SOC_REST_GAIN    3  // 1/8 per update
+#define SOC_WAKE_GAIN    1  // 1/2
+
+// Longest interval integrated in one update, protects against clock jumps
+#define SOC_MAX_DT_MS    60000UL
+
+// Convert between remaining charge and the 0x00-0xFF scale
+static uint8_t soc_scale(struct soc_est const *est)
+{
+  uint32_t soc = est->charge_mas / est->unit_mas;
+  return (soc > SOC_FULL) ? SOC_FULL : (uint8_t)soc;
+}
+
+static uint32_t soc_charge(struct soc_est const *est, uint8_t soc)
+{
+  return (soc == SOC_FULL) ? est->capacity_mas : est->unit_mas * soc;
+}
+
+// Expected OCV at a state of charge
+static uint16_t soc_to_ocv(const struct soc_curve *curve, uint8_t soc)
+{
+  const uint16_t *ocv = curve->ocv;
+
+  // SOC_OCV_POINTS - 1 segments of 32 counts each
+  uint8_t i = soc >> 5;
+  if (i >= SOC_OCV_POINTS - 1) {
+    return ocv[SOC_OCV_POINTS - 1];
+  }
+  return ocv[i] + (uint16_t)(((uint32_t)(ocv[i + 1] - ocv[i]) * (soc & 0x1F)) >> 5);
+}
+
+uint8_t soc_from_ocv(const struct soc_curve *curve, uint16_t mv)
+{
+  if (mv <= curve->lut_base_mv) {
+    return 0;
+  }
+
+  uint16_t i = (mv - curve->lut_base_mv) >> curve->lut_shift;
+  return (i < SOC_LUT_SIZE) ? curve->lut[i] : SOC_FULL;
+}
+
+// Move the remaining charge towards the OCV estimate, by 1 / 2^shift
+static void soc_blend(struct soc_est *est, uint16_t vbat_mv, uint8_t shift)
+{
+  int32_t target = (int32_t)soc_charge(est, soc_from_ocv(est->curve, vbat_mv));
+  int32_t charge = (int32_t)est->charge_mas;
+
+  est->charge_mas = (uint32_t)(charge + ((target - charge) >> shift));
+  est->soc        = soc_scale(est);
+}
+
+void soc_init(struct soc_est *est, const struct soc_curve *curve, uint16_t capacity_mah, uint8_t soc,
+              uint32_t now_ms)
+{
+  est->curve        = curve;
+  est->capacity_mas = (uint32_t)capacity_mah * 3600;
+  est->unit_mas     = est->capacity_mas / SOC_FULL;
+  est->charge_mas   = soc_charge(est, soc);
+  est->residue      = 0;
+  est->last_ms      = now_ms;
+  est->rest_ms      = 0;
+  est->current_ma   = 0;
+  est->soc          = soc;
+}
+
+void soc_update(struct soc_est *est, uint16_t vbat_mv, uint16_t ichg_ma, bool loaded, uint16_t r_mohm,
+                uint32_t now_ms)
+{
+  uint32_t dt = now_ms - est->last_ms;
+  est->last_ms = now_ms;
+  if (dt > SOC_MAX_DT_MS) {
+    dt = SOC_MAX_DT_MS;
+  }
+
+  // Pack current, positive when charging
+  int32_t current = 0;
+  if (ichg_ma > 0) {
+    current = ichg_ma;
+  } else if (loaded && r_mohm > 0) {
+    uint16_t ocv = soc_to_ocv(est->curve, est->soc);
+    if (ocv > vbat_mv) {
+      current = -(int32_t)(((uint32_t)(ocv - vbat_mv) * 1000) / r_mohm);
+    }
+  }
+  // A small calibrated resistance with a stale charge can estimate past the
+  // 16-bit range, which would wrap to a charge current
+  if (current < INT16_MIN) {
+    current = INT16_MIN;
+  } else if (current > INT16_MAX) {
+    current = INT16_MAX;
+  }
+  est->current_ma = (int16_t)current;
+
+  // Coulomb count, carrying the sub-mAs remainder between updates
+  int32_t acc  = est->residue + current * (int32_t)dt;
+  int32_t mas  = acc / 1000;
+  est->residue = acc - mas * 1000;
+
+  if (mas < 0 && (uint32_t)(-mas) > est->charge_mas) {
+    est->charge_mas = 0;
+  } else {
+    est->charge_mas += mas;
+  }
+  if (est->charge_mas > est->capacity_mas) {
+    est->charge_mas = est->capacity_mas;
+  }
+  est->soc = soc_scale(est);
+
+  // Once the pack has settled, the voltage is a good measure of charge
+  if (current > -SOC_REST_MA && current < SOC_REST_MA) {
+    est->rest_ms += dt;
+    if (est->rest_ms >= SOC_REST_MS) {
+      est->rest_ms = SOC_REST_MS;
+      soc_blend(est, vbat_mv, SOC_REST_GAIN);
+    }
+  } else {
+    est->rest_ms = 0;
+  }
+}
+
+void soc_rested(struct soc_est *est, uint16_t vbat_mv, uint32_t rested_ms, uint32_t now_ms)
+{
+  est->last_ms = now_ms;
+
+  // A short nap hasn't let the pack relax, it only adds to the time at rest
+  if (rested_ms >= SOC_REST_MS - est->rest_ms) {
+    est->rest_ms = SOC_REST_MS;
+    soc_blend(est, vbat_mv, (rested_ms >= SOC_REST_MS) ? SOC_WAKE_GAIN : SOC_REST_GAIN);
+  } else {
+    est->rest_ms += rested_ms;
+  }
+}
+
+void soc_set_full(struct soc_est *est)
+{
+  est->charge_mas = est->capacity_mas;
+  est->residue    = 0;
+  est->current_ma = 0;
+  est->soc        = SOC_FULL;
+}
@@ -0,0 +1,60 @@
+/*
+ * Stack painting and high-water mark.
+ *
+ * There is no heap, so everything above _end belongs to the stack.
+ */
+
+#if defined(AVR)
+
+#include <avr/io.h>
+
+#include "stack.h"
+
+#define STACK_CANARY 0xC5
+
+// End of .bss, from the linker
+extern uint8_t _end;
+
+// Runs from .init1, before the stack pointer or r1 are set up, so nothing here
+// can use the stack or rely on the compiler's registers
+void stack_paint(void) __attribute__((naked, used, section(".init1")));
+void stack_paint(void)
+{
+  __asm__ volatile(
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, %[canary]\n"
+    "    ldi r25, hi8(%[top])\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(%[top])\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n"
+    :
+    : [canary] "M" (STACK_CANARY), [top] "i" (RAMEND)
+  );
+}
+
+uint16_t stack_size(void)
+{
+  return RAMEND + 1 - (uint16_t)&_end;
+}
+
+uint16_t stack_unused(void)
+{
+  const uint8_t *p = &_end;
+
+  // The stack grows down, so the untouched bytes are the ones nearest _end
+  while (p <= (const uint8_t *)RAMEND && *p == STACK_CANARY)
+    p++;
+
+  return p - &_end;
+}
+
+uint16_t stack_high_water(void)
+{
+  return stack_size() - stack_unused();
+}
+
+#endif // defined(AVR)
@@ -0,0 +1,22 @@
+/*
+ * Minimal TMP1075N temperature sensor support.
+ */
+
+#include "tmp1075.h"
+
+#include "i2c.h"
+
+bool tmp1075_get_temp(uint8_t addr, int8_t *temp_c)
+{
+  uint8_t reg = TMP1075_REG_TEMP;
+  uint8_t buf[2];
+
+  if (i2c_write_read(addr, &reg, 1, buf, 2) != 0) {
+    return false;
+  }
+
+  // Big-endian, left-justified 12-bit value, 0.0625C per LSB
+  int16_t raw = (int16_t)((buf[0] << 8) | buf[1]) >> 4;
+  *temp_c = (int8_t)((raw + 8) >> 4);
+  return true;
+}
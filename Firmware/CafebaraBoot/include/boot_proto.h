@@ -0,0 +1,77 @@
+/**
+ * I2C bootloader protocol, shared by the bootloader, the Cafebara firmware and
+ * Cafebara/scripts/i2c_update.py.
+ *
+ * The bootloader answers at the firmware's Pi address. Every write starts with
+ * a command byte followed by its arguments, and is acted on at the STOP. A read
+ * returns the status block: BOOT_ID, the status of the last command (see
+ * BOOT_STATUS_*), BOOT_PAGE_SIZE and BOOT_SIZE / 256. Writing BOOT_CMD_STATUS
+ * first makes the same transfer work for the firmware, where it reads
+ * PI_REG_VERSION instead of BOOT_ID.
+ *
+ * An update is BOOT_CMD_BEGIN, one BOOT_CMD_PAGE per page of the image, in any
+ * order, then BOOT_CMD_FINISH and BOOT_CMD_RUN. The CPU halts while a page is
+ * written, so the bus is stretched or NACKed for a few ms after each page;
+ * retry the status read until it succeeds.
+ */
+
+#pragma once
+
+/** BOOT section size, FUSE.BOOTEND = BOOT_SIZE / 256. The firmware starts here */
+#define BOOT_SIZE             0x0800
+
+/** Flash page, the data of one BOOT_CMD_PAGE */
+#define BOOT_PAGE_SIZE        64
+
+/** Identifies the bootloader in the first byte of the status block */
+#define BOOT_ID               0xB0
+
+/** Select the status block, no arguments */
+#define BOOT_CMD_STATUS       0x00
+
+/** BOOT_KEY: mark the firmware invalid and start an update */
+#define BOOT_CMD_BEGIN        0x01
+
+/** Flash address (uint16_t), then BOOT_PAGE_SIZE bytes: erase and write one page */
+#define BOOT_CMD_PAGE         0x02
+
+/**
+ * Image length (uint16_t) and CRC-16/CCITT of the image (uint16_t, initial
+ * value 0xFFFF, reflected, as _crc_ccitt_update()): check what was written,
+ * from BOOT_SIZE, and mark the firmware valid if it matches
+ */
+#define BOOT_CMD_FINISH       0x03
+
+/** BOOT_KEY: start the firmware, if it is valid */
+#define BOOT_CMD_RUN          0x04
+
+/** Argument of BOOT_CMD_BEGIN and BOOT_CMD_RUN, and of the firmware's PI_REG_BOOT */
+#define BOOT_KEY              0xB5
+
+/**
+ * Command status.
+ */
+#define BOOT_STATUS_IDLE      0         // Nothing received since the bootloader started
+#define BOOT_STATUS_OK        1         // Last command done
+#define BOOT_STATUS_ERR_CMD   2         // Unknown command, wrong key or length
+#define BOOT_STATUS_ERR_ADDR  3         // Page not aligned, or outside the firmware
+#define BOOT_STATUS_ERR_ORDER 4         // Page or finish without a begin, or run without a valid firmware
+#define BOOT_STATUS_ERR_CRC   5         // Image doesn't match the CRC, still invalid
+
+/**
+ * Firmware state, in the last EEPROM byte, clear of the firmware's settings.
+ * Anything but BOOT_STATE_UPDATING, including a blank EEPROM, is a firmware
+ * that can be started.
+ */
+#define BOOT_EE_STATE         (EEPROM_SIZE - 1)
+#define BOOT_STATE_UPDATING   0x00
+#define BOOT_STATE_VALID      0xFF
+
+/**
+ * Hand-over between the bootloader and the firmware, without a reset. The
+ * firmware jumps to address 0 with BOOT_HANDOFF in GPIOR0 to keep the
+ * bootloader resident. The bootloader starts the firmware with BOOT_HANDOFF
+ * in GPIOR0 and the state to keep in GPIOR1, see BOOT_HANDOFF_*.
+ */
+#define BOOT_HANDOFF          0xB5
+#define BOOT_HANDOFF_POWERED  (1 << 0)  // Console powered, keep PWR_EN high
@@ -0,0 +1,269 @@
+/*
+ * I2C bootloader.
+ *
+ * Starts the Cafebara firmware straight away, unless the firmware asked for
+ * an update or the last one didn't finish. Then it stays resident with the
+ * console powered, and takes the new image from the Pi over its I2C bus, see
+ * boot_proto.h. Polled, with interrupts off: the vectors in flash are the
+ * firmware's. If the pack sags under the console while waiting, the console
+ * is switched off until the button is pressed.
+ */
+
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <util/crc16.h>
+
+#include "boot_proto.h"
+
+#define PI_I2C_ADDR 0x20
+#define PWR_EN_bm   PIN3_bm   // PC3, the console's regulators
+#define BUTTON_bm   PIN2_bm   // PA2, pulled up, low while pressed
+#define VLM_LEVEL   BOD_VLMLVL_15ABOVE_gc // The firmware's hard cut-off, ~3.0V with the BOD at 2.6V
+
+// Flash as data, where the page buffer is loaded and the image is read back
+#define FLASH_BYTE(addr) (*(volatile uint8_t *)(MAPPED_PROGMEM_START + (addr)))
+
+// Command being received: the command byte, its arguments, and the page
+// address once the first two arguments of a BOOT_CMD_PAGE are in
+static uint8_t cmd;
+static uint8_t args[4];
+static uint8_t len = 0;         // Bytes received, including the command
+static uint16_t page_addr;
+static bool page_ok = false;    // Page address accepted, data goes to the page buffer
+
+static uint8_t status   = BOOT_STATUS_IDLE;
+static bool updating    = false; // BOOT_CMD_BEGIN received, the firmware is marked invalid
+static bool receiving   = false; // Addressed for a write
+static uint8_t read_index = 0;
+
+static bool firmware_valid()
+{
+  return eeprom_read_byte((const uint8_t *)BOOT_EE_STATE) != BOOT_STATE_UPDATING &&
+         (FLASH_BYTE(BOOT_SIZE) != 0xFF || FLASH_BYTE(BOOT_SIZE + 1) != 0xFF);
+}
+
+static void start_firmware(uint8_t handoff)
+{
+  TWI0.SCTRLA = 0; // The firmware sets the target up again
+  GPIOR0 = handoff ? BOOT_HANDOFF : 0;
+  GPIOR1 = handoff;
+  ((void (*)(void))(BOOT_SIZE / 2))(); // Word address
+}
+
+// Run an NVM controller command, the CPU halts until a flash write is done
+static void nvm_command(uint8_t nvm_cmd)
+{
+  _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, nvm_cmd);
+  while (NVMCTRL.STATUS & NVMCTRL_FBUSY_bm) {}
+}
+
+static uint16_t image_crc(uint16_t size)
+{
+  uint16_t crc = 0xFFFF;
+  for (uint16_t i = 0; i < size; i++) {
+    crc = _crc_ccitt_update(crc, FLASH_BYTE(BOOT_SIZE + i));
+  }
+  return crc;
+}
+
+// A received byte, false to NACK it. Page data goes straight into the page
+// buffer, so the page is ready to write as soon as the STOP arrives
+static bool receive(uint8_t data)
+{
+  if (len == 0) {
+    cmd = data;
+  }
+  else if (cmd == BOOT_CMD_PAGE && len > 2) {
+    if (!page_ok || len - 3 >= BOOT_PAGE_SIZE) {
+      return false;
+    }
+    FLASH_BYTE(page_addr + len - 3) = data;
+  }
+  else if (len - 1 < sizeof(args)) {
+    args[len - 1] = data;
+  }
+  else {
+    return false;
+  }
+  len++;
+
+  if (cmd == BOOT_CMD_PAGE && len == 3) {
+    page_addr = args[0] | ((uint16_t)args[1] << 8);
+    page_ok = updating && page_addr % BOOT_PAGE_SIZE == 0 &&
+              page_addr >= BOOT_SIZE && page_addr < PROGMEM_SIZE;
+    if (page_ok) {
+      nvm_command(NVMCTRL_CMD_PAGEBUFCLR_gc);
+    }
+  }
+  return true;
+}
+
+// A write ended, act on it
+static void run_command()
+{
+  uint16_t size, crc;
+
+  switch (cmd) {
+    case BOOT_CMD_STATUS:
+      return;
+    case BOOT_CMD_BEGIN:
+      if (len != 2 || args[0] != BOOT_KEY) {
+        break;
+      }
+      eeprom_update_byte((uint8_t *)BOOT_EE_STATE, BOOT_STATE_UPDATING);
+      updating = true;
+      status = BOOT_STATUS_OK;
+      return;
+    case BOOT_CMD_PAGE:
+      if (!updating) {
+        status = BOOT_STATUS_ERR_ORDER;
+      }
+      else if (len >= 3 && !page_ok) {
+        status = BOOT_STATUS_ERR_ADDR;
+      }
+      else if (len != 3 + BOOT_PAGE_SIZE) {
+        status = BOOT_STATUS_ERR_CMD;
+        if (page_ok) {
+          nvm_command(NVMCTRL_CMD_PAGEBUFCLR_gc); // Don't leave a partial page for the next one
+        }
+      }
+      else {
+        nvm_command(NVMCTRL_CMD_PAGEERASEWRITE_gc);
+        status = BOOT_STATUS_OK;
+      }
+      page_ok = false;
+      return;
+    case BOOT_CMD_FINISH:
+      if (len != 5) {
+        break;
+      }
+      if (!updating) {
+        status = BOOT_STATUS_ERR_ORDER;
+        return;
+      }
+      size = args[0] | ((uint16_t)args[1] << 8);
+      crc  = args[2] | ((uint16_t)args[3] << 8);
+      if (size == 0 || size > PROGMEM_SIZE - BOOT_SIZE) {
+        break;
+      }
+      if (image_crc(size) != crc) {
+        status = BOOT_STATUS_ERR_CRC; // Still marked invalid, the Pi can send it again
+        return;
+      }
+      eeprom_update_byte((uint8_t *)BOOT_EE_STATE, BOOT_STATE_VALID);
+      updating = false;
+      status = BOOT_STATUS_OK;
+      return;
+    case BOOT_CMD_RUN:
+      if (len != 2 || args[0] != BOOT_KEY) {
+        break;
+      }
+      if (updating || !firmware_valid()) {
+        status = BOOT_STATUS_ERR_ORDER;
+        return;
+      }
+      start_firmware((PORTC.OUT & PWR_EN_bm) ? BOOT_HANDOFF_POWERED : 0);
+      return;
+  }
+  status = BOOT_STATUS_ERR_CMD;
+}
+
+static uint8_t status_byte(uint8_t index)
+{
+  switch (index & 3) {
+    case 0:  return BOOT_ID;
+    case 1:  return status;
+    case 2:  return BOOT_PAGE_SIZE;
+    default: return BOOT_SIZE >> 8;
+  }
+}
+
+static void twi_poll()
+{
+  uint8_t sstatus = TWI0.SSTATUS;
+
+  if (sstatus & (TWI_COLL_bm | TWI_BUSERR_bm)) {
+    // Drop whatever was being received
+    TWI0.SSTATUS = TWI_COLL_bm | TWI_BUSERR_bm;
+    TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+    receiving = false;
+    len = 0;
+  }
+  else if (sstatus & TWI_APIF_bm) {
+    if (sstatus & TWI_AP_bm) {
+      receiving = !(sstatus & TWI_DIR_bm);
+      len = 0;
+      read_index = 0;
+      TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+    }
+    else {
+      // Release the bus before a page write halts the CPU
+      TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+      if (receiving && len > 0) {
+        run_command();
+      }
+      receiving = false;
+      len = 0;
+    }
+  }
+  else if (sstatus & TWI_DIF_bm) {
+    if (sstatus & TWI_DIR_bm) {
+      if ((sstatus & TWI_RXACK_bm) && read_index > 0) {
+        TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc; // Host NACKed, done reading
+      }
+      else {
+        TWI0.SDATA = status_byte(read_index++);
+        TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+      }
+    }
+    else if (receive(TWI0.SDATA)) {
+      TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+    }
+    else {
+      TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc | TWI_ACKACT_NACK_gc;
+    }
+  }
+}
+
+// The pack can't hold the console up, and the update can't finish without it.
+// Drop the load and idle at the slowest clock, then start over on a press, as
+// the firmware does after a brown-out. An unfinished update is still marked
+static void power_off()
+{
+  PORTC.OUTCLR = PWR_EN_bm;
+  TWI0.SCTRLA = 0;
+  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLB, CLKCTRL_PDIV_64X_gc | CLKCTRL_PEN_bm);
+
+  PORTA.PIN2CTRL = PORT_PULLUPEN_bm;
+  while (PORTA.IN & BUTTON_bm) {}
+  _PROTECTED_WRITE(RSTCTRL.SWRR, RSTCTRL_SWRE_bm);
+}
+
+int main()
+{
+  bool resident = GPIOR0 == BOOT_HANDOFF; // Sent here by the firmware
+  GPIOR0 = 0;
+
+  if (!resident && firmware_valid()) {
+    start_firmware(0);
+  }
+
+  // The Pi sends the update, keep it powered. Also after a reset with no
+  // valid firmware, so an interrupted update can be sent again
+  PORTC.OUTSET = PWR_EN_bm;
+  PORTC.DIRSET = PWR_EN_bm;
+  BOD.VLMCTRLA = VLM_LEVEL; // Only runs with the BOD enabled, by the firmware's fuses
+
+  TWI0.SADDR = PI_I2C_ADDR << 1;
+  TWI0.SCTRLA = TWI_PIEN_bm | TWI_ENABLE_bm; // Stop flag, polled, no smart mode
+
+  while (1) {
+    twi_poll();
+    if (BOD.STATUS & BOD_VLMS_bm) {
+      power_off();
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#include "bus.h"
+
+#include "bq25895/bq25895_regs.h"
+
+namespace cafebarad {
+
+LinuxBus::LinuxBus() : bus_{-1, false}, dev_{} {
+    bq25895_linux_bind(&bus_, &dev_);
+}
+
+LinuxBus::~LinuxBus() {
+    bq25895_linux_close(&bus_);
+}
+
+bool LinuxBus::open(std::string const& path) {
+    bq25895_linux_close(&bus_);
+    return bq25895_linux_open(&bus_, path.c_str());
+}
+
+bool LinuxBus::read_spans(Span const* spans, std::size_t count, std::uint8_t* regs) {
+    bq25895_linux_span_t linux_spans[kRegs];
+    if (count > kRegs) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < count; i++) {
+        linux_spans[i] = {spans[i].reg, spans[i].len};
+    }
+
+    transfers_++;
+    return bq25895_linux_read_spans(&bus_, BQ_ADDR, linux_spans, count, regs);
+}
+
+FakeBus::FakeBus() : model_{}, dev_{} {
+    bq25895_model_init(&model_);
+    bq25895_model_bind(&model_, &dev_);
+}
+
+bool FakeBus::read_spans(Span const* spans, std::size_t count, std::uint8_t* regs) {
+    transfers_++;
+    for (std::size_t i = 0; i < count; i++) {
+        if (!bq25895_model_read(BQ_ADDR, spans[i].reg, &regs[spans[i].reg], spans[i].len, &model_)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace cafebarad
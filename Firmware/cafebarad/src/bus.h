@@ -0,0 +1,74 @@
+#pragma once
+
+#include "bq25895.h"
+#include "bq25895_linux.h"
+#include "bq25895_model.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cafebarad {
+
+// Number of BQ25895 registers, REG00 to REG14
+constexpr std::size_t kRegs = 0x15;
+
+struct Span {
+    std::uint8_t reg;
+    std::uint8_t len;
+};
+
+// A bus the BQ25895 sits on. Several register ranges can be read in one
+// transfer, so a status refresh costs a single round trip.
+class Bus {
+public:
+    virtual ~Bus() = default;
+
+    // Read each range into regs, at its register address
+    virtual bool read_spans(Span const* spans, std::size_t count, std::uint8_t* regs) = 0;
+
+    // Device handle for the driver, for anything not served from the cache
+    virtual bq25895_t const* device() const = 0;
+
+    // Bus transfers so far
+    std::uint32_t transfers() const { return transfers_; }
+
+protected:
+    std::uint32_t transfers_ = 0;
+};
+
+// The BQ25895 behind a Linux i2c-dev node
+class LinuxBus : public Bus {
+public:
+    LinuxBus();
+    ~LinuxBus() override;
+    LinuxBus(LinuxBus const&) = delete;
+    LinuxBus& operator=(LinuxBus const&) = delete;
+
+    bool open(std::string const& path);
+
+    bool read_spans(Span const* spans, std::size_t count, std::uint8_t* regs) override;
+    bq25895_t const* device() const override { return &dev_; }
+
+private:
+    bq25895_linux_t bus_;
+    bq25895_t dev_;
+};
+
+// In-process register model of the BQ25895, for tests and running without
+// hardware
+class FakeBus : public Bus {
+public:
+    FakeBus();
+
+    bool read_spans(Span const* spans, std::size_t count, std::uint8_t* regs) override;
+    bq25895_t const* device() const override { return &dev_; }
+
+    bq25895_model_t& model() { return model_; }
+
+private:
+    bq25895_model_t model_;
+    bq25895_t dev_;
+};
+
+} // namespace cafebarad
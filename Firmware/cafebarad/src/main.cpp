@@ -0,0 +1,104 @@
+// cafebarad: serves BQ25895 battery and charger telemetry to the Pi over a
+// Unix socket.
+//
+// Usage: cafebarad [-d /dev/i2c-1] [-s /run/cafebarad.sock] [-i interval_ms] [-f] [--fake]
+
+#include "bus.h"
+#include "server.h"
+#include "telemetry.h"
+
+#include "bq25895/bq25895_regs.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+using namespace cafebarad;
+
+static Server* server;
+
+static void on_signal(int) {
+    if (server) {
+        server->stop();
+    }
+}
+
+static void usage(char const* name) {
+    std::fprintf(stderr,
+                 "usage: %s [options]\n"
+                 "  -d, --device PATH    i2c-dev node (default /dev/i2c-1)\n"
+                 "  -s, --socket PATH    socket to serve on (default /run/cafebarad.sock)\n"
+                 "  -i, --interval MS    refresh interval (default 1000)\n"
+                 "  -f, --faults         also read REG0C, clearing the latched faults\n"
+                 "      --fake           use the in-process register model, not the bus\n",
+                 name);
+}
+
+int main(int argc, char** argv) {
+    std::string device = "/dev/i2c-1";
+    std::string socket = "/run/cafebarad.sock";
+    unsigned long interval = 1000;
+    bool faults = false;
+    bool fake = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if ((arg == "-d" || arg == "--device") && has_value) {
+            device = argv[++i];
+        } else if ((arg == "-s" || arg == "--socket") && has_value) {
+            socket = argv[++i];
+        } else if ((arg == "-i" || arg == "--interval") && has_value) {
+            interval = std::strtoul(argv[++i], nullptr, 0);
+        } else if (arg == "-f" || arg == "--faults") {
+            faults = true;
+        } else if (arg == "--fake") {
+            fake = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (interval == 0 || interval > 60000) {
+        std::fprintf(stderr, "interval must be 1 to 60000 ms\n");
+        return 1;
+    }
+
+    std::unique_ptr<Bus> bus;
+    if (fake) {
+        bus = std::make_unique<FakeBus>();
+    } else {
+        auto linux_bus = std::make_unique<LinuxBus>();
+        if (!linux_bus->open(device)) {
+            std::fprintf(stderr, "%s: %s\n", device.c_str(), std::strerror(errno));
+            return 1;
+        }
+        bus = std::move(linux_bus);
+    }
+
+    if (!bq25895_is_present(bus->device())) {
+        std::fprintf(stderr, "BQ25895 not found at 0x%02X\n", BQ_ADDR);
+    }
+
+    StatusCache cache(faults);
+    Server srv(*bus, cache, static_cast<std::uint32_t>(interval));
+    if (!srv.listen(socket)) {
+        std::fprintf(stderr, "%s: %s\n", socket.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    server = &srv;
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    srv.run();
+    server = nullptr;
+    return 0;
+}
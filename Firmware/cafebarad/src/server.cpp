@@ -0,0 +1,182 @@
+#include "server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace cafebarad {
+
+// Most clients served at once
+static constexpr std::size_t kMaxClients = 8;
+
+// Longest command line, anything longer drops the client
+static constexpr std::size_t kMaxLine = 64;
+
+std::uint64_t monotonic_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000U + static_cast<std::uint64_t>(ts.tv_nsec) / 1000000U;
+}
+
+Server::Server(Bus& bus, StatusCache& cache, std::uint32_t interval_ms)
+    : bus_(bus), cache_(cache), interval_ms_(interval_ms) {}
+
+Server::~Server() {
+    for (Client& client : clients_) {
+        close(client.fd);
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(path_.c_str());
+    }
+}
+
+bool Server::listen(std::string const& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        return false;
+    }
+
+    // Replace a socket left behind by a previous run
+    unlink(path.c_str());
+
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd_, static_cast<int>(kMaxClients)) < 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+
+    path_ = path;
+    return true;
+}
+
+std::string Server::handle(std::string const& command, std::uint64_t now_ms) {
+    if (command == "status") {
+        return cache_.status_json(now_ms);
+    }
+    if (command == "regs") {
+        return cache_.regs_json();
+    }
+    return "{\"error\":\"unknown command\"}";
+}
+
+void Server::accept_client() {
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (clients_.size() >= kMaxClients) {
+        close(fd);
+        return;
+    }
+    clients_.push_back({fd, {}, {}});
+}
+
+// Returns false when the client should be dropped
+bool Server::read_client(Client& client, std::uint64_t now_ms) {
+    char buf[256];
+    ssize_t len = read(client.fd, buf, sizeof(buf));
+    if (len == 0) {
+        return false;
+    }
+    if (len < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+
+    client.in.append(buf, static_cast<std::size_t>(len));
+
+    std::size_t end;
+    while ((end = client.in.find('\n')) != std::string::npos) {
+        std::string command = client.in.substr(0, end);
+        client.in.erase(0, end + 1);
+        if (!command.empty() && command.back() == '\r') {
+            command.pop_back();
+        }
+        client.out += handle(command, now_ms);
+        client.out += '\n';
+    }
+
+    return client.in.size() <= kMaxLine;
+}
+
+bool Server::write_client(Client& client) {
+    ssize_t len = write(client.fd, client.out.data(), client.out.size());
+    if (len < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+    client.out.erase(0, static_cast<std::size_t>(len));
+    return true;
+}
+
+void Server::run_once(int timeout_ms) {
+    std::uint64_t now = monotonic_ms();
+    if (now >= next_refresh_ms_) {
+        cache_.refresh(bus_, now);
+        next_refresh_ms_ = now + interval_ms_;
+    }
+
+    // Sleep no longer than the next refresh
+    std::uint64_t due = next_refresh_ms_ - now;
+    if (timeout_ms < 0 || due < static_cast<std::uint64_t>(timeout_ms)) {
+        timeout_ms = static_cast<int>(due);
+    }
+
+    std::vector<pollfd> fds;
+    fds.push_back({listen_fd_, POLLIN, 0});
+    for (Client const& client : clients_) {
+        fds.push_back({client.fd, static_cast<short>(POLLIN | (client.out.empty() ? 0 : POLLOUT)), 0});
+    }
+
+    if (poll(fds.data(), fds.size(), timeout_ms) <= 0) {
+        return;
+    }
+
+    now = monotonic_ms();
+    std::vector<Client> kept;
+    for (std::size_t i = 0; i < clients_.size(); i++) {
+        Client& client = clients_[i];
+        short events = fds[i + 1].revents;
+        bool keep = !(events & (POLLERR | POLLNVAL));
+        if (keep && (events & (POLLIN | POLLHUP))) {
+            keep = read_client(client, now);
+        }
+        // Replies are short, so still answer a client that has hung up
+        if (!(events & (POLLERR | POLLNVAL)) && !client.out.empty()) {
+            keep = write_client(client) && keep;
+        }
+
+        if (keep) {
+            kept.push_back(std::move(client));
+        } else {
+            close(client.fd);
+        }
+    }
+    clients_ = std::move(kept);
+
+    if (fds[0].revents & POLLIN) {
+        accept_client();
+    }
+}
+
+void Server::run() {
+    running_ = 1;
+    while (running_) {
+        run_once(-1);
+    }
+}
+
+} // namespace cafebarad
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "telemetry.h"
+
+#include <csignal>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cafebarad {
+
+// Unix socket server for the cached telemetry. Clients send one command per
+// line and get one line of JSON back:
+//   status  battery and charger telemetry
+//   regs    raw register snapshot
+// Requests are answered from the cache, so clients never add bus traffic.
+class Server {
+public:
+    Server(Bus& bus, StatusCache& cache, std::uint32_t interval_ms);
+    ~Server();
+    Server(Server const&) = delete;
+    Server& operator=(Server const&) = delete;
+
+    bool listen(std::string const& path);
+
+    // Refresh the cache when due, and serve clients for up to timeout_ms
+    void run_once(int timeout_ms);
+
+    // Serve until stop() is called, eg. from a signal handler
+    void run();
+    void stop() { running_ = 0; }
+
+    // Reply to a single command
+    std::string handle(std::string const& command, std::uint64_t now_ms);
+
+private:
+    struct Client {
+        int fd;
+        std::string in;
+        std::string out;
+    };
+
+    void accept_client();
+    bool read_client(Client& client, std::uint64_t now_ms);
+    bool write_client(Client& client);
+
+    Bus& bus_;
+    StatusCache& cache_;
+    std::uint32_t interval_ms_;
+    std::uint64_t next_refresh_ms_ = 0;
+    int listen_fd_ = -1;
+    std::string path_;
+    std::vector<Client> clients_;
+    volatile std::sig_atomic_t running_ = 0;
+};
+
+std::uint64_t monotonic_ms();
+
+} // namespace cafebarad
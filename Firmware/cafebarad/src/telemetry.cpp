@@ -0,0 +1,167 @@
+#include "telemetry.h"
+
+#include "bq25895/bq25895_regs.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace cafebarad {
+
+// Registers read on each refresh, skipping REG0C unless faults are wanted
+static constexpr Span kSpans[] = {
+    {BQ_REG00, BQ_REG0C - BQ_REG00},
+    {BQ_REG0D, kRegs - BQ_REG0D},
+};
+static constexpr Span kSpansFaults[] = {
+    {BQ_REG00, kRegs},
+};
+
+StatusCache::StatusCache(bool read_faults)
+    : read_faults_(read_faults), dev_{cached_write, cached_read, nullptr, this} {}
+
+bool StatusCache::cached_read(std::uint16_t addr, std::uint8_t reg, void* buf, std::size_t len, void* context) {
+    auto const* cache = static_cast<StatusCache const*>(context);
+
+    if (addr != BQ_ADDR || reg + len > kRegs) {
+        return false;
+    }
+    if (!cache->read_faults_ && reg <= BQ_REG0C && reg + len > BQ_REG0C) {
+        return false;
+    }
+
+    std::memcpy(buf, cache->source_->data() + reg, len);
+    return true;
+}
+
+// The cache only decodes, it never writes to the charger
+bool StatusCache::cached_write(std::uint16_t, std::uint8_t, void const*, std::size_t, void*) {
+    return false;
+}
+
+bool StatusCache::refresh(Bus& bus, std::uint64_t now_ms) {
+    Span const* spans = read_faults_ ? kSpansFaults : kSpans;
+    std::size_t count = read_faults_ ? std::size(kSpansFaults) : std::size(kSpans);
+
+    Telemetry telemetry;
+    pending_ = regs_;
+    source_ = &pending_;
+    bool ok = bus.read_spans(spans, count, pending_.data()) && decode(telemetry);
+    source_ = &regs_;
+
+    if (!ok) {
+        errors_++;
+        return false;
+    }
+
+    regs_ = pending_;
+    telemetry_ = telemetry;
+    valid_ = true;
+    updates_++;
+    updated_ms_ = now_ms;
+    return true;
+}
+
+bool StatusCache::decode(Telemetry& out) const {
+    bq25895_adc_t adc;
+    bq25895_iin_max_t iin_max;
+    bq25895_chg_current_t ichg_max;
+    bq25895_vchg_max_t vreg;
+
+    if (!bq25895_read_adc(&dev_, &adc) || !bq25895_is_charger_connected(&dev_, &out.power_good) ||
+        !bq25895_is_in_dpm(&dev_, &out.dpm) || !bq25895_get_charge_state(&dev_, &out.charge_state) ||
+        !bq25895_get_source_type(&dev_, &out.source) || !bq25895_get_iin_max(&dev_, &iin_max) ||
+        !bq25895_get_charge_current(&dev_, &ichg_max) || !bq25895_get_max_charge_voltage(&dev_, &vreg)) {
+        return false;
+    }
+
+    out.batt_mv = adc.batt_mv;
+    out.sys_mv = adc.sys_mv;
+    out.vbus_mv = adc.vbus_mv;
+    out.ichg_ma = adc.ichg_ma;
+    out.ts_pct = adc.ts_pct;
+    out.vbus_good = adc.vbus_good;
+    out.therm_reg = adc.therm_reg;
+    out.iin_max_ma = iin_max;
+    out.ichg_max_ma = ichg_max;
+    out.vreg_mv = vreg;
+
+    out.has_faults = read_faults_ && bq25895_check_faults(&dev_, &out.faults);
+    return true;
+}
+
+char const* charge_state_name(bq25895_charge_state_t state) {
+    switch (state) {
+    case BQ_STATE_NOT_CHARGING:
+        return "not_charging";
+    case BQ_STATE_PRECHARGE:
+        return "precharge";
+    case BQ_STATE_FAST_CHARGE:
+        return "fast_charge";
+    case BQ_STATE_TERMINATED:
+        return "terminated";
+    }
+    return "unknown";
+}
+
+char const* source_name(bq25895_source_type_t source) {
+    switch (source) {
+    case BQ_SOURCE_NONE:
+        return "none";
+    case BQ_SOURCE_USB_SDP:
+        return "sdp";
+    case BQ_SOURCE_USB_CDP:
+        return "cdp";
+    case BQ_SOURCE_USB_DCP:
+        return "dcp";
+    case BQ_SOURCE_ADJ:
+        return "adjustable";
+    case BQ_SOURCE_UNKNOWN:
+        return "unknown";
+    case BQ_SOURCE_NSTD:
+        return "non_standard";
+    case BQ_SOURCE_OTG:
+        return "otg";
+    }
+    return "unknown";
+}
+
+std::string StatusCache::status_json(std::uint64_t now_ms) const {
+    if (!valid_) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "{\"valid\":false,\"errors\":%u}", static_cast<unsigned>(errors_));
+        return buf;
+    }
+
+    Telemetry const& t = telemetry_;
+    char faults[16] = "null";
+    if (t.has_faults) {
+        std::snprintf(faults, sizeof(faults), "%u", static_cast<unsigned>(t.faults));
+    }
+
+    char buf[512];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"valid\":true,\"age_ms\":%llu,\"batt_mv\":%u,\"sys_mv\":%u,\"vbus_mv\":%u,"
+                  "\"ichg_ma\":%u,\"ts_pct\":%u.%u,\"vbus_good\":%s,\"power_good\":%s,"
+                  "\"therm_reg\":%s,\"dpm\":%s,\"charge_state\":\"%s\",\"source\":\"%s\","
+                  "\"iin_max_ma\":%u,\"ichg_max_ma\":%u,\"vreg_mv\":%u,\"faults\":%s,"
+                  "\"updates\":%u,\"errors\":%u}",
+                  static_cast<unsigned long long>(now_ms - updated_ms_), t.batt_mv, t.sys_mv, t.vbus_mv,
+                  t.ichg_ma, t.ts_pct / 10U, t.ts_pct % 10U, t.vbus_good ? "true" : "false",
+                  t.power_good ? "true" : "false", t.therm_reg ? "true" : "false", t.dpm ? "true" : "false",
+                  charge_state_name(t.charge_state), source_name(t.source), t.iin_max_ma, t.ichg_max_ma,
+                  t.vreg_mv, faults, static_cast<unsigned>(updates_), static_cast<unsigned>(errors_));
+    return buf;
+}
+
+std::string StatusCache::regs_json() const {
+    std::string out = "{\"regs\":[";
+    for (std::size_t i = 0; i < regs_.size(); i++) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "%s%u", i ? "," : "", static_cast<unsigned>(regs_[i]));
+        out += buf;
+    }
+    out += "]}";
+    return out;
+}
+
+} // namespace cafebarad
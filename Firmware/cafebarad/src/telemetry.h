@@ -0,0 +1,80 @@
+#pragma once
+
+#include "bus.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace cafebarad {
+
+// Battery and charger state, decoded from one register snapshot
+struct Telemetry {
+    std::uint16_t batt_mv = 0;
+    std::uint16_t sys_mv = 0;
+    std::uint16_t vbus_mv = 0;
+    std::uint16_t ichg_ma = 0;
+    std::uint16_t ts_pct = 0; // 0.1% of REGN
+    bool vbus_good = false;
+    bool power_good = false;
+    bool therm_reg = false;
+    bool dpm = false;
+    bq25895_charge_state_t charge_state = BQ_STATE_NOT_CHARGING;
+    bq25895_source_type_t source = BQ_SOURCE_NONE;
+
+    // Charger settings
+    std::uint16_t iin_max_ma = 0;
+    std::uint16_t ichg_max_ma = 0;
+    std::uint16_t vreg_mv = 0;
+
+    // Latched faults, only when REG0C is read (reading it clears the latch)
+    bool has_faults = false;
+    bq25895_fault_t faults = BQ_FAULT_NONE;
+};
+
+// Register snapshot of the BQ25895, refreshed with a single bus transfer and
+// decoded by the driver from memory
+class StatusCache {
+public:
+    // REG0C is left alone by default, as reading it clears the latched
+    // faults the firmware also relies on
+    explicit StatusCache(bool read_faults = false);
+
+    // Read the registers and decode them, keeping the last good state on error
+    bool refresh(Bus& bus, std::uint64_t now_ms);
+
+    bool valid() const { return valid_; }
+    Telemetry const& telemetry() const { return telemetry_; }
+    std::array<std::uint8_t, kRegs> const& regs() const { return regs_; }
+
+    std::uint32_t updates() const { return updates_; }
+    std::uint32_t errors() const { return errors_; }
+    std::uint64_t updated_ms() const { return updated_ms_; }
+
+    // Telemetry as a single line of JSON
+    std::string status_json(std::uint64_t now_ms) const;
+    std::string regs_json() const;
+
+private:
+    static bool cached_read(std::uint16_t addr, std::uint8_t reg, void* buf, std::size_t len, void* context);
+    static bool cached_write(
+      std::uint16_t addr, std::uint8_t reg, void const* buf, std::size_t len, void* context);
+
+    bool decode(Telemetry& out) const;
+
+    bool read_faults_;
+    std::array<std::uint8_t, kRegs> regs_{};
+    std::array<std::uint8_t, kRegs> pending_{};
+    std::array<std::uint8_t, kRegs> const* source_ = &regs_;
+    Telemetry telemetry_;
+    bool valid_ = false;
+    std::uint32_t updates_ = 0;
+    std::uint32_t errors_ = 0;
+    std::uint64_t updated_ms_ = 0;
+    bq25895_t dev_;
+};
+
+char const* charge_state_name(bq25895_charge_state_t state);
+char const* source_name(bq25895_source_type_t source);
+
+} // namespace cafebarad
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Run cafebarad against the i2c-stub kernel module, seeded with a charging BQ25895:
+#   modprobe i2c-stub chip_addr=0x6a
+# Exits 77 (skipped) when no i2c-stub adapter is present.
+
+daemon="$1"
+sock="${TMPDIR:-/tmp}/cafebarad_stub.$$"
+
+bus=""
+for name in /sys/class/i2c-dev/i2c-*/name; do
+    [ -r "$name" ] || continue
+    if grep -q "SMBus stub driver" "$name"; then
+        bus=$(basename "$(dirname "$name")")
+    fi
+done
+if [ -z "$bus" ] || [ ! -w "/dev/$bus" ] || ! command -v i2cset >/dev/null; then
+    echo "i2c-stub not loaded, skipping"
+    exit 77
+fi
+num=${bus#i2c-}
+
+# REG03 CHG_CONFIG, REG0B DCP fast charge, ADC block 4164 mV / 4104 mV / 5000 mV / 2000 mA
+i2cset -y "$num" 0x6a 0x03 0x3a
+i2cset -y "$num" 0x6a 0x0b 0x74
+i2cset -y "$num" 0x6a 0x0e 0x5d
+i2cset -y "$num" 0x6a 0x0f 0x5a
+i2cset -y "$num" 0x6a 0x10 0x40
+i2cset -y "$num" 0x6a 0x11 0x98
+i2cset -y "$num" 0x6a 0x12 0x28
+i2cset -y "$num" 0x6a 0x14 0x39
+
+"$daemon" -d "/dev/$bus" -s "$sock" -i 100 &
+pid=$!
+trap 'kill $pid 2>/dev/null; rm -f "$sock"' EXIT
+
+sleep 0.5
+reply=$(printf 'status\n' | timeout 2 socat - "UNIX-CONNECT:$sock" 2>/dev/null ||
+        printf 'status\n' | timeout 2 nc -U "$sock")
+echo "$reply"
+
+echo "$reply" | grep -q '"batt_mv":4164' &&
+echo "$reply" | grep -q '"charge_state":"fast_charge"' &&
+echo "$reply" | grep -q '"source":"dcp"'
@@ -0,0 +1,184 @@
+// Tests for cafebarad, run against the in-process register model
+
+#include "bus.h"
+#include "server.h"
+#include "telemetry.h"
+
+#include "bq25895/bq25895_regs.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace cafebarad;
+
+static bool contains(std::string const& haystack, char const* needle) {
+    return haystack.find(needle) != std::string::npos;
+}
+
+// Charging from a DCP, with a full ADC block
+static void load_charging(bq25895_model_t& model) {
+    model.regs[BQ_REG0B] = (BQ_SOURCE_USB_DCP << BQ_VBUS_STAT_POS) |
+                           (BQ_STATE_FAST_CHARGE << BQ_CHRG_STAT_POS) | BQ_PG_STAT_MSK;
+    model.regs[BQ_REG0E] = 0x5D;                   // 2304 + 93 * 20 = 4164 mV
+    model.regs[BQ_REG0F] = 0x5A;                   // 2304 + 90 * 20 = 4104 mV
+    model.regs[BQ_REG10] = 0x40;                   // 21% + 64 * 0.465% = 50.76%
+    model.regs[BQ_REG11] = BQ_VBUS_GD_MSK | 0x18;  // 2600 + 24 * 100 = 5000 mV
+    model.regs[BQ_REG12] = 0x28;                   // 40 * 50 = 2000 mA
+}
+
+static void test_refresh(void) {
+    FakeBus bus;
+    StatusCache cache;
+
+    load_charging(bus.model());
+    CHECK(!cache.valid());
+    CHECK(cache.refresh(bus, 100));
+    CHECK(cache.valid());
+
+    // One transfer for the whole snapshot, decoded without touching the bus again
+    CHECK_EQ(bus.transfers(), 1);
+    CHECK_EQ(bus.model().writes, 0);
+
+    Telemetry const& t = cache.telemetry();
+    CHECK_EQ(t.batt_mv, 4164);
+    CHECK_EQ(t.sys_mv, 4104);
+    CHECK_EQ(t.vbus_mv, 5000);
+    CHECK_EQ(t.ichg_ma, 2000);
+    CHECK(t.vbus_good);
+    CHECK(t.power_good);
+    CHECK_EQ(t.charge_state, BQ_STATE_FAST_CHARGE);
+    CHECK_EQ(t.source, BQ_SOURCE_USB_DCP);
+    CHECK_EQ(t.ichg_max_ma, 2048); // Power-on defaults
+    CHECK_EQ(t.vreg_mv, 4208);
+    CHECK(!t.has_faults);
+
+    CHECK_EQ(cache.updates(), 1);
+    CHECK_EQ(cache.updated_ms(), 100);
+}
+
+static void test_faults_latch(void) {
+    FakeBus bus;
+
+    // REG0C is skipped by default, leaving the latch for the firmware
+    StatusCache cache;
+    bus.model().regs[BQ_REG0C] = BQ_FAULT_WATCHDOG;
+    CHECK(cache.refresh(bus, 0));
+    CHECK(!cache.telemetry().has_faults);
+    CHECK_EQ(bus.model().regs[BQ_REG0C], BQ_FAULT_WATCHDOG);
+    CHECK(contains(cache.status_json(0), "\"faults\":null"));
+
+    // Unless asked for, still in one transfer
+    StatusCache with_faults(true);
+    CHECK(with_faults.refresh(bus, 0));
+    CHECK_EQ(bus.transfers(), 2);
+    CHECK(with_faults.telemetry().has_faults);
+    CHECK_EQ(with_faults.telemetry().faults, BQ_FAULT_WATCHDOG);
+    CHECK_EQ(bus.model().regs[BQ_REG0C], BQ_FAULT_NONE);
+    CHECK(contains(with_faults.status_json(0), "\"faults\":128"));
+}
+
+static void test_bus_error(void) {
+    FakeBus bus;
+    StatusCache cache;
+
+    bus.model().nack = true;
+    CHECK(!cache.refresh(bus, 0));
+    CHECK(!cache.valid());
+    CHECK_EQ(cache.errors(), 1);
+    CHECK(cache.status_json(0) == "{\"valid\":false,\"errors\":1}");
+
+    // The last good state is kept through errors
+    bus.model().nack = false;
+    load_charging(bus.model());
+    CHECK(cache.refresh(bus, 1000));
+    bus.model().nack = true;
+    bus.model().regs[BQ_REG0E] = 0;
+    CHECK(!cache.refresh(bus, 2000));
+    CHECK(cache.valid());
+    CHECK_EQ(cache.telemetry().batt_mv, 4164);
+    CHECK_EQ(cache.updated_ms(), 1000);
+    CHECK(contains(cache.status_json(2500), "\"age_ms\":1500"));
+}
+
+static void test_json(void) {
+    FakeBus bus;
+    StatusCache cache;
+    Server server(bus, cache, 1000);
+
+    load_charging(bus.model());
+    CHECK(cache.refresh(bus, 0));
+
+    std::string status = server.handle("status", 0);
+    CHECK(contains(status, "\"valid\":true"));
+    CHECK(contains(status, "\"batt_mv\":4164"));
+    CHECK(contains(status, "\"ts_pct\":50.7"));
+    CHECK(contains(status, "\"charge_state\":\"fast_charge\""));
+    CHECK(contains(status, "\"source\":\"dcp\""));
+    CHECK(contains(status, "\"vbus_good\":true"));
+
+    CHECK(contains(server.handle("regs", 0), "{\"regs\":[72,"));
+    CHECK(contains(server.handle("bogus", 0), "error"));
+}
+
+// A client on the socket, served from the cache
+static void test_socket(void) {
+    FakeBus bus;
+    StatusCache cache;
+    Server server(bus, cache, 1000);
+
+    char path[] = "/tmp/cafebarad_test_XXXXXX";
+    int tmp = mkstemp(path);
+    CHECK(tmp >= 0);
+    close(tmp);
+
+    load_charging(bus.model());
+    CHECK(server.listen(path));
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    CHECK(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+
+    server.run_once(0); // Refresh, and accept the client
+    CHECK_EQ(bus.transfers(), 1);
+
+    char const request[] = "status\nregs\n";
+    CHECK(write(fd, request, sizeof(request) - 1) == sizeof(request) - 1);
+
+    std::string reply;
+    for (int i = 0; i < 10 && std::count(reply.begin(), reply.end(), '\n') < 2; i++) {
+        server.run_once(100);
+
+        char buf[1024];
+        ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len > 0) {
+            reply.append(buf, static_cast<std::size_t>(len));
+        }
+    }
+
+    CHECK(contains(reply, "\"batt_mv\":4164"));
+    CHECK(contains(reply, "{\"regs\":["));
+
+    // Clients never cause bus traffic of their own
+    CHECK_EQ(bus.transfers(), 1);
+
+    close(fd);
+}
+
+int main() {
+    test_refresh();
+    test_faults_latch();
+    test_bus_error();
+    test_json();
+    test_socket();
+
+    return check_done();
+}